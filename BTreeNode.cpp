@@ -4,7 +4,9 @@
  * @see "Seattle University, CPSC5300, Winter 2023"
  */
 
+#include <algorithm>
 #include <cstring>
+#include <iterator>
 #include "BTreeNode.h"
 
 using namespace std;
@@ -13,8 +15,8 @@ using namespace std;
  * BTreeNode base class *
  ************************/
 
-BTreeNode::BTreeNode(HeapFile &file, BlockID block_id, const KeyProfile &key_profile, bool create) 
-    : block(nullptr), file(file), id(block_id), key_profile(key_profile) {
+BTreeNode::BTreeNode(HeapFile &file, BlockID block_id, const KeyCodec &key_codec, bool create) 
+    : block(nullptr), file(file), id(block_id), key_codec(key_codec) {
     if (create) {
         this->block = file.get_new();
         this->id = this->block->get_block_id();
@@ -32,115 +34,73 @@ void BTreeNode::save() {
     this->file.put(this->block);
 }
 
-// Get the record and turn it into a block ID.
-BlockID BTreeNode::get_block_id(RecordID record_id) const {
-    Dbt *dbt = this->block->get(record_id);
-    BlockID block_id = *(BlockID *) dbt->get_data();
-    delete dbt;
-    return block_id;
+uint BTreeNode::used_bytes() const {
+    return this->capacity() - this->block->unused_bytes();
 }
 
-// Get the record and turn it into a Handle.
-Handle BTreeNode::get_handle(RecordID record_id) const {
-    Dbt *dbt = this->block->get(record_id);
-    BlockID handle_block_id = *(BlockID *) dbt->get_data();
-    RecordID handle_record_id = *(RecordID *) ((char *) dbt->get_data() + sizeof(BlockID));
-    delete dbt;
-    return Handle(handle_block_id, handle_record_id);
-}
-
-// Get the record and turn it into a KeyValue.
-KeyValue *BTreeNode::get_key(RecordID record_id) const {
-    Dbt *dbt = this->block->get(record_id);
-    char *bytes = (char *) dbt->get_data();
-    KeyValue *key_value = new KeyValue();
-    Value value;
-    uint offset = 0;
-    for (auto const &data_type: this->key_profile) {
-        value.data_type = data_type;
-        if (data_type == ColumnAttribute::DataType::INT) {
-            value.n = *(int32_t *) (bytes + offset);
-            offset += sizeof(int32_t);
-        } else if (data_type == ColumnAttribute::DataType::TEXT) {
-            uint16_t size = *(uint16_t *) (bytes + offset);
-            offset += sizeof(uint16_t);
-            char buffer[DbBlock::BLOCK_SZ];
-            memcpy(buffer, bytes + offset, size);
-            buffer[size] = '\0';
-            value.s = std::string(buffer);  // assume ascii for now
-            offset += size;
-        } else if (data_type == ColumnAttribute::DataType::BOOLEAN) {
-            value.n = *(uint8_t *) (bytes + offset);
-            offset += sizeof(uint8_t);
-        } else {
-            throw DbRelationError("Only know how to unmarshal INT, TEXT, or BOOLEAN");
-        }
-        key_value->push_back(value);
-    }
-    delete dbt;
-    return key_value;
-}
-
-// Convert block_id into bytes.
-Dbt *BTreeNode::marshal_block_id(BlockID block_id) {
-    char *bytes = new char[sizeof(BlockID)];
-    Dbt *dbt = new Dbt(bytes, sizeof(BlockID));
-    *(BlockID *) bytes = block_id;
-    return dbt;
+void BTreeNode::discard() {
+    this->block->clear();
+    this->file.put(this->block);
 }
 
-// Convert handle into bytes.
-Dbt *BTreeNode::marshal_handle(Handle handle) {
-    char *bytes = new char[sizeof(BlockID) + sizeof(RecordID)];
-    Dbt *dbt = new Dbt(bytes, sizeof(BlockID) + sizeof(RecordID));
-    *(BlockID *) bytes = handle.first;
-    *(RecordID *) (bytes + sizeof(BlockID)) = handle.second;
-    return dbt;
+// Bytes taken by a record in a block (slot header plus data).
+static uint record_size(uint data_size) {
+    return 2 * sizeof(u_int16_t) + data_size;
 }
 
-// Convert KeyValue into bytes.
-Dbt *BTreeNode::marshal_key(const KeyValue *key) {
-    char *bytes = new char[DbBlock::BLOCK_SZ]; // more than we need
-    uint offset = 0;
-    uint col_num = 0;
-    for (auto const &data_type: this->key_profile) {
-        Value value = (*key)[col_num];
+// Bytes taken by an empty node: the block header and the node's block pointer.
+static const uint NODE_OVERHEAD = SlottedPage::HEADER_SIZE + record_size(sizeof(BlockID));
 
-        if (data_type == ColumnAttribute::DataType::INT) {
-            if (offset + 4 > DbBlock::BLOCK_SZ - 4)
-                throw DbRelationError("index key too big to marshal");
+// Get the record and turn it into a block ID.
+BlockID BTreeNode::get_block_id(RecordID record_id) const {
+    u_int16_t size;
+    return *(BlockID *) this->block->get_record(record_id, size);
+}
 
-            *(int32_t *) (bytes + offset) = value.n;
-            offset += sizeof(int32_t);
+uint BTreeNode::entry_count() const {
+    u_int16_t records = this->block->size();
+    return records < FIRST_ENTRY ? 0 : records - (FIRST_ENTRY - 1);
+}
 
-        } else if (data_type == ColumnAttribute::DataType::TEXT) {
-            u_long size = (uint16_t) value.s.length();
-            if (size > UINT16_MAX)
-                throw DbRelationError("text field too long to marshal");
-            if (offset + 2 + size > DbBlock::BLOCK_SZ)
-                throw DbRelationError("index key too big to marshal");
+const char *BTreeNode::entry(uint i, u_int16_t &size) const {
+    return this->block->get_record(FIRST_ENTRY + i, size);
+}
 
-            *(uint16_t *) (bytes + offset) = (uint16_t) size;
-            offset += sizeof(uint16_t);
-            memcpy(bytes + offset, value.s.c_str(), size); // assume ascii for now
-            offset += size;
+const char *BTreeNode::entry_key(const char *bytes, u_int16_t size, uint &key_size) const {
+    key_size = size;
+    return bytes;
+}
 
-        } else if (data_type == ColumnAttribute::DataType::BOOLEAN) {
-            if (offset + 1 > DbBlock::BLOCK_SZ - 1)
-                throw DbRelationError("index key too big to marshal");
+uint BTreeNode::search(const KeyBytes *key, bool or_equal) const {
+    uint low = 0, high = this->entry_count();
+    while (low < high) {
+        uint middle = (low + high) / 2;
+        u_int16_t size;
+        const char *bytes = this->entry(middle, size);
+        uint probe_size;
+        const char *probe = this->entry_key(bytes, size, probe_size);
+        int cmp = KeyCodec::compare(probe, probe_size, key->data(), (uint) key->size());
+        if (or_equal ? cmp < 0 : cmp <= 0)
+            low = middle + 1;  // the answer is to the right of middle
+        else
+            high = middle;
+    }
+    return low;
+}
 
-            *(uint8_t *) (bytes + offset) = (uint8_t) value.n;
-            offset += sizeof(uint8_t);
+char *BTreeNode::add_entry(const KeyBytes *key, uint key_offset, uint trailing) {
+    RecordID record_id;
+    char *bytes = this->block->allocate((u_int16_t) (key_offset + key->size() + trailing), record_id);
+    std::memcpy(bytes + key_offset, key->data(), key->size());
+    return bytes;
+}
 
-        } else {
-            throw DbRelationError("only know how to marshal INT, TEXT, or BOOLEAN for BTree index");
-        }
-    }
-    char *right_size_bytes = new char[offset];
-    memcpy(right_size_bytes, bytes, offset);
-    delete[] bytes;
-    Dbt *data = new Dbt(right_size_bytes, offset);
-    return data;
+// Convert block_id into bytes.
+Dbt *BTreeNode::marshal_block_id(BlockID block_id) {
+    char *bytes = new char[sizeof(BlockID)];
+    Dbt *dbt = new Dbt(bytes, sizeof(BlockID));
+    *(BlockID *) bytes = block_id;
+    return dbt;
 }
 
 
@@ -148,13 +108,13 @@ Dbt *BTreeNode::marshal_key(const KeyValue *key) {
  * BTreeStat statistics block *
  ******************************/
 
-BTreeStat::BTreeStat(HeapFile &file, BlockID stat_id, BlockID new_root, const KeyProfile &key_profile) 
-    : BTreeNode(file, stat_id, key_profile, false), root_id(new_root), height(1) {
+BTreeStat::BTreeStat(HeapFile &file, BlockID stat_id, BlockID new_root, const KeyCodec &key_codec) 
+    : BTreeNode(file, stat_id, key_codec, false), root_id(new_root), height(1) {
     save();
 }
 
-BTreeStat::BTreeStat(HeapFile &file, BlockID stat_id, const KeyProfile &key_profile)
-    : BTreeNode(file, stat_id, key_profile, false), root_id(get_block_id(ROOT)), height(get_block_id(HEIGHT)) {
+BTreeStat::BTreeStat(HeapFile &file, BlockID stat_id, const KeyCodec &key_codec)
+    : BTreeNode(file, stat_id, key_codec, false), root_id(get_block_id(ROOT)), height(get_block_id(HEIGHT)) {
 }
 
 void BTreeStat::save() {
@@ -183,280 +143,544 @@ void BTreeStat::save() {
  * BTreeInterior *
  *****************/
 
-BTreeInterior::BTreeInterior(HeapFile &file, BlockID block_id, const KeyProfile &key_profile, bool create) : BTreeNode(
-        file, block_id, key_profile, create), first(0), pointers(), boundaries() {
-    if (!create) {
-        RecordIDs *record_id_list = this->block->ids();
-        RecordID i = 1;
-        for (auto j = record_id_list->size(); j > 0; j--) {
-            if (i == 1) {
-                // first pointer
-                this->first = get_block_id(i);
-            } else if (i % 2 != 0) {
-                // pointer
-                this->pointers.push_back(get_block_id(i));
-            } else {
-                // key
-                KeyValue *key_value = get_key(i);
-                this->boundaries.push_back(key_value);
-            }
-            i++;
-        }
-        delete record_id_list;
-    }
+BTreeInterior::BTreeInterior(HeapFile &file, BlockID block_id, const KeyCodec &key_codec, bool create) : BTreeNode(
+        file, block_id, key_codec, create), first(0), loaded(create), pointers(), boundaries() {
+    if (!create && this->block->size() > 0)
+        this->first = get_block_id(1);
 }
 
 BTreeInterior::~BTreeInterior() {
-    for (auto key_value: this->boundaries)
-        delete key_value;
-    this->boundaries.clear();
+}
+
+// Parse the entries so they can be changed.
+void BTreeInterior::load() {
+    if (this->loaded)
+        return;
+    uint n = this->entry_count();
+    for (uint i = 0; i < n; i++) {
+        u_int16_t size;
+        const char *bytes = this->entry(i, size);
+        this->pointers.push_back(*(BlockID *) bytes);
+        this->boundaries.push_back(KeyBytes(bytes + KEY_OFFSET, size - KEY_OFFSET));
+    }
+    this->loaded = true;
 }
 
 // Get next block down in tree where key must be.
-BTreeNode *BTreeInterior::find(const KeyValue *key, uint depth) const {
-    BlockID down = this->pointers.back();  // last pointer is correct if we don't find an earlier boundary
-    for (uint i = 0; i < this->boundaries.size(); i++) {
-        KeyValue *boundary = this->boundaries[i];
-        if (*boundary > *key) {
-            if (i > 0)
-                down = this->pointers[i - 1];
-            else
-                down = this->first;
+BTreeNode *BTreeInterior::find(const KeyBytes *key, uint depth) const {
+    return this->child(this->get_child_id(this->find_child(key)), depth);
+}
+
+// Get the leftmost block down in the tree.
+BTreeNode *BTreeInterior::find_first(uint depth) const {
+    return this->child(this->first, depth);
+}
+
+// The child to the left of the first boundary greater than key.
+uint BTreeInterior::find_child(const KeyBytes *key) const {
+    return this->search(key, false);
+}
+
+const char *BTreeInterior::entry_key(const char *bytes, u_int16_t size, uint &key_size) const {
+    key_size = size - KEY_OFFSET;
+    return bytes + KEY_OFFSET;
+}
+
+BlockID BTreeInterior::get_child_id(uint k) const {
+    u_int16_t size;
+    return k == 0 ? this->first : *(BlockID *) this->entry(k - 1, size);
+}
+
+KeyBytes BTreeInterior::get_boundary(uint i) const {
+    u_int16_t size;
+    const char *bytes = this->entry(i, size);
+    return KeyBytes(bytes + KEY_OFFSET, size - KEY_OFFSET);
+}
+
+void BTreeInterior::set_boundary(uint i, const KeyBytes &boundary) {
+    this->load();
+    this->boundaries[i] = boundary;
+}
+
+void BTreeInterior::remove_child(uint k) {
+    this->load();
+    this->boundaries.erase(this->boundaries.begin() + (k - 1));
+    this->pointers.erase(this->pointers.begin() + (k - 1));
+}
+
+uint BTreeInterior::used_bytes() const {
+    if (!this->loaded)
+        return BTreeNode::used_bytes();
+    uint used = NODE_OVERHEAD;
+    for (auto const &boundary: this->boundaries)
+        used += record_size(KEY_OFFSET + (uint) boundary.size());
+    return used;
+}
+
+bool BTreeInterior::can_merge(const KeyBytes *separator, const BTreeInterior *right) const {
+    uint extra = right->used_bytes() - NODE_OVERHEAD + record_size(KEY_OFFSET + separator->size());
+    return this->used_bytes() + extra <= this->capacity();
+}
+
+void BTreeInterior::merge(const KeyBytes *separator, BTreeInterior *right) {
+    this->load();
+    right->load();
+    this->boundaries.push_back(*separator);
+    this->pointers.push_back(right->first);
+    this->boundaries.insert(this->boundaries.end(), right->boundaries.begin(), right->boundaries.end());
+    this->pointers.insert(this->pointers.end(), right->pointers.begin(), right->pointers.end());
+    right->boundaries.clear();
+    right->pointers.clear();
+}
+
+KeyBytes BTreeInterior::redistribute(const KeyBytes *separator, BTreeInterior *right) {
+    this->load();
+    right->load();
+    // rotate entries through the parent's separator until the two are about the same size
+    KeyBytes boundary = *separator;
+    while (this->used_bytes() < right->used_bytes() && right->boundaries.size() > 1) {
+        uint moving = record_size(KEY_OFFSET + boundary.size());
+        if (this->used_bytes() + moving >= right->used_bytes())
             break;
-        }
+        this->boundaries.push_back(boundary);
+        this->pointers.push_back(right->first);
+        boundary = right->boundaries.front();
+        right->first = right->pointers.front();
+        right->boundaries.erase(right->boundaries.begin());
+        right->pointers.erase(right->pointers.begin());
+    }
+    while (right->used_bytes() < this->used_bytes() && this->boundaries.size() > 1) {
+        uint moving = record_size(KEY_OFFSET + boundary.size());
+        if (right->used_bytes() + moving >= this->used_bytes())
+            break;
+        right->boundaries.insert(right->boundaries.begin(), boundary);
+        right->pointers.insert(right->pointers.begin(), right->first);
+        right->first = this->pointers.back();
+        boundary = this->boundaries.back();
+        this->boundaries.pop_back();
+        this->pointers.pop_back();
     }
+    return boundary;
+}
+
+// Add a boundary and the child to its right after all the others, unless that takes the node past limit bytes.
+bool BTreeInterior::append(const KeyBytes *boundary, BlockID block_id, uint limit) {
+    this->load();
+    if (this->used_bytes() + record_size(KEY_OFFSET + boundary->size()) > limit)
+        return false;
+    this->boundaries.push_back(*boundary);
+    this->pointers.push_back(block_id);
+    return true;
+}
+
+BTreeNode *BTreeInterior::child(BlockID down, uint depth) const {
     if (depth == 2)
-        return new BTreeLeaf(this->file, down, this->key_profile, false);
+        return new BTreeLeaf(this->file, down, this->key_codec, false);
     else
-        return new BTreeInterior(this->file, down, this->key_profile, false);
+        return new BTreeInterior(this->file, down, this->key_codec, false);
 }
 
-// Save the pointers and boundaries in the correct order
+// Save the first pointer and then each boundary packed with the pointer to its right
 void BTreeInterior::save() {
-    Dbt *dbt;
+    this->load();
     this->block->clear();
-    dbt = marshal_block_id(this->first);
+    Dbt *dbt = marshal_block_id(this->first);
     this->block->add(dbt);
     delete[] (char *) dbt->get_data();
     delete dbt;
     for (uint i = 0; i < this->boundaries.size(); i++) {
-        // key
-        dbt = marshal_key(this->boundaries[i]);
-        this->block->add(dbt);
-        delete[] (char *) dbt->get_data();
-        delete dbt;
-
-        // boundary
-        dbt = marshal_block_id(this->pointers[i]);
-        this->block->add(dbt);
-        delete[] (char *) dbt->get_data();
-        delete dbt;
+        char *bytes = this->add_entry(&this->boundaries[i], KEY_OFFSET);
+        *(BlockID *) bytes = this->pointers[i];
     }
     BTreeNode::save();
 }
 
 // Insert boundary, block_id pair into block.
-Insertion BTreeInterior::insert(const KeyValue *boundary, BlockID block_id) {
+Insertion BTreeInterior::insert(const KeyBytes *boundary, BlockID block_id) {
     // cout << "inserting (" << block_id << ", " << (*boundary)[0] << ") into interior node " << id; // DEBUG
     // cout << " (pointers:" << boundaries.size() << ", unused:" << block->unused_bytes() << ") " << endl; // DEBUG
+    this->load();
 
-    Dbt *dbt;
+    auto at = std::upper_bound(this->boundaries.begin(), this->boundaries.end(), *boundary);
+    this->pointers.insert(this->pointers.begin() + (at - this->boundaries.begin()), block_id);
+    this->boundaries.insert(at, *boundary);
 
-    bool inserted = false;
-    for (uint i = 0; i < this->boundaries.size(); i++) {
-        KeyValue *check = this->boundaries[i];
-        if (*boundary == *check) {
-            this->boundaries.insert(this->boundaries.begin() + i, new KeyValue(*boundary));
-            this->pointers.insert(this->pointers.begin() + i, block_id);
-            inserted = true;
-            break;
-        }
-    }
-    if (!inserted) {
-        // must go at the end
-        this->boundaries.push_back(new KeyValue(*boundary));
-        this->pointers.push_back(block_id);
-    }
-    dbt = marshal_block_id(block_id);
-    try {
-        // following is just a check for size (the save method will redo this in the right order)
-        this->block->add(dbt);
-        delete[] (char *) dbt->get_data();
-        delete dbt;
-        dbt = marshal_key(boundary);
-        this->block->add(dbt);
-        delete[] (char *) dbt->get_data();
-        delete dbt;
-
-        // that worked, so no need to split
+    if (this->used_bytes() <= this->capacity()) {
+        // it fits, so no need to split
         save();
         return BTreeNode::insertion_none();
+    }
 
-    } catch (DbBlockNoRoomError &e) {
-        cout << "splitting " << *this << endl; // DEBUG
-        delete[] (char *) dbt->get_data();
-        delete dbt;
-
-        // too big, so split
+    // too big, so split
+    cout << "splitting " << *this << endl; // DEBUG
 
-        // create the sister
-        BTreeInterior *nnode = new BTreeInterior(this->file, 0, this->key_profile, true);
+    // create the sister
+    BTreeInterior *nnode = new BTreeInterior(this->file, 0, this->key_codec, true);
 
-        // only the pointer of the middle entry goes into the sister (as it's first pointer)
-        // the corresponding boundary is moved up to be inserted into the parent node
-        u_long split = this->boundaries.size() / 2;
-        nnode->first = this->pointers[split];
-        KeyValue *nboundary = this->boundaries[split];
-        Insertion ret(nnode->id, *nboundary);
-        delete nboundary;
+    // only the pointer of the middle entry goes into the sister (as it's first pointer)
+    // the corresponding boundary is moved up to be inserted into the parent node
+    u_long split = this->boundaries.size() / 2;
+    nnode->first = this->pointers[split];
+    Insertion ret(nnode->id, this->boundaries[split]);
 
-        // move half of the entries to the sister
-        for (u_long i = split + 1; i < this->boundaries.size(); i++) {
-            nnode->boundaries.push_back(this->boundaries[i]);
-            nnode->pointers.push_back(this->pointers[i]);
-        }
-        this->boundaries.erase(this->boundaries.begin() + split, this->boundaries.end());
-        this->pointers.erase(this->pointers.begin() + split, this->pointers.end());
-        // cout << "after split " << *this << endl; // DEBUG
-        // cout << "new sibling " << *nnode << endl; // DEBUG
-
-        // save everything
-        nnode->save();
-        this->save();
-        return ret;
+    // move half of the entries to the sister
+    for (u_long i = split + 1; i < this->boundaries.size(); i++) {
+        nnode->boundaries.push_back(this->boundaries[i]);
+        nnode->pointers.push_back(this->pointers[i]);
     }
+    this->boundaries.erase(this->boundaries.begin() + split, this->boundaries.end());
+    this->pointers.erase(this->pointers.begin() + split, this->pointers.end());
+    // cout << "after split " << *this << endl; // DEBUG
+    // cout << "new sibling " << *nnode << endl; // DEBUG
+
+    // save everything
+    nnode->save();
+    this->save();
+    delete nnode;
+    return ret;
 }
 
 
 ostream &operator<<(ostream &out, const BTreeInterior &node) {
     out << "(interior block " << node.id << "): " << node.first;
-    if (node.boundaries.size() != node.pointers.size()) {
-        out << " MISMATCH boundaries: " << node.boundaries.size() << ", pointers: " << node.pointers.size();
-    } else {
-        for (unsigned int i = 0; i < node.boundaries.size(); i++)
-            out << '|' << (*node.boundaries[i])[0] << '|' << node.pointers[i];
+    KeyValue boundary;
+    for (uint i = 0; i < node.entry_count(); i++) {
+        node.key_codec.decode(node.get_boundary(i).data(), boundary);
+        out << '|' << boundary[0] << '|' << node.get_child_id(i + 1);
     }
     return out;
 }
 
 
+/*****************
+ * BTreeOverflow *
+ *****************/
+
+static const uint HANDLE_SIZE = sizeof(BlockID) + sizeof(RecordID);
+
+// Put a handle into bytes.
+static void marshal_handle(Handle handle, char *bytes) {
+    *(BlockID *) bytes = handle.first;
+    *(RecordID *) (bytes + sizeof(BlockID)) = handle.second;
+}
+
+// Get a handle from bytes.
+static Handle unmarshal_handle(const char *bytes) {
+    return Handle(*(BlockID *) bytes, *(RecordID *) (bytes + sizeof(BlockID)));
+}
+
+BTreeOverflow::BTreeOverflow(HeapFile &file, BlockID block_id, const KeyCodec &key_codec, bool create)
+    : BTreeNode(file, block_id, key_codec, create), next(0), handles() {
+    if (!create && this->block->size() > 0) {
+        this->next = get_block_id(1);
+        u_int16_t size;
+        const char *bytes = this->block->get_record(2, size);
+        for (uint at = 0; at + HANDLE_SIZE <= size; at += HANDLE_SIZE)
+            this->handles.push_back(unmarshal_handle(bytes + at));
+    }
+}
+
+// Save the next page pointer and then the handles packed together
+void BTreeOverflow::save() {
+    this->block->clear();
+    Dbt *dbt = marshal_block_id(this->next);
+    this->block->add(dbt);
+    delete[] (char *) dbt->get_data();
+    delete dbt;
+    RecordID record_id;
+    char *bytes = this->block->allocate((u_int16_t) (this->handles.size() * HANDLE_SIZE), record_id);
+    for (auto const &handle: this->handles) {
+        marshal_handle(handle, bytes);
+        bytes += HANDLE_SIZE;
+    }
+    BTreeNode::save();
+}
+
+
 /*************
  * BTreeLeaf *
  *************/
 
-BTreeLeaf::BTreeLeaf(HeapFile &file, BlockID block_id, const KeyProfile &key_profile, bool create)
-    : BTreeNode(file, block_id, key_profile, create), next_leaf(0), key_map() {
-    if (!create) {
-        RecordIDs *record_id_list = this->block->ids();
-        RecordID i = 1;
-        for (auto j = record_id_list->size(); j > 0; j--) {
-            if (i == record_id_list->size()) {
-                // next leaf block
-                this->next_leaf = get_block_id(i);
-            } else if (i % 2 == 0) {
-                // record i-1: handle, record i: key
-                KeyValue *key_value = get_key(i);
-                this->key_map[*key_value] = get_handle(i - 1);
-            }
-            i++;
+BTreeLeaf::BTreeLeaf(HeapFile &file, BlockID block_id, const KeyCodec &key_codec, bool create)
+    : BTreeNode(file, block_id, key_codec, create), next_leaf(0), loaded(create), key_map() {
+    if (!create && this->block->size() > 0)
+        this->next_leaf = get_block_id(1);
+}
+
+BTreeLeaf::~BTreeLeaf() {
+}
+
+// Parse the entries so they can be changed.
+void BTreeLeaf::load() {
+    if (this->loaded)
+        return;
+    uint n = this->entry_count();
+    for (uint i = 0; i < n; i++)
+        this->key_map.emplace_hint(this->key_map.end(), this->get_key(i), this->get_posting(i));
+    this->loaded = true;
+}
+
+const char *BTreeLeaf::entry_key(const char *bytes, u_int16_t size, uint &key_size) const {
+    key_size = *(u_int16_t *) bytes;
+    return bytes + KEY_OFFSET;
+}
+
+KeyBytes BTreeLeaf::get_key(uint i) const {
+    u_int16_t size;
+    const char *bytes = this->entry(i, size);
+    uint key_size;
+    const char *key = this->entry_key(bytes, size, key_size);
+    return KeyBytes(key, key_size);
+}
+
+// The handles are 6 bytes each and an overflow page pointer 4, so what follows the key says whether there is one.
+Posting BTreeLeaf::get_posting(uint i) const {
+    u_int16_t size;
+    const char *bytes = this->entry(i, size);
+    uint key_size;
+    bytes = this->entry_key(bytes, size, key_size) + key_size;
+    uint rest = size - KEY_OFFSET - key_size;
+    Posting posting(Handles(), 0);
+    for (; rest >= HANDLE_SIZE; rest -= HANDLE_SIZE, bytes += HANDLE_SIZE)
+        posting.first.push_back(unmarshal_handle(bytes));
+    if (rest == sizeof(BlockID))
+        posting.second = *(BlockID *) bytes;
+    return posting;
+}
+
+void BTreeLeaf::get_handles(uint i, Handles &handles) const {
+    Posting posting = this->get_posting(i);
+    u_long start = handles.size();
+    handles.insert(handles.end(), posting.first.begin(), posting.first.end());
+    for (BlockID overflow_id = posting.second; overflow_id != 0;) {
+        BTreeOverflow overflow(this->file, overflow_id, this->key_codec, false);
+        handles.insert(handles.end(), overflow.get_handles().begin(), overflow.get_handles().end());
+        overflow_id = overflow.get_next();
+    }
+    if (posting.second != 0)
+        std::sort(handles.begin() + start, handles.end());
+}
+
+uint BTreeLeaf::lower_bound(const KeyBytes *key) const {
+    return this->search(key, true);
+}
+
+// Find the handles for a given key
+void BTreeLeaf::find_eq(const KeyBytes *key, Handles &handles) const {
+    uint i = this->lower_bound(key);
+    if (i < this->size() && this->get_key(i) == *key)
+        this->get_handles(i, handles);
+}
+
+// Remove handle from key's posting list, and the key once it has no handles left
+void BTreeLeaf::del(const KeyBytes *key, Handle handle) {
+    this->load();
+    auto it = this->key_map.find(*key);
+    if (it == this->key_map.end())
+        throw DbRelationError("key to delete is not in the index");
+    Posting &posting = it->second;
+    auto at = std::lower_bound(posting.first.begin(), posting.first.end(), handle);
+    if (at != posting.first.end() && *at == handle)
+        posting.first.erase(at);
+    else if (!this->del_overflow(posting, handle))
+        throw DbRelationError("key to delete is not in the index");
+    if (posting.first.empty() && posting.second == 0)
+        this->key_map.erase(it);
+    save();
+}
+
+// Only the first page in the chain is checked for room, so inserting a frequent key stays cheap.
+void BTreeLeaf::add_overflow(Posting &posting, Handle handle) {
+    if (posting.second != 0) {
+        BTreeOverflow overflow(this->file, posting.second, this->key_codec, false);
+        if (!overflow.is_full()) {
+            overflow.get_handles().push_back(handle);
+            overflow.save();
+            return;
         }
-        delete record_id_list;
     }
+    BTreeOverflow overflow(this->file, 0, this->key_codec, true);
+    overflow.set_next(posting.second);
+    overflow.get_handles().push_back(handle);
+    overflow.save();
+    posting.second = overflow.get_id();
 }
 
-BTreeLeaf::~BTreeLeaf() {
+// A page left empty is unlinked from the chain.
+bool BTreeLeaf::del_overflow(Posting &posting, Handle handle) {
+    BlockID prev_id = 0;
+    for (BlockID overflow_id = posting.second; overflow_id != 0;) {
+        BTreeOverflow overflow(this->file, overflow_id, this->key_codec, false);
+        Handles &handles = overflow.get_handles();
+        auto at = std::find(handles.begin(), handles.end(), handle);
+        if (at == handles.end()) {
+            prev_id = overflow_id;
+            overflow_id = overflow.get_next();
+            continue;
+        }
+        handles.erase(at);
+        if (!handles.empty()) {
+            overflow.save();
+        } else if (prev_id == 0) {
+            posting.second = overflow.get_next();
+            overflow.discard();
+        } else {
+            BTreeOverflow prev(this->file, prev_id, this->key_codec, false);
+            prev.set_next(overflow.get_next());
+            prev.save();
+            overflow.discard();
+        }
+        return true;
+    }
+    return false;
 }
 
-// Find the handle for a given key
-Handle BTreeLeaf::find_eq(const KeyValue *key) const {
-    return this->key_map.at(*key);
+uint BTreeLeaf::entry_size(const KeyBytes &key, const Posting &posting) {
+    return KEY_OFFSET + (uint) key.size() + (uint) posting.first.size() * HANDLE_SIZE
+           + (posting.second != 0 ? sizeof(BlockID) : 0);
 }
 
-// Save the key_map and next_leaf data in the correct order
-void BTreeLeaf::save() {
-    Dbt *dbt;
-    this->block->clear();
-    for (auto const &item: this->key_map) {
-        // handle
-        dbt = marshal_handle(item.second);
-        this->block->add(dbt);
-        delete[] (char *) dbt->get_data();
-        delete dbt;
+uint BTreeLeaf::used_bytes() const {
+    if (!this->loaded)
+        return BTreeNode::used_bytes();
+    uint used = NODE_OVERHEAD;
+    for (auto const &item: this->key_map)
+        used += record_size(entry_size(item.first, item.second));
+    return used;
+}
 
-        // key
-        dbt = marshal_key(&item.first);
-        this->block->add(dbt);
-        delete[] (char *) dbt->get_data();
-        delete dbt;
+bool BTreeLeaf::can_merge(const BTreeLeaf *right) const {
+    return this->used_bytes() + right->used_bytes() - NODE_OVERHEAD <= this->capacity();
+}
+
+void BTreeLeaf::merge(BTreeLeaf *right) {
+    this->load();
+    right->load();
+    this->key_map.insert(right->key_map.begin(), right->key_map.end());
+    right->key_map.clear();
+    this->next_leaf = right->next_leaf;
+}
+
+KeyBytes BTreeLeaf::redistribute(BTreeLeaf *right) {
+    this->load();
+    right->load();
+    // move entries across one at a time until the two are about the same size
+    while (this->used_bytes() < right->used_bytes() && right->key_map.size() > 1) {
+        auto it = right->key_map.begin();
+        uint moving = record_size(entry_size(it->first, it->second));
+        if (this->used_bytes() + moving >= right->used_bytes())
+            break;
+        this->key_map.insert(*it);
+        right->key_map.erase(it);
+    }
+    while (right->used_bytes() < this->used_bytes() && this->key_map.size() > 1) {
+        auto it = std::prev(this->key_map.end());
+        uint moving = record_size(entry_size(it->first, it->second));
+        if (right->used_bytes() + moving >= this->used_bytes())
+            break;
+        right->key_map.insert(*it);
+        this->key_map.erase(it);
+    }
+    return right->key_map.begin()->first;
+}
+
+// Keep as many of the handles in the leaf as fit in max_entry() (at least one) and write the rest to overflow pages.
+bool BTreeLeaf::append(const KeyBytes *key, const Handles &handles, uint limit) {
+    this->load();
+    Posting posting(handles, 0);
+    if (entry_size(*key, posting) > this->max_entry()) {
+        posting.second = 1;  // stands in for the overflow page while sizing the entry
+        posting.first.clear();
+        while (posting.first.size() < handles.size()
+               && (posting.first.empty() || entry_size(*key, posting) + HANDLE_SIZE <= this->max_entry()))
+            posting.first.push_back(handles[posting.first.size()]);
+    }
+    if (!this->key_map.empty() && this->used_bytes() + record_size(entry_size(*key, posting)) > limit)
+        return false;
+    posting.second = 0;
+    for (u_long i = posting.first.size(); i < handles.size(); i += BTreeOverflow::max_handles(this->capacity())) {
+        BTreeOverflow overflow(this->file, 0, this->key_codec, true);
+        overflow.set_next(posting.second);
+        u_long end = std::min(handles.size(), i + BTreeOverflow::max_handles(this->capacity()));
+        overflow.get_handles().assign(handles.begin() + i, handles.begin() + end);
+        overflow.save();
+        posting.second = overflow.get_id();
     }
-    // next leaf pointer is final record
-    dbt = marshal_block_id(this->next_leaf);
+    this->key_map.emplace_hint(this->key_map.end(), *key, posting);
+    return true;
+}
+
+// Follow the leaf chain one step
+BTreeLeaf *BTreeLeaf::next() const {
+    if (this->next_leaf == 0)
+        return nullptr;
+    return new BTreeLeaf(this->file, this->next_leaf, this->key_codec, false);
+}
+
+// Save the next_leaf pointer and then each key packed with its posting, in key order
+void BTreeLeaf::save() {
+    this->load();
+    this->block->clear();
+    Dbt *dbt = marshal_block_id(this->next_leaf);
     this->block->add(dbt);
     delete[] (char *) dbt->get_data();
     delete dbt;
-
+    for (auto const &item: this->key_map) {
+        const Posting &posting = item.second;
+        uint trailing = entry_size(item.first, posting) - KEY_OFFSET - (uint) item.first.size();
+        char *bytes = this->add_entry(&item.first, KEY_OFFSET, trailing);
+        *(u_int16_t *) bytes = (u_int16_t) item.first.size();
+        bytes += KEY_OFFSET + item.first.size();
+        for (auto const &handle: posting.first) {
+            marshal_handle(handle, bytes);
+            bytes += HANDLE_SIZE;
+        }
+        if (posting.second != 0)
+            *(BlockID *) bytes = posting.second;
+    }
     BTreeNode::save();
 }
 
 // Insert key, handle pair into block.
-Insertion BTreeLeaf::insert(const KeyValue *key, Handle handle) {
+Insertion BTreeLeaf::insert(const KeyBytes *key, Handle handle, bool unique) {
     // cout << "inserting " << (*key)[0] << " into leaf " << id << endl; // DEBUG
-    // check unique
-    if (this->key_map.find(*key) != this->key_map.end())
+    this->load();
+    auto it = this->key_map.find(*key);
+    if (it == this->key_map.end()) {
+        this->key_map[*key] = Posting(Handles(1, handle), 0);
+    } else if (unique) {
         throw DbRelationError("Duplicate keys are not allowed in unique index");
+    } else {
+        Handles &handles = it->second.first;
+        if (entry_size(*key, it->second) + HANDLE_SIZE <= this->max_entry())
+            handles.insert(std::upper_bound(handles.begin(), handles.end(), handle), handle);
+        else
+            this->add_overflow(it->second, handle);
+    }
 
-    Dbt *dbt;
-    dbt = marshal_handle(handle);
-    try {
-        // following is just a check for size (the save method will redo this in the right order)
-        this->block->add(dbt);
-        delete[] (char *) dbt->get_data();
-        delete dbt;
-        dbt = marshal_key(key);
-        this->block->add(dbt);
-        delete[] (char *) dbt->get_data();
-        delete dbt;
-
-        // that worked, so no need to split
-        this->key_map[*key] = handle;
+    if (this->used_bytes() <= this->capacity()) {
+        // it fits, so no need to split
         save();
         return BTreeNode::insertion_none();
-
-    } catch (DbBlockNoRoomError &e) {
-        delete[] (char *) dbt->get_data();
-        delete dbt;
-
-        // too big, so split
-
-        // create the sister and put her to the right
-        BTreeLeaf *nleaf = new BTreeLeaf(this->file, 0, this->key_profile, true);
-        nleaf->next_leaf = this->next_leaf;
-        this->next_leaf = nleaf->id;
-
-        // move half of the entries to the sister
-        auto key_list = this->key_map;       // make a copy of my key_map
-        key_list[*key] = handle;             // add key/handle to it
-        u_long split = key_list.size() / 2;  // figure out how many to keep (the rest move to nleaf)
-        this->key_map.clear();               // empty my list
-        u_long i = 0;
-        KeyValue boundary;
-        for (auto const &item: key_list) {
-            if (i < split) {
-                this->key_map[item.first] = item.second;
-            } else if (i == split) {
-                boundary = item.first;
-                nleaf->key_map[boundary] = item.second;
-            } else {
-                nleaf->key_map[item.first] = item.second;
-            }
-            i++;
-        }
-        //cout << "splitting leaf " << id << ", new sibling " << nleaf->id; // DEBUG
-        //cout << " starting at value " << boundary[0] << endl; // DEBUG
-
-        nleaf->save();
-        this->save();
-        return Insertion(nleaf->id, boundary);
     }
-}
 
+    // too big, so split
+
+    // create the sister and put her to the right
+    BTreeLeaf *nleaf = new BTreeLeaf(this->file, 0, this->key_codec, true);
+    nleaf->next_leaf = this->next_leaf;
+    this->next_leaf = nleaf->id;
+
+    // move the upper half of the entries to the sister
+    auto split = std::next(this->key_map.begin(), this->key_map.size() / 2);
+    KeyBytes boundary = split->first;
+    nleaf->key_map.insert(split, this->key_map.end());
+    this->key_map.erase(split, this->key_map.end());
+    //cout << "splitting leaf " << id << ", new sibling " << nleaf->id << endl; // DEBUG
+
+    nleaf->save();
+    this->save();
+    BlockID nleaf_id = nleaf->id;
+    delete nleaf;
+    return Insertion(nleaf_id, boundary);
+}
@@ -8,44 +8,87 @@
 
 #include "storage_engine.h"
 #include "heap_storage.h"
+#include "RowCodec.h"
 
-using KeyProfile = std::vector<ColumnAttribute::DataType>;
+using KeyProfile = DataTypes;
 using KeyValue = std::vector<Value>;
-using KeyValues = std::vector<KeyValue *>;
 using BlockPointers = std::vector<BlockID>;
-using Insertion = std::pair<BlockID, KeyValue>;
+using Insertion = std::pair<BlockID, KeyBytes>;
+using Posting = std::pair<Handles, BlockID>;  // a key's handles kept in its leaf, and its first overflow page (or 0)
 
+/**
+ * @class BTreeNode - a node of a B+tree, kept in one block
+ *
+ * Leaves and interior nodes use the same page layout: record 1 is a block pointer (the next leaf or the
+ * leftmost child), followed by one record per entry in key order. An entry packs a key, encoded by the index's
+ * KeyCodec so that keys compare with memcmp, together with a child pointer (interior) or the key's posting list
+ * of handles (leaf).
+ * Lookups binary-search those records in place. A node is only parsed into memory when it is about to be
+ * changed; the readers see it as it was last saved.
+ */
 class BTreeNode {
 public:
-    BTreeNode(HeapFile &file, BlockID block_id, const KeyProfile &key_profile, bool create);
+    BTreeNode(HeapFile &file, BlockID block_id, const KeyCodec &key_codec, bool create);
 
     virtual ~BTreeNode();
 
     static bool insertion_is_none(Insertion insertion) { return insertion.first == 0; }
 
-    static Insertion insertion_none() { return Insertion(0, KeyValue()); }
+    static Insertion insertion_none() { return Insertion(0, KeyBytes()); }
 
     virtual void save();
 
     BlockID get_id() const { return this->id; }
 
+    virtual uint used_bytes() const;  // bytes the node takes in its block when saved
+
+    uint capacity() const { return this->file.get_block_size() - 1; }  // bytes of its block a node can fill
+
+    bool is_underfull() const { return this->used_bytes() < this->file.get_block_size() / 2; }
+
+    void discard();  // empty the block of a node that is no longer in the tree
+
 protected:
+    static const RecordID FIRST_ENTRY = 2;  // record 1 is the node's block pointer
+
     SlottedPage *block;
     HeapFile &file;
     BlockID id;
-    const KeyProfile &key_profile;
+    const KeyCodec &key_codec;
 
     static Dbt *marshal_block_id(BlockID block_id);
 
-    static Dbt *marshal_handle(Handle handle);
-
-    virtual Dbt *marshal_key(const KeyValue *key);
-
     virtual BlockID get_block_id(RecordID record_id) const;
 
-    virtual Handle get_handle(RecordID record_id) const;
-
-    virtual KeyValue *get_key(RecordID record_id) const;
+    uint entry_count() const;  // number of entries as last saved
+
+    const char *entry(uint i, u_int16_t &size) const;  // bytes and size of the i-th entry (0-based) as last saved
+
+    /**
+     * Find the key within a saved entry.
+     * @param bytes     the entry
+     * @param size      size of the entry
+     * @param key_size  returns the size of the key
+     * @returns         where the key starts
+     */
+    virtual const char *entry_key(const char *bytes, u_int16_t size, uint &key_size) const;
+
+    /**
+     * Binary search of the saved entries.
+     * @param key       search key
+     * @param or_equal  find the first key not less than key, rather than the first key greater than key
+     * @returns         position of the first entry found, or entry_count() if there is none
+     */
+    uint search(const KeyBytes *key, bool or_equal) const;
+
+    /**
+     * Add a record at the end of the block for an entry and fill in its key.
+     * @param key         the entry's key
+     * @param key_offset  where the key starts within the entry
+     * @param trailing    bytes in the entry after the key
+     * @returns           the start of the entry, where the caller writes the rest of it
+     */
+    char *add_entry(const KeyBytes *key, uint key_offset, uint trailing = 0);
 };
 
 class BTreeStat : public BTreeNode {
@@ -53,9 +96,9 @@ public:
     static const RecordID ROOT = 1;  // where we store the root id in the stat block
     static const RecordID HEIGHT = ROOT + 1;  // where we store the height in the stat block
 
-    BTreeStat(HeapFile &file, BlockID stat_id, BlockID new_root, const KeyProfile &key_profile);
+    BTreeStat(HeapFile &file, BlockID stat_id, BlockID new_root, const KeyCodec &key_codec);
 
-    BTreeStat(HeapFile &file, BlockID stat_id, const KeyProfile &key_profile);
+    BTreeStat(HeapFile &file, BlockID stat_id, const KeyCodec &key_codec);
 
     virtual ~BTreeStat() {}
 
@@ -77,13 +120,37 @@ protected:
 
 class BTreeInterior : public BTreeNode {
 public:
-    BTreeInterior(HeapFile &file, BlockID block_id, const KeyProfile &key_profile, bool create);
+    BTreeInterior(HeapFile &file, BlockID block_id, const KeyCodec &key_codec, bool create);
 
     virtual ~BTreeInterior();
 
-    BTreeNode *find(const KeyValue *key, uint depth) const;
+    BTreeNode *find(const KeyBytes *key, uint depth) const;
+
+    BTreeNode *find_first(uint depth) const;  // leftmost child
+
+    uint find_child(const KeyBytes *key) const;  // position of the child where key must be
+
+    uint child_count() const { return this->entry_count() + 1; }
+
+    BlockID get_child_id(uint k) const;
+
+    KeyBytes get_boundary(uint i) const;  // between child i and child i+1
+
+    void set_boundary(uint i, const KeyBytes &boundary);
 
-    Insertion insert(const KeyValue *boundary, BlockID block_id);
+    void remove_child(uint k);  // k > 0; also removes the boundary in front of it
+
+    virtual uint used_bytes() const;
+
+    bool can_merge(const KeyBytes *separator, const BTreeInterior *right) const;
+
+    void merge(const KeyBytes *separator, BTreeInterior *right);  // right's entries move here
+
+    KeyBytes redistribute(const KeyBytes *separator, BTreeInterior *right);  // returns the new separator
+
+    Insertion insert(const KeyBytes *boundary, BlockID block_id);
+
+    bool append(const KeyBytes *boundary, BlockID block_id, uint limit);  // bulk load: add at the end if within limit
 
     virtual void save();
 
@@ -92,24 +159,116 @@ public:
     friend std::ostream &operator<<(std::ostream &out, const BTreeInterior &node);
 
 protected:
+    static const uint KEY_OFFSET = sizeof(BlockID);  // an entry is the child pointer then the boundary
+
     BlockID first;
+    bool loaded;  // pointers and boundaries have been parsed (the node is being changed)
     BlockPointers pointers;
-    KeyValues boundaries;
+    std::vector<KeyBytes> boundaries;
+
+    void load();
+
+    virtual const char *entry_key(const char *bytes, u_int16_t size, uint &key_size) const;
+
+    BTreeNode *child(BlockID down, uint depth) const;
+};
+
+/**
+ * @class BTreeOverflow - continuation page for a leaf key with more handles than its leaf entry keeps. A key's
+ * overflow pages form a chain; record 1 is the next page (or 0) and record 2 is the page's handles.
+ */
+class BTreeOverflow : public BTreeNode {
+public:
+    static uint max_handles(uint capacity) {  // handles that fit in a page, less block overhead
+        return (capacity - SlottedPage::HEADER_SIZE - 12) / (sizeof(BlockID) + sizeof(RecordID));
+    }
+
+    BTreeOverflow(HeapFile &file, BlockID block_id, const KeyCodec &key_codec, bool create);
+
+    virtual ~BTreeOverflow() {}
+
+    virtual void save();
+
+    BlockID get_next() const { return this->next; }
+
+    void set_next(BlockID next) { this->next = next; }
+
+    Handles &get_handles() { return this->handles; }  // in no particular order
+
+    bool is_full() const { return this->handles.size() >= max_handles(this->capacity()); }
+
+protected:
+    BlockID next;
+    Handles handles;
 };
 
+/**
+ * @class BTreeLeaf - leaf node. Each entry is a distinct key with its posting list: the handles of its rows in
+ * block order, as many as fit in max_entry() bytes, followed by the first of its overflow pages if it has more.
+ */
 class BTreeLeaf : public BTreeNode {
 public:
-    BTreeLeaf(HeapFile &file, BlockID block_id, const KeyProfile &key_profile, bool create);
+    uint max_entry() const { return this->capacity() / 8; }  // beyond this, more handles for a key go to overflow pages
+
+    BTreeLeaf(HeapFile &file, BlockID block_id, const KeyCodec &key_codec, bool create);
 
     virtual ~BTreeLeaf();
 
-    Handle find_eq(const KeyValue *key) const;  // throws if not found
-    Insertion insert(const KeyValue *key, Handle handle);
+    uint size() const { return this->entry_count(); }  // number of keys
+
+    KeyBytes get_key(uint i) const;  // i-th smallest key
+
+    void get_handles(uint i, Handles &handles) const;  // add all the handles for the i-th key, in block order
+
+    uint lower_bound(const KeyBytes *key) const;  // position of the first key not less than key
+
+    void find_eq(const KeyBytes *key, Handles &handles) const;  // add key's handles, if it is here
+
+    /**
+     * Add a handle for key, splitting the leaf if it is full.
+     * @param unique  throw if key is already here, rather than adding to its posting list
+     * @returns       the new sister leaf and the boundary, if there was a split
+     */
+    Insertion insert(const KeyBytes *key, Handle handle, bool unique);
+
+    /**
+     * Bulk load: add a key greater than all the others, unless that takes a non-empty leaf past limit bytes.
+     * @param handles  the key's handles, in block order
+     */
+    bool append(const KeyBytes *key, const Handles &handles, uint limit);
+
+    void set_next(BlockID next_leaf) { this->next_leaf = next_leaf; }
 
     virtual void save();
 
+    void del(const KeyBytes *key, Handle handle);  // throws if handle is not there for key
+
+    virtual uint used_bytes() const;
+
+    bool can_merge(const BTreeLeaf *right) const;
+
+    void merge(BTreeLeaf *right);  // right's entries move here and right drops out of the leaf chain
+
+    KeyBytes redistribute(BTreeLeaf *right);  // returns the new boundary between the two
+
+    BTreeLeaf *next() const;  // next leaf to the right, or nullptr if this is the last one
+
 protected:
+    static const uint KEY_OFFSET = sizeof(u_int16_t);  // an entry is the key's size, the key, then its postings
+
     BlockID next_leaf;
-    std::map<KeyValue, Handle> key_map;
-};
+    bool loaded;  // key_map has been parsed (the leaf is being changed)
+    std::map<KeyBytes, Posting> key_map;
+
+    void load();
+
+    virtual const char *entry_key(const char *bytes, u_int16_t size, uint &key_size) const;
 
+    Posting get_posting(uint i) const;  // the i-th key's posting as saved
+
+    static uint entry_size(const KeyBytes &key, const Posting &posting);
+
+    void add_overflow(Posting &posting, Handle handle);  // onto the first overflow page, or a new one ahead of it
+
+    bool del_overflow(Posting &posting, Handle handle);  // false if handle is on none of the overflow pages
+};
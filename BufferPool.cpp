@@ -0,0 +1,212 @@
+/**
+ * @file BufferPool.cpp - implementation of the buffer pool
+ * @author Justin Thoreson
+ * @see "Seattle University, CPSC5300, Winter 2023"
+ */
+
+#include <cstring>
+#include "BufferPool.h"
+#include "HeapFile.h"
+
+std::ostream& operator<<(std::ostream& out, const BufferPoolStats& stats) {
+    u_long pins = stats.hits + stats.misses;
+    out << "hits: " << stats.hits << ", misses: " << stats.misses << ", evictions: " << stats.evictions
+        << ", writes: " << stats.writes;
+    if (pins)
+        out << ", hit ratio: " << (100 * stats.hits / pins) << "%";
+    return out;
+}
+
+BufferPool& BufferPool::instance() {
+    static BufferPool pool;
+    return pool;
+}
+
+BufferPool::BufferPool(uint capacity)
+    : frames(), memory(), big_memory(), page_table(), file_ids(), clock_hand(0), stats() {
+    this->allocate(capacity);
+}
+
+// Nothing is written back here -- by the time static objects are destroyed the files are gone.
+// Callers that want durability must checkpoint() (or close their files) first.
+BufferPool::~BufferPool() {}
+
+void BufferPool::allocate(uint capacity) {
+    if (capacity == 0)
+        throw DbRelationError("buffer pool must have at least one frame");
+    this->frames.assign(capacity, BufferFrame());
+    this->memory.assign((size_t) capacity * DbBlock::BLOCK_SZ, 0);
+    this->big_memory.assign(capacity, std::vector<char>());
+    for (uint i = 0; i < capacity; i++) {
+        this->frames[i].data = &this->memory[(size_t) i * DbBlock::BLOCK_SZ];
+        this->frames[i].size = DbBlock::BLOCK_SZ;
+    }
+    this->page_table.clear();
+    this->clock_hand = 0;
+}
+
+void BufferPool::fit(uint i, uint size) {
+    BufferFrame& frame = this->frames[i];
+    if (frame.size == size)
+        return;
+    if (size == DbBlock::BLOCK_SZ) {
+        this->big_memory[i].clear();
+        this->big_memory[i].shrink_to_fit();
+        frame.data = &this->memory[(size_t) i * DbBlock::BLOCK_SZ];
+    } else {
+        this->big_memory[i].assign(size, 0);
+        frame.data = this->big_memory[i].data();
+    }
+    frame.size = size;
+}
+
+u_int32_t BufferPool::register_file(const std::string& filename) {
+    auto it = this->file_ids.find(filename);
+    if (it != this->file_ids.end())
+        return it->second;
+    u_int32_t file_id = (u_int32_t) this->file_ids.size() + 1;  // 0 marks an empty frame
+    this->file_ids[filename] = file_id;
+    return file_id;
+}
+
+BufferFrame* BufferPool::pin(HeapFile& file, BlockID block_id, bool is_new) {
+    u_int64_t key = page_key(file.get_file_id(), block_id);
+    auto it = this->page_table.find(key);
+    if (it != this->page_table.end()) {
+        BufferFrame& frame = this->frames[it->second];
+        this->stats.hits++;
+        frame.pin_count++;
+        frame.referenced = true;
+        frame.file = &file;
+        if (is_new)
+            std::memset(frame.data, 0, frame.size);
+        return &frame;
+    }
+
+    uint i = this->victim();
+    this->fit(i, file.get_block_size());
+    BufferFrame& frame = this->frames[i];
+    if (is_new)
+        std::memset(frame.data, 0, frame.size);
+    else
+        file.read_block(block_id, frame.data);  // may throw, in which case the frame stays empty
+    this->stats.misses++;
+    frame.file = &file;
+    frame.file_id = file.get_file_id();
+    frame.block_id = block_id;
+    frame.pin_count = 1;
+    frame.dirty = false;
+    frame.referenced = true;
+    this->page_table[key] = i;
+    return &frame;
+}
+
+// Called from page destructors, so never throws (the frame may already have been discarded).
+void BufferPool::unpin(BufferFrame* frame) {
+    if (frame->pin_count > 0)
+        frame->pin_count--;
+}
+
+void BufferPool::mark_dirty(HeapFile& file, BufferFrame* frame) {
+    frame->file = &file;
+    frame->dirty = true;
+}
+
+void BufferPool::write(HeapFile& file, BlockID block_id, const char* data) {
+    auto it = this->page_table.find(page_key(file.get_file_id(), block_id));
+    if (it == this->page_table.end()) {
+        file.write_block(block_id, data);
+        this->stats.writes++;
+        return;
+    }
+    BufferFrame& frame = this->frames[it->second];
+    if (frame.data != data)
+        std::memcpy(frame.data, data, frame.size);
+    frame.file = &file;
+    frame.dirty = true;
+}
+
+void BufferPool::flush(HeapFile& file) {
+    for (auto& frame: this->frames) {
+        if (frame.file_id != file.get_file_id())
+            continue;
+        if (frame.dirty) {
+            frame.file = &file;
+            this->write_back(frame);
+        }
+        if (frame.file == &file && frame.pin_count == 0)
+            frame.file = nullptr;  // still cached (and clean), but nobody to write it back through
+    }
+}
+
+void BufferPool::discard(HeapFile& file, BlockID first_block) {
+    for (auto const& frame: this->frames)
+        if (frame.file_id == file.get_file_id() && frame.block_id >= first_block && frame.pin_count > 0)
+            throw DbRelationError("cannot discard block " + std::to_string(frame.block_id) + ": it is still pinned");
+    for (auto& frame: this->frames) {
+        if (frame.file_id != file.get_file_id() || frame.block_id < first_block)
+            continue;
+        this->page_table.erase(page_key(frame.file_id, frame.block_id));
+        frame.file = nullptr;
+        frame.file_id = 0;
+        frame.block_id = 0;
+        frame.dirty = false;
+        frame.referenced = false;
+    }
+}
+
+void BufferPool::checkpoint() {
+    for (auto& frame: this->frames)
+        if (frame.dirty)
+            this->write_back(frame);
+}
+
+void BufferPool::set_capacity(uint capacity) {
+    if (this->get_pinned_count() > 0)
+        throw DbRelationError("cannot resize the buffer pool while frames are pinned");
+    this->checkpoint();
+    this->allocate(capacity);
+}
+
+uint BufferPool::get_pinned_count() const {
+    uint count = 0;
+    for (auto const& frame: this->frames)
+        if (frame.pin_count > 0)
+            count++;
+    return count;
+}
+
+uint BufferPool::victim() {
+    // two full sweeps are enough: the first clears every reference bit
+    uint n = (uint) this->frames.size();
+    for (uint tries = 0; tries < 2 * n; tries++) {
+        uint i = this->clock_hand;
+        this->clock_hand = (this->clock_hand + 1) % n;
+        BufferFrame& frame = this->frames[i];
+        if (frame.pin_count > 0)
+            continue;
+        if (frame.referenced) {
+            frame.referenced = false;
+            continue;
+        }
+        if (frame.file_id != 0) {
+            if (frame.dirty)
+                this->write_back(frame);
+            this->page_table.erase(page_key(frame.file_id, frame.block_id));
+            this->stats.evictions++;
+        }
+        frame.file = nullptr;
+        frame.file_id = 0;
+        frame.block_id = 0;
+        return i;
+    }
+    throw DbRelationError("buffer pool exhausted: all " + std::to_string(n) + " frames are pinned");
+}
+
+void BufferPool::write_back(BufferFrame& frame) {
+    if (frame.file == nullptr)
+        throw DbRelationError("dirty buffer frame for block " + std::to_string(frame.block_id) + " has no open file");
+    frame.file->write_block(frame.block_id, frame.data);
+    frame.dirty = false;
+    this->stats.writes++;
+}
@@ -0,0 +1,219 @@
+/**
+ * @file BufferPool.h - Buffer pool of pinned block frames shared by all heap files.
+ * BufferFrame
+ * BufferPoolStats
+ * BufferPool
+ *
+ * @author Justin Thoreson
+ * @see "Seattle University, CPSC5300, Winter 2023"
+ */
+
+#pragma once
+
+#include <iostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "storage_engine.h"
+
+class HeapFile;  // forward declare
+
+/**
+ * @class BufferFrame - one block-sized slot of memory in the buffer pool
+ */
+class BufferFrame {
+public:
+    BufferFrame() : data(nullptr), size(0), file(nullptr), file_id(0), block_id(0), pin_count(0), dirty(false),
+                    referenced(false) {}
+
+    /**
+     * Access the block's memory held in this frame.
+     * @returns  raw bytes of the block
+     */
+    char* get_data() const { return data; }
+
+    /**
+     * Get the id of the block held in this frame.
+     * @returns  block id within its file
+     */
+    BlockID get_block_id() const { return block_id; }
+
+protected:
+    char* data;
+    uint size;            // bytes at data: the block size of the file the block belongs to
+    HeapFile* file;       // handle that last pinned this frame (used for write-back)
+    u_int32_t file_id;    // file the block belongs to (0 if the frame is empty)
+    BlockID block_id;
+    u_int32_t pin_count;
+    bool dirty;
+    bool referenced;      // CLOCK reference bit
+
+    friend class BufferPool;
+};
+
+
+/**
+ * @class BufferPoolStats - running counters for sizing the buffer pool
+ */
+class BufferPoolStats {
+public:
+    BufferPoolStats() : hits(0), misses(0), evictions(0), writes(0) {}
+
+    u_long hits;       // pins satisfied from a resident frame
+    u_long misses;     // pins that had to read the block from its file
+    u_long evictions;  // resident blocks pushed out to make room
+    u_long writes;     // dirty blocks written back to their files
+
+    friend std::ostream& operator<<(std::ostream& out, const BufferPoolStats& stats);
+};
+
+
+/**
+ * @class BufferPool - fixed set of block frames with pin counts, dirty bits and CLOCK replacement
+ *
+ * HeapFile::get and HeapFile::get_new pin a frame and hand out a SlottedPage over the frame's memory;
+ * deleting that page unpins the frame. HeapFile::put just marks the frame dirty. Dirty frames are written
+ * back when they are evicted, when their file is closed, or on checkpoint().
+ *
+ * Frames are keyed by file name, not by HeapFile object, so two handles on the same file share frames.
+ * A frame is DbBlock::BLOCK_SZ bytes unless it holds a block of a file with bigger blocks; then it gets
+ * memory of its own of that size, which it keeps until it holds a block of a different size.
+ */
+class BufferPool {
+public:
+    /**
+     * Number of frames in the pool unless set_capacity() is called (4MB of 4kB blocks)
+     */
+    static const uint DEFAULT_CAPACITY = 1024U;
+
+    /**
+     * The one buffer pool shared by all heap files.
+     * @returns  the pool
+     */
+    static BufferPool& instance();
+
+    BufferPool(uint capacity = DEFAULT_CAPACITY);
+
+    virtual ~BufferPool();
+
+    BufferPool(const BufferPool& other) = delete;
+
+    BufferPool(BufferPool&& temp) = delete;
+
+    BufferPool& operator=(const BufferPool& other) = delete;
+
+    BufferPool& operator=(BufferPool&& temp) = delete;
+
+    /**
+     * Get the id the pool uses for a given file name (assigned on first request).
+     * @param filename  name of the underlying database file
+     * @returns         pool-wide id for the file
+     */
+    u_int32_t register_file(const std::string& filename);
+
+    /**
+     * Pin a block into a frame, reading it from the file if it is not already resident.
+     * @param file      open file the block belongs to
+     * @param block_id  which block
+     * @param is_new    true if the block is being created (zero the frame instead of reading it)
+     * @returns         the pinned frame
+     * @throws          DbRelationError if every frame is pinned
+     */
+    BufferFrame* pin(HeapFile& file, BlockID block_id, bool is_new = false);
+
+    /**
+     * Release one pin on a frame (never throws, since it is called from page destructors).
+     * @param frame  frame returned by pin()
+     */
+    void unpin(BufferFrame* frame);
+
+    /**
+     * Note that a pinned frame's memory has been changed and must be written back.
+     * @param file   handle the frame was changed through (and is to be written back through)
+     * @param frame  frame returned by pin()
+     */
+    void mark_dirty(HeapFile& file, BufferFrame* frame);
+
+    /**
+     * Store a copy of a block that does not live in a frame. If the block is resident, the frame is
+     * overwritten and marked dirty, otherwise the block is written straight through to the file.
+     * @param file      open file the block belongs to
+     * @param block_id  which block
+     * @param data      the block's bytes
+     */
+    void write(HeapFile& file, BlockID block_id, const char* data);
+
+    /**
+     * Write back all the dirty frames of a file and forget the given handle (it is being closed), except on frames
+     * still pinned: whoever holds them changes them through another handle, which mark_dirty then records.
+     * @param file  handle being closed
+     */
+    void flush(HeapFile& file);
+
+    /**
+     * Throw away frames of a file without writing them back (the file is being dropped, or cut short).
+     * @param file         handle of the file
+     * @param first_block  the first block whose frame goes; all the blocks after it go too
+     * @throws             DbRelationError if any of those frames is still pinned (nothing is thrown away then)
+     */
+    void discard(HeapFile& file, BlockID first_block = 1);
+
+    /**
+     * Write back every dirty frame in the pool.
+     */
+    void checkpoint();
+
+    /**
+     * Change the number of frames. Writes back and empties the pool first.
+     * @param capacity  new number of frames
+     * @throws          DbRelationError if any frame is pinned
+     */
+    void set_capacity(uint capacity);
+
+    uint get_capacity() const { return (uint) this->frames.size(); }
+
+    /**
+     * Count of frames currently pinned.
+     * @returns  number of frames with a nonzero pin count
+     */
+    uint get_pinned_count() const;
+
+    const BufferPoolStats& get_stats() const { return this->stats; }
+
+protected:
+    std::vector<BufferFrame> frames;
+    std::vector<char> memory;  // the frames' DbBlock::BLOCK_SZ bytes each
+    std::vector<std::vector<char>> big_memory;  // memory of frames holding bigger blocks, by frame index
+    std::unordered_map<u_int64_t, uint> page_table;  // (file id, block id) -> frame index
+    std::unordered_map<std::string, u_int32_t> file_ids;
+    uint clock_hand;
+    BufferPoolStats stats;
+
+    static u_int64_t page_key(u_int32_t file_id, BlockID block_id) {
+        return ((u_int64_t) file_id << 32) | block_id;
+    }
+
+    /**
+     * Choose an unpinned frame to reuse with the CLOCK algorithm, writing it back if it is dirty.
+     * @returns  index of the now empty frame
+     * @throws   DbRelationError if every frame is pinned
+     */
+    uint victim();
+
+    /**
+     * Write a dirty frame back to its file and clear its dirty bit.
+     */
+    void write_back(BufferFrame& frame);
+
+    /**
+     * Allocate the frames and their memory (pool must be empty).
+     */
+    void allocate(uint capacity);
+
+    /**
+     * Give an empty frame the memory for a block of a given size.
+     * @param i     index of the frame
+     * @param size  block size of the file the frame is about to hold a block of
+     */
+    void fit(uint i, uint size);
+};
@@ -4,121 +4,682 @@
  * @see "Seattle University, CPSC5300, Winter 2023"
  */
 
+#include <algorithm>
+#include <cmath>
+#include <sstream>
 #include "EvalPlan.h"
+#include "schema_tables.h"
 
+// The cost model, in blocks read
+static const double DEFAULT_ROWS = 1000.0;  // for a table that has not been analyzed
+static const double DEFAULT_PAGES = 10.0;
+static const double DEFAULT_EQUAL_FRACTION = 0.005;  // share of the rows an equality predicate keeps
+static const double DEFAULT_BOUND_FRACTION = 1.0 / 3.0;  // share of the rows each bound of a range keeps
+static const double HASH_LOOKUP_COST = 1.0;  // the key's bucket
+static const double BTREE_LOOKUP_COST = 2.0;  // the interior nodes on the way down (mostly cached) and a leaf
 
-class Dummy : public DbRelation {
+/**
+ * @class TableEstimates - what the optimizer reckons a table holds: from its statistics if it has been analyzed,
+ * otherwise from the defaults above
+ */
+class TableEstimates {
 public:
-    static Dummy &one() {
-        static Dummy d;
-        return d;
+    TableEstimates(Statistics* statistics, DbRelation& table)
+        : rows(DEFAULT_ROWS), pages(DEFAULT_PAGES), statistics(statistics), table(table), analyzed(false), columns() {
+        u_long row_count, changed_rows;
+        uint page_count;
+        if (statistics != nullptr &&
+            statistics->get_table(table.get_table_name(), row_count, page_count, changed_rows)) {
+            analyzed = true;
+            rows = row_count;
+            pages = page_count;
+            ColumnStatistics* first = column(table.get_column_names().front());
+            if (first != nullptr && first->row_count > 0)
+                pages = std::ceil(pages * rows / first->row_count);  // the table has grown or shrunk since
+            pages = std::max(pages, 1.0);
+        }
     }
 
-    Dummy() : DbRelation("dummy", ColumnNames(), ColumnAttributes()) {}
+    TableEstimates(const TableEstimates& other) = delete;
+
+    TableEstimates& operator=(const TableEstimates& other) = delete;
 
-    virtual void create() {};
+    double rows;  // rows in the table now
+    double pages;  // blocks it takes
+
+    // share of the rows with value in column
+    double equal(const Identifier& column_name, const Value& value) {
+        ColumnStatistics* statistics = column(column_name);
+        return statistics == nullptr ? DEFAULT_EQUAL_FRACTION : statistics->equal_fraction(value);
+    }
 
-    virtual void create_if_not_exists() {};
+    // share of the rows with column's value in range
+    double range(const Identifier& column_name, const ValueRange& range) {
+        ColumnStatistics* statistics = column(column_name);
+        if (statistics != nullptr)
+            return statistics->range_fraction(range);
+        return (range.has_min ? DEFAULT_BOUND_FRACTION : 1.0) * (range.has_max ? DEFAULT_BOUND_FRACTION : 1.0);
+    }
 
-    virtual void drop() {};
+    // share of the rows meeting all the predicates, taking them to be independent
+    double conjunction(const ValueDict& conjunction, const ValueRanges& ranges) {
+        double fraction = 1.0;
+        for (auto const& predicate: conjunction)
+            fraction *= equal(predicate.first, predicate.second);
+        for (auto const& predicate: ranges)
+            fraction *= range(predicate.first, predicate.second);
+        return fraction;
+    }
 
-    virtual void open() {};
+    // rows out of the table for a share of them: at least one unless the share is nothing
+    double rows_for(double fraction) const {
+        return fraction <= 0.0 ? 0.0 : std::min(rows, std::max(1.0, std::round(rows * fraction)));
+    }
 
-    virtual void close() {};
+    // blocks read to fetch rows by their handles: one per row, but no more than there are
+    double fetch_cost(double row_count) const {
+        return std::min(row_count, pages);
+    }
 
-    virtual Handle insert(const ValueDict *row) { return Handle(); }
+protected:
+    Statistics* statistics;
+    DbRelation& table;
+    bool analyzed;
+    std::map<Identifier, ColumnStatistics> columns;  // looked up as they are needed
 
-    virtual void update(const Handle handle, const ValueDict *new_values) {}
+    ColumnStatistics* column(const Identifier& column_name) {
+        if (!analyzed)
+            return nullptr;
+        auto found = columns.find(column_name);
+        if (found == columns.end()) {
+            ColumnStatistics column_statistics;
+            if (!statistics->get_column(table.get_table_name(), column_name, column_statistics))
+                return nullptr;
+            found = columns.insert({column_name, column_statistics}).first;
+        }
+        return &found->second;
+    }
+};
 
-    virtual void del(const Handle handle) {}
+// a literal as it would be written in SQL
+static std::string literal(const Value& value) {
+    std::ostringstream out;
+    if (value.data_type == ColumnAttribute::TEXT)
+        out << '"' << value.s << '"';
+    else
+        out << value;
+    return out.str();
+}
 
-    virtual Handles *select() { return nullptr; };
+// "a = 1 and b = 2"
+static std::string describe_conjunction(const ValueDict& conjunction) {
+    std::string ret;
+    for (auto const& predicate: conjunction)
+        ret += (ret.empty() ? "" : " and ") + predicate.first + " = " + literal(predicate.second);
+    return ret;
+}
 
-    virtual Handles *select(const ValueDict *where) { return nullptr; }
+// "a >= 1 and a < 5"
+static std::string describe_range(const Identifier& column_name, const ValueRange& range) {
+    std::string ret;
+    if (range.has_min)
+        ret += column_name + (range.min_inclusive ? " >= " : " > ") + literal(range.min);
+    if (range.has_min && range.has_max)
+        ret += " and ";
+    if (range.has_max)
+        ret += column_name + (range.max_inclusive ? " <= " : " < ") + literal(range.max);
+    return ret;
+}
 
-    virtual Handles *select(Handles *current_selection, const ValueDict *where) { return nullptr; }
+/**
+ * @class EvalPlanCursor - HandleCursor over the handles produced by an open operator (not owned)
+ */
+class EvalPlanCursor : public HandleCursor {
+public:
+    EvalPlanCursor(EvalPlan* plan) : plan(plan) {}
 
-    virtual ValueDict *project(Handle handle) { return nullptr; }
+    virtual bool next(Handle& handle) { return plan->next_handle(handle); }
 
-    virtual ValueDict *project(Handle handle, const ColumnNames *column_names) { return nullptr; }
+protected:
+    EvalPlan* plan;
 };
 
-EvalPlan::EvalPlan(PlanType type, EvalPlan *relation) : type(type), relation(relation), projection(nullptr),
-                                                        select_conjunction(nullptr), table(Dummy::one()) {
+
+/***********
+ * EvalPlan
+ ***********/
+
+EvalPlan::EvalPlan(EvalPlan* relation) : relation(relation), estimated_rows(-1.0), estimated_cost(-1.0) {
 }
 
-EvalPlan::EvalPlan(ColumnNames *projection, EvalPlan *relation) : type(Project), relation(relation),
-                                                                  projection(projection), select_conjunction(nullptr),
-                                                                  table(Dummy::one()) {
+EvalPlan::~EvalPlan() {
+    delete relation;
 }
 
-EvalPlan::EvalPlan(ValueDict *conjunction, EvalPlan *relation) : type(Select), relation(relation), projection(nullptr),
-                                                                 select_conjunction(conjunction), table(Dummy::one()) {
+EvalPlan* EvalPlan::optimize(Indices* indices, Statistics* statistics) const {
+    EvalPlan* copy = this->clone();  // by default, just optimize the input (and pass on its estimates)
+    this->optimize_relation(copy, indices, statistics);
+    if (copy->relation != nullptr) {
+        copy->estimated_rows = copy->relation->estimated_rows;
+        copy->estimated_cost = copy->relation->estimated_cost;
+    }
+    return copy;
 }
 
-EvalPlan::EvalPlan(DbRelation &table) : type(TableScan), relation(nullptr), projection(nullptr),
-                                        select_conjunction(nullptr), table(table) {
+void EvalPlan::optimize_relation(EvalPlan* copy, Indices* indices, Statistics* statistics) const {
+    if (copy->relation != nullptr) {
+        EvalPlan* optimized = copy->relation->optimize(indices, statistics);
+        delete copy->relation;
+        copy->relation = optimized;
+    }
 }
 
-EvalPlan::EvalPlan(const EvalPlan *other) : type(other->type), table(other->table) {
-    if (other->relation != nullptr)
-        relation = new EvalPlan(other->relation);
-    else
-        relation = nullptr;
-    if (other->projection != nullptr)
-        projection = new ColumnNames(*other->projection);
-    else
-        projection = nullptr;
-    if (other->select_conjunction != nullptr)
-        select_conjunction = new ValueDict(*other->select_conjunction);
-    else
-        select_conjunction = nullptr;
+void EvalPlan::open() {
+    if (this->relation != nullptr)
+        this->relation->open();
 }
 
-EvalPlan::~EvalPlan() {
-    delete relation;
-    delete projection;
-    delete select_conjunction;
+bool EvalPlan::next_handle(Handle& handle) {
+    throw DbRelationError("Invalid evaluation plan--operator does not produce handles");
 }
 
+bool EvalPlan::next(ValueDict*& row) {
+    throw DbRelationError("Invalid evaluation plan--not ending with a projection");
+}
 
-EvalPlan *EvalPlan::optimize() {
-    return new EvalPlan(this);  // For now, we don't know how to do anything better
+void EvalPlan::close() {
+    if (this->relation != nullptr)
+        this->relation->close();
 }
 
-ValueDicts *EvalPlan::evaluate() {
-    ValueDicts *ret = nullptr;
-    if (this->type != ProjectAll && this->type != Project)
-        throw DbRelationError("Invalid evaluation plan--not ending with a projection");
+DbRelation& EvalPlan::get_relation() const {
+    if (this->relation == nullptr)
+        throw DbRelationError("Invalid evaluation plan--no relation");
+    return this->relation->get_relation();
+}
+
+std::string EvalPlan::explain() const {
+    std::ostringstream out;
+    std::string indent;
+    for (const EvalPlan* plan = this; plan != nullptr; plan = plan->relation) {
+        if (plan != this)
+            out << "\n";
+        out << indent << plan->describe();
+        if (plan->estimated_rows >= 0.0)
+            out << "  (rows " << std::llround(plan->estimated_rows) << ", cost " << std::llround(plan->estimated_cost)
+                << ")";
+        indent += "  ";
+    }
+    return out.str();
+}
 
-    EvalPipeline pipeline = this->relation->pipeline();
-    DbRelation *temp_table = pipeline.first;
-    Handles *handles = pipeline.second;
-    if (this->type == ProjectAll)
-        ret = temp_table->project(handles);
-    else if (this->type == Project)
-        ret = temp_table->project(handles, this->projection);
-    delete handles;
+ValueDicts* EvalPlan::evaluate() {
+    ValueDicts* ret = new ValueDicts();
+    ValueDict* row;
+    this->open();
+    try {
+        while (this->next(row))
+            ret->push_back(row);
+    } catch (...) {
+        this->close();
+        for (auto r: *ret)
+            delete r;
+        delete ret;
+        throw;
+    }
+    this->close();
     return ret;
 }
 
-EvalPipeline EvalPlan::pipeline() {
-    // base cases
-    if (this->type == TableScan)
-        return EvalPipeline(&this->table, this->table.select());
-    if (this->type == Select && this->relation->type == TableScan)
-        return EvalPipeline(&this->relation->table, this->relation->table.select(this->select_conjunction));
 
-    // recursive case
-    if (this->type == Select) {
-        EvalPipeline pipeline = this->relation->pipeline();
-        DbRelation *temp_table = pipeline.first;
-        Handles *handles = pipeline.second;
-        EvalPipeline ret(temp_table, temp_table->select(handles, this->select_conjunction));
-        delete handles;
-        return ret;
+/****************
+ * EvalTableScan
+ ****************/
+
+EvalTableScan::EvalTableScan(DbRelation& table, ValueDict* conjunction)
+    : EvalPlan(nullptr), table(table), conjunction(conjunction), cursor(nullptr) {
+}
+
+EvalTableScan::~EvalTableScan() {
+    delete cursor;
+    delete conjunction;
+}
+
+EvalPlan* EvalTableScan::clone() const {
+    return new EvalTableScan(this->table, this->conjunction ? new ValueDict(*this->conjunction) : nullptr);
+}
+
+void EvalTableScan::open() {
+    delete this->cursor;
+    this->cursor = this->table.scan(this->conjunction);
+}
+
+bool EvalTableScan::next_handle(Handle& handle) {
+    if (this->cursor == nullptr)
+        throw DbRelationError("Invalid evaluation plan--table scan not open");
+    return this->cursor->next(handle);
+}
+
+void EvalTableScan::close() {
+    delete this->cursor;
+    this->cursor = nullptr;
+}
+
+std::string EvalTableScan::describe() const {
+    std::string ret = "TableScan " + this->table.get_table_name();
+    if (this->conjunction != nullptr && !this->conjunction->empty())
+        ret += " where " + describe_conjunction(*this->conjunction);
+    return ret;
+}
+
+
+/******************
+ * EvalIndexLookup
+ ******************/
+
+EvalIndexLookup::EvalIndexLookup(DbIndex& index, DbRelation& table, ValueDict* key)
+    : EvalPlan(nullptr), index(index), table(table), key(key), cursor(nullptr) {
+}
+
+EvalIndexLookup::~EvalIndexLookup() {
+    delete cursor;
+    delete key;
+}
+
+EvalPlan* EvalIndexLookup::clone() const {
+    return new EvalIndexLookup(this->index, this->table, new ValueDict(*this->key));
+}
+
+void EvalIndexLookup::open() {
+    delete this->cursor;
+    this->cursor = nullptr;
+    this->index.open();
+    this->cursor = new HandlesCursor(this->index.lookup(this->key));
+}
+
+bool EvalIndexLookup::next_handle(Handle& handle) {
+    if (this->cursor == nullptr)
+        throw DbRelationError("Invalid evaluation plan--index lookup not open");
+    return this->cursor->next(handle);
+}
+
+void EvalIndexLookup::close() {
+    delete this->cursor;
+    this->cursor = nullptr;
+}
+
+std::string EvalIndexLookup::describe() const {
+    return "IndexLookup " + this->table.get_table_name() + "." + this->index.get_name() + " where " +
+           describe_conjunction(*this->key);
+}
+
+
+/*****************
+ * EvalIndexRange
+ *****************/
+
+EvalIndexRange::EvalIndexRange(DbIndex& index, DbRelation& table, const Identifier& column, const ValueRange& range)
+    : EvalPlan(nullptr), index(index), table(table), column(column), range(range), cursor(nullptr) {
+}
+
+EvalIndexRange::~EvalIndexRange() {
+    delete cursor;
+}
+
+EvalPlan* EvalIndexRange::clone() const {
+    return new EvalIndexRange(this->index, this->table, this->column, this->range);
+}
+
+void EvalIndexRange::open() {
+    delete this->cursor;
+    this->cursor = nullptr;
+    this->index.open();
+    ValueDict min_key = {{this->column, this->range.min}}, max_key = {{this->column, this->range.max}};
+    this->cursor = this->index.range_scan(this->range.has_min ? &min_key : nullptr, this->range.min_inclusive,
+                                          this->range.has_max ? &max_key : nullptr, this->range.max_inclusive);
+}
+
+bool EvalIndexRange::next_handle(Handle& handle) {
+    if (this->cursor == nullptr)
+        throw DbRelationError("Invalid evaluation plan--index range not open");
+    return this->cursor->next(handle);
+}
+
+void EvalIndexRange::close() {
+    delete this->cursor;
+    this->cursor = nullptr;
+}
+
+std::string EvalIndexRange::describe() const {
+    return "IndexRange " + this->table.get_table_name() + "." + this->index.get_name() + " where " +
+           describe_range(this->column, this->range);
+}
+
+
+/**********************
+ * EvalIndexOnlyLookup
+ **********************/
+
+EvalIndexOnlyLookup::EvalIndexOnlyLookup(DbIndex& index, DbRelation& table, ValueDict* key,
+                                         const ColumnNames& projection)
+    : EvalPlan(nullptr), index(index), table(table), key(key), projection(projection), rows(nullptr), i(0) {
+}
+
+EvalIndexOnlyLookup::~EvalIndexOnlyLookup() {
+    this->close();
+    delete key;
+}
+
+EvalPlan* EvalIndexOnlyLookup::clone() const {
+    return new EvalIndexOnlyLookup(this->index, this->table, new ValueDict(*this->key), this->projection);
+}
+
+void EvalIndexOnlyLookup::open() {
+    this->close();
+    this->index.open();
+    this->rows = this->index.lookup_covered(this->key, this->projection);
+}
+
+bool EvalIndexOnlyLookup::next(ValueDict*& row) {
+    if (this->rows == nullptr)
+        throw DbRelationError("Invalid evaluation plan--index-only lookup not open");
+    if (this->i >= this->rows->size())
+        return false;
+    row = (*this->rows)[this->i++];
+    return true;
+}
+
+void EvalIndexOnlyLookup::close() {
+    if (this->rows != nullptr) {
+        for (; this->i < this->rows->size(); this->i++)
+            delete (*this->rows)[this->i];
+        delete this->rows;
+        this->rows = nullptr;
+    }
+    this->i = 0;
+}
+
+std::string EvalIndexOnlyLookup::describe() const {
+    std::string columns;
+    for (auto const& column_name: this->projection)
+        columns += (columns.empty() ? "" : ", ") + column_name;
+    return "IndexOnlyLookup " + this->table.get_table_name() + "." + this->index.get_name() + " where " +
+           describe_conjunction(*this->key) + " for " + columns;
+}
+
+
+/*************
+ * EvalSelect
+ *************/
+
+EvalSelect::EvalSelect(ValueDict* conjunction, EvalPlan* relation, ValueRanges* ranges)
+    : EvalPlan(relation), conjunction(conjunction), ranges(ranges), range_order(), cursor(nullptr) {
+    if (ranges != nullptr)
+        for (auto const& range: *ranges)
+            this->range_order.push_back(range.first);
+}
+
+EvalSelect::~EvalSelect() {
+    delete cursor;
+    delete conjunction;
+    delete ranges;
+}
+
+EvalPlan* EvalSelect::clone() const {
+    auto* copy = new EvalSelect(new ValueDict(*this->conjunction), this->relation->clone(),
+                                this->ranges ? new ValueRanges(*this->ranges) : nullptr);
+    copy->range_order = this->range_order;
+    return copy;
+}
+
+EvalPlan* EvalSelect::optimize(Indices* indices, Statistics* statistics) const {
+    EvalPlan* input = this->relation->optimize(indices, statistics);
+    EvalTableScan* scan = dynamic_cast<EvalTableScan*>(input);
+    if (scan == nullptr) {
+        auto* copy = new EvalSelect(new ValueDict(*this->conjunction), input,
+                                    this->ranges ? new ValueRanges(*this->ranges) : nullptr);
+        copy->range_order = this->range_order;
+        copy->estimated_rows = input->estimated_rows;
+        copy->estimated_cost = input->estimated_cost;
+        return copy;
+    }
+
+    ValueDict* conjunction = new ValueDict(*this->conjunction);
+    if (scan->conjunction != nullptr)
+        conjunction->insert(scan->conjunction->begin(), scan->conjunction->end());
+    ValueRanges* ranges = this->ranges ? new ValueRanges(*this->ranges) : new ValueRanges();
+    DbRelation& table = scan->get_relation();
+    delete input;
+    TableEstimates estimates(statistics, table);
+    double rows_out = estimates.rows_for(estimates.conjunction(*conjunction, *ranges));
+
+    // the access paths: a scan reads every block; an index lookup reads the index, then a block per row found
+    DbIndex* best = nullptr;
+    bool best_is_range = false;
+    double best_rows = estimates.rows_for(estimates.conjunction(*conjunction, ValueRanges()));
+    double best_cost = estimates.pages;
+    const ColumnNames& table_columns = table.get_column_names();
+    if (indices != nullptr) {
+        for (auto const& index_name: indices->get_index_names(table.get_table_name())) {
+            ColumnNames key_columns;
+            bool is_hash, is_unique;
+            indices->get_columns(table.get_table_name(), index_name, key_columns, is_hash, is_unique);
+            ValueDict key;
+            for (auto const& column_name: key_columns)
+                if (conjunction->find(column_name) != conjunction->end())
+                    key[column_name] = conjunction->at(column_name);
+            double rows, cost = is_hash ? HASH_LOOKUP_COST : BTREE_LOOKUP_COST;
+            bool is_range = false;
+            if (key.size() == key_columns.size()) {
+                rows = is_unique ? std::min(1.0, estimates.rows) : estimates.rows_for(estimates.conjunction(key, {}));
+            } else if (!is_hash && key_columns.size() == 1 && ranges->find(key_columns[0]) != ranges->end()) {
+                // the bounds must be of the column's type to be encoded as keys
+                const ValueRange& range = ranges->at(key_columns[0]);
+                ptrdiff_t column = std::find(table_columns.begin(), table_columns.end(), key_columns[0]) -
+                                   table_columns.begin();
+                ColumnAttribute attribute = table.get_column_attributes()[column];
+                ColumnAttribute::DataType data_type = attribute.get_data_type();
+                if ((range.has_min && range.min.data_type != data_type) ||
+                    (range.has_max && range.max.data_type != data_type))
+                    continue;
+                rows = estimates.rows_for(estimates.range(key_columns[0], range));
+                is_range = true;
+            } else {
+                continue;
+            }
+            cost += estimates.fetch_cost(rows);
+            if (cost < best_cost) {
+                best = &indices->get_index(table.get_table_name(), index_name);
+                best_is_range = is_range;
+                best_rows = rows;
+                best_cost = cost;
+            }
+        }
+    }
+
+    EvalPlan* access;
+    if (best == nullptr) {
+        // fold the equality predicates into the scan so rows are checked as their blocks are read
+        access = new EvalTableScan(table, conjunction->empty() ? nullptr : conjunction);
+        if (conjunction->empty())
+            delete conjunction;
+        conjunction = new ValueDict();
+    } else if (best_is_range) {
+        const Identifier& column_name = best->get_key_columns()[0];
+        access = new EvalIndexRange(*best, table, column_name, ranges->at(column_name));
+        ranges->erase(column_name);
+    } else {
+        ValueDict* key = new ValueDict();
+        for (auto const& column_name: best->get_key_columns()) {
+            (*key)[column_name] = (*conjunction)[column_name];
+            conjunction->erase(column_name);
+        }
+        access = new EvalIndexLookup(*best, table, key);
+    }
+    access->estimated_rows = best_rows;
+    access->estimated_cost = best_cost;
+    if (conjunction->empty() && ranges->empty()) {
+        delete conjunction;
+        delete ranges;
+        return access;
     }
 
-    throw DbRelationError("Not implemented: pipeline other than Select or TableScan");
+    // check whatever the access path did not, the range predicates that weed out the most rows first
+    auto* select = new EvalSelect(conjunction, access, ranges);
+    std::stable_sort(select->range_order.begin(), select->range_order.end(),
+                     [&estimates, ranges](const Identifier& a, const Identifier& b) {
+                         return estimates.range(a, ranges->at(a)) < estimates.range(b, ranges->at(b));
+                     });
+    select->estimated_rows = rows_out;
+    select->estimated_cost = best_cost;
+    return select;
+}
+
+void EvalSelect::open() {
+    EvalPlan::open();
+    delete this->cursor;
+    this->cursor = nullptr;
+    if (this->conjunction->empty())
+        this->cursor = new EvalPlanCursor(this->relation);
+    else
+        this->cursor = this->get_relation().scan(new EvalPlanCursor(this->relation), this->conjunction);
 }
 
+bool EvalSelect::next_handle(Handle& handle) {
+    if (this->cursor == nullptr)
+        throw DbRelationError("Invalid evaluation plan--select not open");
+    while (this->cursor->next(handle))
+        if (this->range_order.empty() || this->in_ranges(handle))
+            return true;
+    return false;
+}
+
+bool EvalSelect::in_ranges(Handle handle) const {
+    ValueDict* row = this->get_relation().project(handle, &this->range_order);
+    bool in = true;
+    for (auto const& column_name: this->range_order)
+        if (!this->ranges->at(column_name).contains(row->at(column_name))) {
+            in = false;
+            break;
+        }
+    delete row;
+    return in;
+}
+
+void EvalSelect::close() {
+    delete this->cursor;
+    this->cursor = nullptr;
+    EvalPlan::close();
+}
+
+std::string EvalSelect::describe() const {
+    std::string ret = describe_conjunction(*this->conjunction);
+    for (auto const& column_name: this->range_order)
+        ret += (ret.empty() ? "" : " and ") + describe_range(column_name, this->ranges->at(column_name));
+    return "Select " + ret;
+}
+
+
+/**************
+ * EvalProject
+ **************/
+
+EvalProject::EvalProject(const ColumnNames& projection, EvalPlan* relation)
+    : EvalPlan(relation), projection(projection), batch(), rows(nullptr), i(0) {
+}
+
+EvalProject::~EvalProject() {
+    this->close();
+}
+
+EvalPlan* EvalProject::clone() const {
+    return new EvalProject(this->projection, this->relation->clone());
+}
+
+EvalPlan* EvalProject::optimize(Indices* indices, Statistics* statistics) const {
+    EvalPlan* copy = EvalPlan::optimize(indices, statistics);
+    auto* lookup = dynamic_cast<EvalIndexLookup*>(dynamic_cast<EvalProject*>(copy)->relation);
+    if (lookup == nullptr)
+        return copy;
+
+    // if the entries of an index on the same key have every column wanted, the table need not be read at all
+    ColumnNames projection = this->projection.empty() ? this->get_relation().get_column_names() : this->projection;
+    DbIndex* index = &lookup->index;
+    if (!index->covers(projection) && indices != nullptr) {
+        for (auto const& index_name: indices->get_index_names(lookup->table.get_table_name())) {
+            DbIndex& other = indices->get_index(lookup->table.get_table_name(), index_name);
+            if (other.get_key_columns() == index->get_key_columns() && other.covers(projection)) {
+                index = &other;
+                break;
+            }
+        }
+    }
+    if (!index->covers(projection))
+        return copy;
+    EvalPlan* index_only = new EvalIndexOnlyLookup(*index, lookup->table, new ValueDict(*lookup->key), projection);
+    index_only->estimated_rows = lookup->estimated_rows;
+    index_only->estimated_cost = lookup->estimated_cost < 0.0 ? -1.0 : BTREE_LOOKUP_COST;  // no rows to fetch
+    delete copy;
+    return index_only;
+}
+
+bool EvalProject::next(ValueDict*& row) {
+    if (this->rows == nullptr || this->i >= this->rows->size()) {
+        delete this->rows;  // rows already handed out belong to the caller
+        this->rows = nullptr;
+        this->batch.clear();
+        Handle handle;
+        while (this->batch.size() < BATCH_SIZE && this->relation->next_handle(handle))
+            this->batch.push_back(handle);
+        if (this->batch.empty())
+            return false;
+        this->rows = this->project_batch();
+        this->i = 0;
+    }
+    row = (*this->rows)[this->i++];
+    return true;
+}
+
+void EvalProject::close() {
+    if (this->rows != nullptr) {
+        for (; this->i < this->rows->size(); this->i++)
+            delete (*this->rows)[this->i];
+        delete this->rows;
+        this->rows = nullptr;
+    }
+    this->batch.clear();
+    this->i = 0;
+    if (this->relation != nullptr)
+        EvalPlan::close();
+}
+
+ValueDicts* EvalProject::project_batch() {
+    return this->get_relation().project(&this->batch, &this->projection);
+}
+
+std::string EvalProject::describe() const {
+    std::string columns;
+    for (auto const& column_name: this->projection)
+        columns += (columns.empty() ? "" : ", ") + column_name;
+    return "Project " + columns;
+}
+
+
+/*****************
+ * EvalProjectAll
+ *****************/
+
+EvalProjectAll::EvalProjectAll(EvalPlan* relation) : EvalProject(ColumnNames(), relation) {
+}
+
+EvalPlan* EvalProjectAll::clone() const {
+    return new EvalProjectAll(this->relation->clone());
+}
+
+ValueDicts* EvalProjectAll::project_batch() {
+    return this->get_relation().project(&this->batch);
+}
+
+std::string EvalProjectAll::describe() const {
+    return "ProjectAll";
+}
@@ -1,42 +1,397 @@
 /**
  * @file EvalPlan.h - Evaluation plans
+ * EvalPlan
+ * EvalTableScan
+ * EvalIndexLookup
+ * EvalIndexRange
+ * EvalIndexOnlyLookup
+ * EvalSelect
+ * EvalProject
+ * EvalProjectAll
  *
  * @author Kevin Lundeen
  * @see "Seattle University, CPSC5300, Winter 2023"
  */
 
 #pragma once
+#include <string>
 #include "storage_engine.h"
 
-using EvalPipeline = std::pair<DbRelation*, Handles*>;
+class Indices;  // forward declare (schema_tables.h)
+class Statistics;  // forward declare (schema_tables.h)
 
+/**
+ * @class EvalPlan - abstract operator in a pull-based (Volcano-style) evaluation plan
+ *
+ * Each operator is opened, pulled from until it runs out, and closed. Operators that find rows
+ * (TableScan, IndexLookup, IndexRange, Select) produce handles with next_handle(); operators that read rows
+ * (Project, ProjectAll, IndexOnlyLookup) produce values with next(). An operator only holds its own small state (a cursor,
+ * a batch of handles), so nothing below the top of the plan holds a whole result.
+ *
+ * New kinds of operators are new subclasses; nothing else has to know about them.
+ *
+ * optimize() picks the cheapest way to find a Select's rows among a table scan and lookups in the table's
+ * indices, costed in blocks read, from the table's statistics in _statistics (see ANALYZE) or from defaults if
+ * it has not been analyzed. Each operator of the plan it returns carries its estimated rows and cost.
+ */
 class EvalPlan {
 public:
-    enum PlanType {
-        ProjectAll, Project, Select, TableScan
-    };
+    /**
+     * Number of handles a projection reads at a time
+     */
+    static const uint BATCH_SIZE = 256U;
+
+    /**
+     * @param relation  input operator (owned by this one), or nullptr for a leaf
+     */
+    EvalPlan(EvalPlan* relation);
 
-    EvalPlan(PlanType type, EvalPlan* relation);  // use for ProjectAll, e.g., EvalPlan(EvalPlan::ProjectAll, table);
-    EvalPlan(ColumnNames* projection, EvalPlan* relation); // use for Project
-    EvalPlan(ValueDict* conjunction, EvalPlan* relation);  // use for Select
-    EvalPlan(DbRelation& table);  // use for TableScan
-    EvalPlan(const EvalPlan* other);  // use for copying
     virtual ~EvalPlan();
 
-    // Attempt to get the best equivalent evaluation plan
-    EvalPlan* optimize();
+    EvalPlan(const EvalPlan& other) = delete;
+
+    EvalPlan& operator=(const EvalPlan& other) = delete;
+
+    /**
+     * Deep copy of this plan.
+     * @returns  the copy (freed by caller)
+     */
+    virtual EvalPlan* clone() const = 0;
 
-    // Evaluate the plan: evaluate gets values, pipeline gets handles
+    /**
+     * Attempt to get the best equivalent evaluation plan.
+     * @param indices     catalog of indices that may be used, or nullptr to not use any
+     * @param statistics  catalog of table statistics for estimating costs, or nullptr to use defaults
+     * @returns           a new plan (freed by caller); this one is unchanged
+     */
+    virtual EvalPlan* optimize(Indices* indices, Statistics* statistics = nullptr) const;
+
+    /**
+     * Get ready to produce results. Opens the input operator.
+     */
+    virtual void open();
+
+    /**
+     * Get the next qualifying row's handle.
+     * @param handle  returned by reference: the next handle
+     * @returns       false if there are no more
+     * @throws        DbRelationError if this operator does not produce handles
+     */
+    virtual bool next_handle(Handle& handle);
+
+    /**
+     * Get the next row's values.
+     * @param row  returned by reference: the next row (freed by caller)
+     * @returns    false if there are no more
+     * @throws     DbRelationError if this operator does not produce values
+     */
+    virtual bool next(ValueDict*& row);
+
+    /**
+     * Release everything held since open(). Closes the input operator.
+     */
+    virtual void close();
+
+    /**
+     * The relation that the handles produced by this operator belong to.
+     */
+    virtual DbRelation& get_relation() const;
+
+    /**
+     * Run the whole plan: open, pull every row, close.
+     * @returns  all the rows (freed by caller)
+     */
     ValueDicts* evaluate();
 
-    EvalPipeline pipeline();
+    /**
+     * Rows this operator is expected to produce, as estimated by optimize().
+     * @returns  the estimate, or a negative number if the plan has not been optimized
+     */
+    double get_estimated_rows() const { return estimated_rows; }
+
+    /**
+     * Blocks the plan up to this operator is expected to read, as estimated by optimize().
+     * @returns  the estimate, or a negative number if the plan has not been optimized
+     */
+    double get_estimated_cost() const { return estimated_cost; }
+
+    /**
+     * Describe the plan (EXPLAIN): a line for each operator with its estimates, its input on the next line.
+     * @returns  the description
+     */
+    std::string explain() const;
+
+protected:
+    EvalPlan* relation;  // input (nullptr for leaves)
+    double estimated_rows;  // set by optimize()
+    double estimated_cost;
+
+    /**
+     * Optimize the input in place (used by optimize() of the subclasses).
+     * @param copy        copy of this operator whose input is to be replaced with its optimized version
+     * @param indices     catalog of indices that may be used, or nullptr
+     * @param statistics  catalog of table statistics, or nullptr
+     */
+    void optimize_relation(EvalPlan* copy, Indices* indices, Statistics* statistics) const;
+
+    /**
+     * Describe this operator, without its input (see explain).
+     */
+    virtual std::string describe() const = 0;
+
+    friend class EvalSelect;  // sets the estimates of the access paths it picks
+    friend class EvalProject;
+};
+
+
+/**
+ * @class EvalTableScan - leaf operator: the handles of a table's rows, optionally restricted by a
+ * conjunction of equality predicates pushed down from a Select
+ */
+class EvalTableScan : public EvalPlan {
+public:
+    /**
+     * @param table        table to scan
+     * @param conjunction  predicates the rows must meet (freed by this operator) or nullptr for all rows
+     */
+    EvalTableScan(DbRelation& table, ValueDict* conjunction = nullptr);
+
+    virtual ~EvalTableScan();
+
+    virtual EvalPlan* clone() const;
+
+    virtual void open();
+
+    virtual bool next_handle(Handle& handle);
+
+    virtual void close();
+
+    virtual DbRelation& get_relation() const { return table; }
+
+protected:
+    DbRelation& table;
+    ValueDict* conjunction;
+    HandleCursor* cursor;
+
+    virtual std::string describe() const;
+
+    friend class EvalSelect;
+};
+
+
+/**
+ * @class EvalIndexLookup - leaf operator: the handles an index has for one search key
+ */
+class EvalIndexLookup : public EvalPlan {
+public:
+    /**
+     * @param index  index to look in (its relation is the one the handles belong to)
+     * @param table  the index's relation
+     * @param key    value for each of the index's key columns (freed by this operator)
+     */
+    EvalIndexLookup(DbIndex& index, DbRelation& table, ValueDict* key);
+
+    virtual ~EvalIndexLookup();
+
+    virtual EvalPlan* clone() const;
+
+    virtual void open();
+
+    virtual bool next_handle(Handle& handle);
+
+    virtual void close();
+
+    virtual DbRelation& get_relation() const { return table; }
+
+protected:
+    DbIndex& index;
+    DbRelation& table;
+    ValueDict* key;
+    HandleCursor* cursor;
+
+    virtual std::string describe() const;
+
+    friend class EvalProject;
+};
+
+
+/**
+ * @class EvalIndexRange - leaf operator: the handles a B-tree index has for a range of values of its key column,
+ * in key order
+ */
+class EvalIndexRange : public EvalPlan {
+public:
+    /**
+     * @param index   index to look in, with column as its whole search key
+     * @param table   the index's relation
+     * @param column  the index's key column
+     * @param range   values of column to find
+     */
+    EvalIndexRange(DbIndex& index, DbRelation& table, const Identifier& column, const ValueRange& range);
+
+    virtual ~EvalIndexRange();
+
+    virtual EvalPlan* clone() const;
+
+    virtual void open();
+
+    virtual bool next_handle(Handle& handle);
+
+    virtual void close();
+
+    virtual DbRelation& get_relation() const { return table; }
+
+protected:
+    DbIndex& index;
+    DbRelation& table;
+    Identifier column;
+    ValueRange range;
+    HandleCursor* cursor;
+
+    virtual std::string describe() const;
+};
+
+
+/**
+ * @class EvalIndexOnlyLookup - leaf operator: the values of some columns of the rows an index has for one
+ * search key, read out of the index entries (the index covers the columns) without reading the table's blocks
+ */
+class EvalIndexOnlyLookup : public EvalPlan {
+public:
+    /**
+     * @param index       index to look in, covering projection
+     * @param table       the index's relation
+     * @param key         value for each of the index's key columns (freed by this operator)
+     * @param projection  columns to get
+     */
+    EvalIndexOnlyLookup(DbIndex& index, DbRelation& table, ValueDict* key, const ColumnNames& projection);
+
+    virtual ~EvalIndexOnlyLookup();
+
+    virtual EvalPlan* clone() const;
+
+    virtual void open();
+
+    virtual bool next(ValueDict*& row);
+
+    virtual void close();
+
+    virtual DbRelation& get_relation() const { return table; }
+
+protected:
+    DbIndex& index;
+    DbRelation& table;
+    ValueDict* key;
+    ColumnNames projection;
+    ValueDicts* rows;  // handed out from position i
+    size_t i;
+
+    virtual std::string describe() const;
+};
+
+
+/**
+ * @class EvalSelect - the handles from its input whose rows meet a conjunction of equality predicates and range
+ * predicates. The equality predicates are checked in place in the encoded rows; the range predicates then, one
+ * column at a time, in the order optimize() puts them in (most selective first).
+ */
+class EvalSelect : public EvalPlan {
+public:
+    /**
+     * @param conjunction  equality predicates the rows must meet (freed by this operator)
+     * @param relation     input operator producing handles (freed by this operator)
+     * @param ranges       range predicates the rows must also meet (freed by this operator), or nullptr
+     */
+    EvalSelect(ValueDict* conjunction, EvalPlan* relation, ValueRanges* ranges = nullptr);
+
+    virtual ~EvalSelect();
+
+    virtual EvalPlan* clone() const;
+
+    /**
+     * Over a TableScan, picks the cheapest of: the scan with the equality predicates pushed down into it, a
+     * lookup in an index whose whole search key is in the equality predicates, and a range lookup in a B-tree
+     * on a column with a range predicate. Whatever predicates the access path does not take care of are
+     * checked on top of it.
+     */
+    virtual EvalPlan* optimize(Indices* indices, Statistics* statistics = nullptr) const;
+
+    virtual void open();
+
+    virtual bool next_handle(Handle& handle);
+
+    virtual void close();
+
+protected:
+    ValueDict* conjunction;
+    ValueRanges* ranges;
+    ColumnNames range_order;  // the columns of ranges, in the order they are checked
+    HandleCursor* cursor;
+
+    virtual std::string describe() const;
+
+    /**
+     * Check the range predicates for a row.
+     */
+    bool in_ranges(Handle handle) const;
+};
+
+
+/**
+ * @class EvalProject - the values of some columns of the rows from its input, read a batch at a time
+ */
+class EvalProject : public EvalPlan {
+public:
+    /**
+     * @param projection  columns to get
+     * @param relation    input operator producing handles (freed by this operator)
+     */
+    EvalProject(const ColumnNames& projection, EvalPlan* relation);
+
+    virtual ~EvalProject();
+
+    virtual EvalPlan* clone() const;
+
+    /**
+     * Over an index lookup, becomes an index-only lookup if that index, or another one on the same key,
+     * covers the projected columns.
+     */
+    virtual EvalPlan* optimize(Indices* indices, Statistics* statistics = nullptr) const;
+
+    virtual bool next(ValueDict*& row);
+
+    virtual void close();
 
 protected:
+    ColumnNames projection;
+    Handles batch;
+    ValueDicts* rows;  // current batch's rows, handed out from position i
+    size_t i;
+
+    /**
+     * Read the rows for a batch of handles.
+     * @returns  rows in the order of the batch (freed by caller)
+     */
+    virtual ValueDicts* project_batch();
 
-    PlanType type;
-    EvalPlan* relation;  // for everything except TableScan
-    ColumnNames* projection;  // for Project
-    ValueDict* select_conjunction;  // for Select
-    DbRelation& table;  // for TableScan
+    virtual std::string describe() const;
 };
 
+
+/**
+ * @class EvalProjectAll - the values of every column of the rows from its input
+ */
+class EvalProjectAll : public EvalProject {
+public:
+    /**
+     * @param relation  input operator producing handles (freed by this operator)
+     */
+    EvalProjectAll(EvalPlan* relation);
+
+    virtual EvalPlan* clone() const;
+
+protected:
+    virtual ValueDicts* project_batch();
+
+    virtual std::string describe() const;
+};
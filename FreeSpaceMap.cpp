@@ -0,0 +1,163 @@
+/**
+ * @file FreeSpaceMap.cpp - implementation of FreeSpaceMap
+ * @author Kevin Lundeen
+ * @see "Seattle University, CPSC5300, Winter 2023"
+ */
+#include <algorithm>
+#include "FreeSpaceMap.h"
+
+std::map<std::string, FreeSpaceMap::Room> FreeSpaceMap::rooms;
+
+FreeSpaceMap::FreeSpaceMap(HeapFile &heap, std::string name)
+    : heap(heap), file(name + ".fsm"), name(name), room(nullptr) {
+}
+
+void FreeSpaceMap::create() {
+    file.create();
+    attach(true);
+    for (BlockID block_id: heap.blocks()) {
+        SlottedPage *block = heap.get(block_id);
+        update(block);
+        delete block;
+    }
+}
+
+void FreeSpaceMap::drop() {
+    file.drop();
+    if (room != nullptr) {
+        room->bytes.clear();  // for any other map still open on the heap file
+        if (--room->open_maps == 0)
+            rooms.erase(name);
+        room = nullptr;
+    }
+}
+
+void FreeSpaceMap::open() {
+    if (room != nullptr)
+        return;
+    try {
+        file.open();
+    } catch (DbException &e) {
+        create();  // the heap file was made before it had a map
+        return;
+    }
+    attach(false);
+}
+
+void FreeSpaceMap::close() {
+    if (room == nullptr)
+        return;
+    file.close();
+    if (--room->open_maps == 0)
+        rooms.erase(name);
+    room = nullptr;
+}
+
+void FreeSpaceMap::attach(bool fresh) {
+    bool shared = rooms.find(name) != rooms.end();
+    Room &shared_room = rooms[name];
+    if (room == nullptr)
+        shared_room.open_maps = shared ? shared_room.open_maps + 1 : 1;
+    room = &shared_room;
+    if (shared && !fresh)
+        return;  // another map has it open already, and up to date
+    room->unit = heap.get_block_size() / EMPTY;
+    room->bytes.clear();
+    room->target = 0;
+    room->full_before = 1;
+    room->full_room = 0;
+    if (fresh)
+        return;
+    for (BlockID page_id: file.blocks()) {
+        SlottedPage *page = file.get(page_id);
+        u_int16_t size;
+        const char *bytes = page->get_record(1, size);
+        if (bytes != nullptr)
+            room->bytes.insert(room->bytes.end(), (const u_int8_t *) bytes, (const u_int8_t *) bytes + size);
+        delete page;
+    }
+}
+
+void FreeSpaceMap::update(SlottedPage *block) {
+    BlockID block_id = block->get_block_id();
+    u_int8_t byte = (u_int8_t) std::min(block->unused_bytes() / room->unit, (uint) EMPTY - 1);
+    if (block->size() == 0)
+        byte |= EMPTY;
+    std::vector<u_int8_t> &bytes = room->bytes;
+    if (bytes.size() < block_id)
+        bytes.resize(((block_id - 1) / BLOCKS_PER_PAGE + 1) * BLOCKS_PER_PAGE, 0);
+    if (bytes[block_id - 1] == byte)
+        return;
+    bytes[block_id - 1] = byte;
+    if (block_id < room->full_before && room_of(block_id) >= room->full_room)
+        room->full_before = block_id;
+    write(block_id);
+}
+
+BlockID FreeSpaceMap::find(u_int16_t size, BlockID before) {
+    uint needed = size + RECORD_OVERHEAD;
+    BlockID &target = room->target;
+    if (target != 0 && (before == 0 || target < before) && room_of(target) >= needed)
+        return target;
+    BlockID last = std::min(heap.get_last_block_id(), (BlockID) room->bytes.size());
+    if (before != 0)
+        last = std::min(last, before - 1);
+    // the blocks before full_before are too full
+    BlockID block_id = needed >= room->full_room ? room->full_before : 1;
+    for (; block_id <= last; block_id++)
+        if (room_of(block_id) >= needed)
+            break;
+    if (block_id >= room->full_before) {
+        room->full_before = block_id;
+        room->full_room = needed;
+    }
+    if (block_id <= last)
+        return target = block_id;
+    target = heap.get_last_block_id() + 1;  // the block the caller adds next, once update has its room
+    return 0;
+}
+
+void FreeSpaceMap::truncate(BlockID last_block) {
+    if (room->target > last_block)
+        room->target = 0;
+    room->full_before = std::min(room->full_before, last_block + 1);
+    std::vector<u_int8_t> &bytes = room->bytes;
+    std::vector<BlockID> changed;  // a block on each page to write
+    for (BlockID block_id = last_block + 1; block_id <= bytes.size(); block_id++) {
+        if (bytes[block_id - 1] == 0)
+            continue;
+        bytes[block_id - 1] = 0;
+        if (changed.empty() || (changed.back() - 1) / BLOCKS_PER_PAGE != (block_id - 1) / BLOCKS_PER_PAGE)
+            changed.push_back(block_id);
+    }
+    for (auto block_id: changed)
+        write(block_id);
+}
+
+bool FreeSpaceMap::is_empty(BlockID block_id) const {
+    return block_id <= room->bytes.size() && (room->bytes[block_id - 1] & EMPTY) != 0;
+}
+
+uint FreeSpaceMap::room_of(BlockID block_id) const {
+    return block_id <= room->bytes.size() ? (room->bytes[block_id - 1] & ~EMPTY) * room->unit : 0;
+}
+
+void FreeSpaceMap::write(BlockID block_id) {
+    std::vector<u_int8_t> &bytes = room->bytes;
+    BlockID page_id = (block_id - 1) / BLOCKS_PER_PAGE + 1;
+    while (file.get_last_block_id() < page_id) {
+        SlottedPage *page = file.get_new();
+        Dbt page_bytes(&bytes[(page->get_block_id() - 1) * BLOCKS_PER_PAGE], BLOCKS_PER_PAGE);
+        page->add(&page_bytes);
+        file.put(page);
+        delete page;
+    }
+    SlottedPage *page = file.get(page_id);
+    Dbt page_bytes(&bytes[(page_id - 1) * BLOCKS_PER_PAGE], BLOCKS_PER_PAGE);
+    if (page->size() == 0)
+        page->add(&page_bytes);  // page 1 starts out empty
+    else
+        page->put(1, page_bytes);
+    file.put(page);
+    delete page;
+}
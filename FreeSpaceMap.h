@@ -0,0 +1,113 @@
+/**
+ * @file FreeSpaceMap.h - FreeSpaceMap class
+ *
+ * @author Kevin Lundeen
+ * @see "Seattle University, CPSC5300, Winter 2023"
+ */
+#pragma once
+
+#include <map>
+#include <string>
+#include <vector>
+#include "HeapFile.h"
+
+/**
+ * @class FreeSpaceMap - roughly how much room each block of a heap file has, so inserts can go into space left
+ * by deletes instead of always at the end of the file
+ *
+ * One byte per block: the block's unused bytes in units of 1/128th of the block size (32 bytes for 4kB
+ * blocks), rounded down so a block always has at least the room the map says, and a flag for a block with no
+ * live records (which a scan can skip without reading it). The bytes are kept in a file of their own, named after the heap file with ".fsm", as a single
+ * record of BLOCKS_PER_PAGE bytes per block, and in memory while the map is open. Every open map of the same heap
+ * file (two HeapTables on one file, say) works on the same bytes in memory, so none of them goes stale.
+ */
+class FreeSpaceMap {
+public:
+    static const uint BLOCKS_PER_PAGE = 4000U;
+
+    /**
+     * @param heap  heap file whose blocks are mapped (must outlive the map)
+     * @param name  name of the heap file
+     */
+    FreeSpaceMap(HeapFile &heap, std::string name);
+
+    virtual ~FreeSpaceMap() {}
+
+    FreeSpaceMap(const FreeSpaceMap &other) = delete;
+
+    FreeSpaceMap &operator=(const FreeSpaceMap &other) = delete;
+
+    /**
+     * Create the map's file and record the heap file's blocks in it.
+     */
+    void create();
+
+    void drop();
+
+    /**
+     * Open the map, or create it if the heap file does not have one yet. The heap file must be open.
+     */
+    void open();
+
+    void close();
+
+    /**
+     * Record how much room a block of the heap file has now.
+     * @param block  the block, after it has been changed
+     */
+    void update(SlottedPage *block);
+
+    /**
+     * Find a block with room for another record. The block found last is tried first, and the search starts after
+     * the blocks a search has found too full since (so filling a table one record at a time does not search the
+     * whole map for each block it adds).
+     * @param size    size of the record
+     * @param before  only look at the blocks before this one (0 to look at them all)
+     * @returns       the block's id, or 0 if no block has room
+     */
+    BlockID find(u_int16_t size, BlockID before = 0);
+
+    /**
+     * Forget the blocks after a given one (the heap file is being cut short there).
+     * @param last_block  the heap file's new last block
+     */
+    void truncate(BlockID last_block);
+
+    /**
+     * Whether a block has no live records, as of its last update.
+     */
+    bool is_empty(BlockID block_id) const;
+
+protected:
+    static const u_int8_t EMPTY = 0x80U;  // flag for no live records; the rest of the byte is the room
+    static const uint RECORD_OVERHEAD = 4U;  // a new record also takes a header in its block
+
+    /**
+     * What the open maps of a heap file know, shared between them
+     */
+    struct Room {
+        uint unit;  // bytes per unit of room
+        std::vector<u_int8_t> bytes;  // bytes[block_id - 1]
+        BlockID target;  // block found last (or the block added after a miss), tried first next time
+        BlockID full_before;  // every block before this one has less room than full_room
+        uint full_room;
+        uint open_maps;  // the room is forgotten when the last of them closes
+    };
+
+    static std::map<std::string, Room> rooms;  // by heap file name
+
+    HeapFile &heap;
+    HeapFile file;
+    std::string name;
+    Room *room;  // nullptr while closed
+
+    /**
+     * Start sharing the room of the heap file, reading it from the map's file if no other map has it open
+     * @param fresh  forget what is known (the map's file has just been created)
+     */
+    void attach(bool fresh);
+
+    uint room_of(BlockID block_id) const;  // in bytes
+
+    void write(BlockID block_id);  // write the page holding a block's byte
+};
@@ -0,0 +1,463 @@
+/**
+ * @file HashIndex.cpp - implementation of HashIndex
+ * @author Kevin Lundeen
+ * @see "Seattle University, CPSC5300, Winter 2023"
+ */
+#include <algorithm>
+#include <cstring>
+#include "HashIndex.h"
+
+// split a bucket whenever the entries take more than this fraction of the buckets' blocks
+static const double SPLIT_LOAD = 0.75;
+
+// bytes of a block an entry can use (less the block header and the next page pointer)
+static const uint BUCKET_SPACE = DbBlock::BLOCK_SZ - 1 - SlottedPage::HEADER_SIZE - 2 * sizeof(u_int16_t) - sizeof(BlockID);
+
+static const uint HANDLE_SIZE = sizeof(BlockID) + sizeof(RecordID);
+
+// Bytes taken by a record in a block (slot header plus data).
+static uint record_size(uint data_size) {
+    return 2 * sizeof(u_int16_t) + data_size;
+}
+
+// FNV-1a, so the hash of a key is the same from run to run.
+static u_int32_t hash_key(const char *bytes, uint size) {
+    u_int32_t hash = 2166136261U;
+    for (uint i = 0; i < size; i++) {
+        hash ^= (unsigned char) bytes[i];
+        hash *= 16777619U;
+    }
+    return hash;
+}
+
+// Record 1 of each page in a bucket's chain is the next overflow page (or 0).
+static BlockID get_next(const SlottedPage *page) {
+    u_int16_t size;
+    return *(BlockID *) page->get_record(1, size);
+}
+
+static void set_next(SlottedPage *page, BlockID next) {
+    Dbt dbt(&next, sizeof(next));
+    if (page->size() == 0)
+        page->add(&dbt);
+    else
+        page->put(1, dbt);
+}
+
+static u_int32_t get_number(const SlottedPage *page, RecordID record_id) {
+    u_int16_t size;
+    return *(u_int32_t *) page->get_record(record_id, size);
+}
+
+static void set_number(SlottedPage *page, RecordID record_id, u_int32_t n) {
+    Dbt dbt(&n, sizeof(n));
+    if (record_id > page->size())
+        page->add(&dbt);
+    else
+        page->put(record_id, dbt);
+}
+
+// An entry is the handle followed by the key.
+static std::string make_entry(const KeyBytes &key, Handle handle) {
+    std::string entry(HANDLE_SIZE + key.size(), '\0');
+    *(BlockID *) &entry[0] = handle.first;
+    *(RecordID *) &entry[sizeof(BlockID)] = handle.second;
+    std::memcpy(&entry[HANDLE_SIZE], key.data(), key.size());
+    return entry;
+}
+
+static bool entry_has_key(const char *entry, u_int16_t size, const KeyBytes &key) {
+    return size == HANDLE_SIZE + key.size() && std::memcmp(entry + HANDLE_SIZE, key.data(), key.size()) == 0;
+}
+
+static Handle entry_handle(const char *entry) {
+    return Handle(*(BlockID *) entry, *(RecordID *) (entry + sizeof(BlockID)));
+}
+
+/**
+ * @class HashChain - walks the pages of a bucket, starting with its own block, holding one page at a time
+ */
+class HashChain {
+public:
+    HashChain(HeapFile &file, HeapFile &overflow, BlockID bucket_block)
+        : file(file), overflow(overflow), page(file.get(bucket_block)), in_overflow(false) {
+    }
+
+    virtual ~HashChain() {
+        delete this->page;
+    }
+
+    HashChain(const HashChain &other) = delete;
+
+    HashChain &operator=(const HashChain &other) = delete;
+
+    SlottedPage *get_page() const { return this->page; }
+
+    // Move on to the next page of the chain, if there is one.
+    bool next() {
+        BlockID next_id = get_next(this->page);
+        if (next_id == 0)
+            return false;
+        delete this->page;  // releases its pinned block
+        this->page = nullptr;
+        this->page = this->overflow.get(next_id);
+        this->in_overflow = true;
+        return true;
+    }
+
+    void put() {
+        (this->in_overflow ? this->overflow : this->file).put(this->page);
+    }
+
+protected:
+    HeapFile &file;
+    HeapFile &overflow;
+    SlottedPage *page;
+    bool in_overflow;
+};
+
+HashIndex::HashIndex(DbRelation &relation, Identifier name, ColumnNames key_columns, bool unique)
+    : DbIndex(relation, name, key_columns, unique),
+      closed(true),
+      file(relation.get_table_name() + "-" + name),
+      overflow(relation.get_table_name() + "-" + name + "-overflow"),
+      key_codec(DataTypes()),
+      level(0),
+      split(0),
+      used(0),
+      free_overflow(0) {
+    // figure out the data type of each key column
+    DataTypes key_profile;
+    const ColumnNames &column_names = relation.get_column_names();
+    ColumnAttributes column_attributes = relation.get_column_attributes();
+    for (auto const &column_name: key_columns) {
+        auto it = std::find(column_names.begin(), column_names.end(), column_name);
+        if (it == column_names.end())
+            throw DbRelationError("no column " + column_name + " for index " + name);
+        key_profile.push_back(column_attributes[it - column_names.begin()].get_data_type());
+    }
+    key_codec = KeyCodec(key_profile);
+}
+
+HashIndex::~HashIndex() {
+}
+
+// Create the index: the initial buckets, then an entry for every row already in the relation.
+void HashIndex::create() {
+    file.create();
+    overflow.create();
+    closed = false;
+    level = 0;
+    split = 0;
+    used = 0;
+    free_overflow = 0;
+    for (uint bucket = 0; bucket < INITIAL_BUCKETS; bucket++) {
+        SlottedPage *page = file.get_new();
+        set_next(page, 0);
+        file.put(page);
+        delete page;
+    }
+
+    static const uint PROJECT_BATCH_SIZE = 256;
+    HandleCursor *cursor = relation.scan();
+    try {
+        Handles batch;
+        Handle handle;
+        bool more = true;
+        while (more) {
+            more = cursor->next(handle);
+            if (more)
+                batch.push_back(handle);
+            if (batch.size() == PROJECT_BATCH_SIZE || (!more && !batch.empty())) {
+                ValueDicts *rows = relation.project(&batch, &key_columns);
+                std::vector<KeyBytes> keys;
+                for (auto row: *rows) {
+                    KeyBytes *key = encode_key(row);
+                    keys.push_back(*key);
+                    delete key;
+                    delete row;
+                }
+                delete rows;
+                for (size_t i = 0; i < batch.size(); i++)
+                    add(keys[i], batch[i]);
+                batch.clear();
+            }
+        }
+    } catch (...) {
+        delete cursor;
+        save_stat();
+        throw;
+    }
+    delete cursor;
+    save_stat();
+}
+
+// Drop the index.
+void HashIndex::drop() {
+    closed = true;
+    file.drop();
+    overflow.drop();
+}
+
+// Open existing index. Enables: lookup, insert, delete.
+void HashIndex::open() {
+    if (closed) {
+        file.open();
+        overflow.open();
+        load_stat();
+        closed = false;
+    }
+}
+
+// Closes the index. Disables: lookup, insert, delete.
+void HashIndex::close() {
+    if (!closed) {
+        file.close();
+        overflow.close();
+        closed = true;
+    }
+}
+
+void HashIndex::load_stat() {
+    SlottedPage *page = file.get(STAT);
+    level = get_number(page, 1);
+    split = get_number(page, 2);
+    used = get_number(page, 3);
+    free_overflow = get_number(page, 4);
+    delete page;
+}
+
+void HashIndex::save_stat() {
+    SlottedPage *page = file.get(STAT);
+    set_number(page, 1, level);
+    set_number(page, 2, split);
+    set_number(page, 3, used);
+    set_number(page, 4, free_overflow);
+    file.put(page);
+    delete page;
+}
+
+// Find all the rows whose columns are equal to key. Assumes key is a dictionary whose keys are the column
+// names in the index. Returns a list of row handles in block order.
+Handles *HashIndex::lookup(ValueDict *key_dict) const {
+    if (closed)
+        throw DbRelationError("index " + name + " is not open");
+    if (!key_codec.accepts(key_values(key_dict)))
+        return new Handles();  // no row's key is of another type
+    KeyBytes *key = encode_key(key_dict);
+    Handles *handles = new Handles();
+    HashChain chain(file, overflow, FIRST_BUCKET + bucket_of(*key));
+    do {
+        SlottedPage *page = chain.get_page();
+        for (RecordID record_id: page->records()) {
+            u_int16_t size;
+            const char *entry = page->get_record(record_id, size);
+            if (record_id > 1 && entry_has_key(entry, size, *key))
+                handles->push_back(entry_handle(entry));
+        }
+    } while (chain.next());
+    delete key;
+    std::sort(handles->begin(), handles->end());
+    return handles;
+}
+
+// Insert a row with the given handle. Row must exist in relation already.
+void HashIndex::insert(Handle handle) {
+    open();
+    ValueDict *row = relation.project(handle, &key_columns);
+    KeyBytes *key;
+    try {
+        key = encode_key(row);
+    } catch (DbRelationError &e) {
+        delete row;
+        throw;
+    }
+    delete row;
+    try {
+        add(*key, handle);
+    } catch (DbRelationError &e) {
+        delete key;
+        throw;
+    }
+    delete key;
+    save_stat();
+}
+
+// Delete the entry for the row with the given handle. Row must still exist in relation.
+void HashIndex::del(Handle handle) {
+    open();
+    ValueDict *row = relation.project(handle, &key_columns);
+    KeyBytes *key;
+    try {
+        key = encode_key(row);
+    } catch (DbRelationError &e) {
+        delete row;
+        throw;
+    }
+    delete row;
+    std::string entry = make_entry(*key, handle);
+    delete key;
+
+    // an empty overflow page stays in its chain until the bucket is next split
+    HashChain chain(file, overflow, FIRST_BUCKET + bucket_of(entry.substr(HANDLE_SIZE)));
+    do {
+        SlottedPage *page = chain.get_page();
+        for (RecordID record_id: page->records()) {
+            u_int16_t size;
+            const char *bytes = page->get_record(record_id, size);
+            if (record_id > 1 && size == entry.size() && std::memcmp(bytes, entry.data(), size) == 0) {
+                page->del(record_id);
+                chain.put();
+                used -= record_size(size);
+                save_stat();
+                return;
+            }
+        }
+    } while (chain.next());
+    throw DbRelationError("key to delete is not in the index");
+}
+
+std::vector<Value> HashIndex::key_values(const ValueDict *key) const {
+    std::vector<Value> key_value;
+    for (auto const &column_name: key_columns) {
+        auto it = key->find(column_name);
+        if (it == key->end())
+            throw DbRelationError("key for index " + name + " has no value for column " + column_name);
+        key_value.push_back(it->second);
+    }
+    return key_value;
+}
+
+KeyBytes *HashIndex::encode_key(const ValueDict *key) const {
+    return new KeyBytes(key_codec.encode(key_values(key)));
+}
+
+// Linear hashing: buckets below the split pointer have already been split, so use one more bit of the hash.
+uint HashIndex::bucket_of(const KeyBytes &key) const {
+    u_int32_t hash = hash_key(key.data(), (uint) key.size());
+    uint buckets = INITIAL_BUCKETS << level;
+    uint bucket = hash & (buckets - 1);
+    if (bucket < split)
+        bucket = hash & (2 * buckets - 1);
+    return bucket;
+}
+
+void HashIndex::add(const KeyBytes &key, Handle handle) {
+    uint bucket = bucket_of(key);
+    if (unique) {
+        HashChain chain(file, overflow, FIRST_BUCKET + bucket);
+        do {
+            SlottedPage *page = chain.get_page();
+            for (RecordID record_id: page->records()) {
+                u_int16_t size;
+                const char *entry = page->get_record(record_id, size);
+                if (record_id > 1 && entry_has_key(entry, size, key))
+                    throw DbRelationError("Duplicate keys are not allowed in unique index");
+            }
+        } while (chain.next());
+    }
+    std::string entry = make_entry(key, handle);
+    add(bucket, entry);
+    used += record_size((uint) entry.size());
+    if (used > SPLIT_LOAD * get_bucket_count() * BUCKET_SPACE)
+        split_bucket();
+}
+
+void HashIndex::add(uint bucket, const std::string &entry) {
+    HashChain chain(file, overflow, FIRST_BUCKET + bucket);
+    do {
+        SlottedPage *page = chain.get_page();
+        try {
+            RecordID record_id;
+            char *bytes = page->allocate((u_int16_t) entry.size(), record_id);
+            std::memcpy(bytes, entry.data(), entry.size());
+            chain.put();
+            return;
+        } catch (DbBlockNoRoomError &e) {
+            // try the next page
+        }
+    } while (chain.next());
+
+    // every page is full, so put a new one on the end of the chain
+    SlottedPage *page = new_overflow_page();
+    try {
+        RecordID record_id;
+        char *bytes = page->allocate((u_int16_t) entry.size(), record_id);
+        std::memcpy(bytes, entry.data(), entry.size());
+    } catch (DbBlockNoRoomError &e) {
+        delete page;
+        throw DbRelationError("key too big for index " + name);
+    }
+    overflow.put(page);
+    set_next(chain.get_page(), page->get_block_id());
+    chain.put();
+    delete page;
+}
+
+// Reuse a page from the free_overflow list if there is one.
+SlottedPage *HashIndex::new_overflow_page() {
+    SlottedPage *page;
+    if (free_overflow != 0) {
+        page = overflow.get(free_overflow);
+        free_overflow = get_next(page);
+        page->clear();
+    } else {
+        page = overflow.get_new();
+    }
+    set_next(page, 0);
+    return page;
+}
+
+void HashIndex::split_bucket() {
+    uint buckets = INITIAL_BUCKETS << level;
+    uint from = split;
+
+    // take all the entries out of the bucket, and its overflow pages onto the free_overflow list
+    std::vector<std::string> entries;
+    SlottedPage *page = file.get(FIRST_BUCKET + from);
+    BlockID next_id = get_next(page);
+    for (RecordID record_id: page->records()) {
+        u_int16_t size;
+        const char *bytes = page->get_record(record_id, size);
+        if (record_id > 1)
+            entries.push_back(std::string(bytes, size));
+    }
+    page->clear();
+    set_next(page, 0);
+    file.put(page);
+    delete page;
+    while (next_id != 0) {
+        page = overflow.get(next_id);
+        BlockID following = get_next(page);
+        for (RecordID record_id: page->records()) {
+            u_int16_t size;
+            const char *bytes = page->get_record(record_id, size);
+            if (record_id > 1)
+                entries.push_back(std::string(bytes, size));
+        }
+        page->clear();
+        set_next(page, free_overflow);
+        overflow.put(page);
+        free_overflow = next_id;
+        delete page;
+        next_id = following;
+    }
+
+    // the new bucket is the next block of the file
+    page = file.get_new();
+    if (page->get_block_id() != FIRST_BUCKET + from + buckets) {
+        delete page;
+        throw DbRelationError("hash index " + name + " is missing buckets");
+    }
+    set_next(page, 0);
+    file.put(page);
+    delete page;
+    if (++split == buckets) {
+        level++;
+        split = 0;
+    }
+
+    // each entry goes back into the old bucket or into the new one
+    for (auto const &entry: entries)
+        add(bucket_of(entry.substr(HANDLE_SIZE)), entry);
+}
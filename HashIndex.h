@@ -0,0 +1,102 @@
+/**
+ * @file HashIndex.h - HashIndex class
+ *
+ * @author Kevin Lundeen
+ * @see "Seattle University, CPSC5300, Winter 2023"
+ */
+#pragma once
+
+#include "heap_storage.h"
+#include "RowCodec.h"
+
+/**
+ * @class HashIndex - disk-based linear hashing index
+ *
+ * Block 1 of the index's file holds its state and bucket b is block b + 2, so finding a key's bucket takes no
+ * directory. A bucket that outgrows its block gets a chain of overflow pages, kept in a second file. Whenever the
+ * entries fill more than SPLIT_LOAD of the buckets' blocks, the bucket at the split pointer is split in two, so
+ * the chains stay short (and an equality lookup reads about one block) without ever rehashing the whole index.
+ *
+ * Each entry is the row's handle followed by its key, encoded by a KeyCodec; keys are hashed and compared in that
+ * encoding. Duplicate keys are allowed unless the index is unique.
+ */
+class HashIndex : public DbIndex {
+public:
+    /**
+     * Number of buckets in a new index
+     */
+    static const uint INITIAL_BUCKETS = 4U;
+
+    HashIndex(DbRelation &relation, Identifier name, ColumnNames key_columns, bool unique);
+
+    virtual ~HashIndex();
+
+    virtual void create();
+
+    virtual void drop();
+
+    virtual void open();
+
+    virtual void close();
+
+    virtual Handles *lookup(ValueDict *key) const;
+
+    virtual void insert(Handle handle);
+
+    virtual void del(Handle handle);
+
+    uint get_bucket_count() const { return (INITIAL_BUCKETS << this->level) + this->split; }
+
+protected:
+    static const BlockID STAT = 1;  // records: level, split, used, free_overflow
+    static const BlockID FIRST_BUCKET = STAT + 1;
+
+    bool closed;
+    mutable HeapFile file;  // state, then the buckets in order
+    mutable HeapFile overflow;  // overflow pages (block 1 is not used)
+    KeyCodec key_codec;
+    uint level;  // the buckets numbered below INITIAL_BUCKETS << level have not all been split
+    uint split;  // next bucket to split
+    u_int32_t used;  // bytes the entries take in their blocks
+    BlockID free_overflow;  // first of the overflow pages no longer in any chain (linked like a chain)
+
+    void load_stat();
+
+    void save_stat();
+
+    /**
+     * Pull out the key values from a ValueDict, in key column order.
+     * @param key  values for (at least) the key columns
+     * @returns    one value per key column
+     */
+    std::vector<Value> key_values(const ValueDict *key) const;
+
+    /**
+     * Pull out the key values from a ValueDict and encode them the way the entries store them.
+     * @param key  values for (at least) the key columns
+     * @returns    the encoded key (freed by caller)
+     */
+    KeyBytes *encode_key(const ValueDict *key) const;
+
+    uint bucket_of(const KeyBytes &key) const;
+
+    /**
+     * Add an entry to the first page of a bucket's chain with room for it, extending the chain if none has.
+     * @param bucket  the bucket
+     * @param entry   handle followed by key
+     */
+    void add(uint bucket, const std::string &entry);
+
+    /**
+     * Add an entry for a row (and split a bucket if the index has gotten too full).
+     * @throws DbRelationError  if the index is unique and key is already in it
+     */
+    void add(const KeyBytes &key, Handle handle);
+
+    /**
+     * Split the bucket at the split pointer: its entries are shared between it and a new bucket at the end.
+     */
+    void split_bucket();
+
+    SlottedPage *new_overflow_page();  // freed by caller
+};
@@ -12,18 +12,53 @@
 using u16 = u_int16_t;
 using u32 = u_int32_t;
 
-HeapFile::HeapFile(std::string name) : DbFile(name), dbfilename(""), last(0), closed(true), db(_DB_ENV, 0) {
+/**
+ * @class PinnedPage - SlottedPage over a pinned buffer pool frame; deleting it releases the pin
+ */
+class PinnedPage : public SlottedPage {
+public:
+    PinnedPage(Dbt& block, BlockID block_id, BufferFrame* frame, bool is_new = false)
+        : SlottedPage(block, block_id, is_new), frame(frame) {}
+
+    virtual ~PinnedPage() { BufferPool::instance().unpin(this->frame); }
+
+    PinnedPage(const PinnedPage& other) = delete;
+
+    PinnedPage& operator=(const PinnedPage& other) = delete;
+
+    BufferFrame* get_frame() const { return this->frame; }
+
+protected:
+    BufferFrame* frame;
+};
+
+HeapFile::HeapFile(std::string name)
+    : DbFile(name), dbfilename(""), last(0), block_size(DbBlock::BLOCK_SZ), closed(true), file_id(0), db(_DB_ENV, 0) {
     this->dbfilename = this->name + ".db";
+    this->file_id = BufferPool::instance().register_file(this->dbfilename);
+}
+
+HeapFile::~HeapFile() {
+    if (!this->closed)
+        this->close();
 }
 
 void HeapFile::create(void) {
+    this->create(DbBlock::BLOCK_SZ);
+}
+
+void HeapFile::create(uint block_size) {
+    if (block_size < DbBlock::BLOCK_SZ || block_size > DbBlock::MAX_BLOCK_SZ || (block_size & (block_size - 1)))
+        throw DbRelationError("block size must be a power of 2 from " + std::to_string(DbBlock::BLOCK_SZ) +
+                              " to " + std::to_string(DbBlock::MAX_BLOCK_SZ));
     u32 flags = DB_CREATE | DB_EXCL;
-    this->db_open(flags);
+    this->db_open(flags, block_size);
     SlottedPage* page = get_new(); // force one page to exist
     delete page;
 }
 
 void HeapFile::drop(void) {
+    BufferPool::instance().discard(*this);
     this->close();
     Db db(_DB_ENV, 0);
     db.remove(this->dbfilename.c_str(), nullptr, 0);
@@ -34,36 +69,64 @@ void HeapFile::open(void) {
 }
 
 void HeapFile::close(void) {
+    if (!this->closed)
+        BufferPool::instance().flush(*this);
     this->db.close(0);
     this->closed = true;
 }
 
 SlottedPage* HeapFile::get_new(void) {
-    char block[DbBlock::BLOCK_SZ];
-    std::memset(block, 0, sizeof(block));
-    Dbt data(block, sizeof(block));
+    BlockID block_id = ++this->last;
+    BufferFrame* frame = BufferPool::instance().pin(*this, block_id, true);
+    Dbt data(frame->get_data(), this->block_size);
+    SlottedPage* page = new PinnedPage(data, block_id, frame, true);
 
-    int block_id = ++this->last;
-    Dbt key(&block_id, sizeof(block_id));
-
-    // write out an empty block and read it back in so Berkeley DB is managing the memory
-    SlottedPage* page = new SlottedPage(data, this->last, true);
-    this->db.put(nullptr, &key, &data, 0); // write it out with initialization done to it
-    delete page;
-    this->db.get(nullptr, &key, &data, 0);
-    return new SlottedPage(data, this->last);
+    // write out the initialized block right away so Berkeley DB knows the file has grown
+    this->write_block(block_id, frame->get_data());
+    return page;
 }
 
 SlottedPage* HeapFile::get(BlockID block_id) {
-    Dbt key(&block_id, sizeof(block_id)), data;
-    this->db.get(nullptr, &key, &data, 0);
-    return new SlottedPage(data, block_id, false);
+    BufferFrame* frame = BufferPool::instance().pin(*this, block_id);
+    Dbt data(frame->get_data(), this->block_size);
+    return new PinnedPage(data, block_id, frame, false);
 }
 
 void HeapFile::put(DbBlock* block) {
-    BlockID block_id = block->get_block_id();
+    PinnedPage* page = dynamic_cast<PinnedPage*>(block);
+    if (page != nullptr)
+        BufferPool::instance().mark_dirty(*this, page->get_frame());
+    else
+        BufferPool::instance().write(*this, block->get_block_id(), (const char*) block->get_data());
+}
+
+void HeapFile::truncate(BlockID last_block) {
+    if (last_block == 0)
+        throw DbRelationError("cannot truncate " + this->dbfilename + " to no blocks");
+    if (last_block >= this->last)
+        return;
+    BufferPool::instance().discard(*this, last_block + 1);
+    for (BlockID block_id = this->last; block_id > last_block; block_id--) {
+        Dbt key(&block_id, sizeof(block_id));
+        this->db.del(nullptr, &key, 0);
+    }
+    this->last = last_block;
+    this->db.compact(nullptr, nullptr, nullptr, nullptr, DB_FREE_SPACE, nullptr);  // return the pages to the OS
+}
+
+void HeapFile::read_block(BlockID block_id, char* data) {
     Dbt key(&block_id, sizeof(block_id));
-    this->db.put(nullptr, &key, block->get_block(), 0);
+    Dbt block(data, this->block_size);
+    block.set_ulen(this->block_size);
+    block.set_flags(DB_DBT_USERMEM);  // read straight into the frame
+    if (this->db.get(nullptr, &key, &block, 0) != 0)
+        throw DbRelationError("block " + std::to_string(block_id) + " not found in " + this->dbfilename);
+}
+
+void HeapFile::write_block(BlockID block_id, const char* data) {
+    Dbt key(&block_id, sizeof(block_id));
+    Dbt block((void*) data, this->block_size);
+    this->db.put(nullptr, &key, &block, 0);
 }
 
 BlockIDs* HeapFile::block_ids() const {
@@ -74,19 +137,30 @@ BlockIDs* HeapFile::block_ids() const {
 }
 
 u32 HeapFile::get_block_count() {
-    DB_BTREE_STAT* stat;
-    this->db.stat(nullptr, &stat, DB_FAST_STAT);
-    uint32_t bt_ndata = stat->bt_ndata;
-    std::free(stat);
-    return bt_ndata;
+    // the number of the last record: a fast stat would still count the records truncate deleted
+    BlockID block_id = 0;
+    Dbt key(&block_id, sizeof(block_id));
+    key.set_ulen(sizeof(block_id));
+    key.set_flags(DB_DBT_USERMEM);
+    Dbt data;
+    data.set_flags(DB_DBT_PARTIAL);  // just the key, not the block
+    data.set_dlen(0);
+    Dbc* cursor;
+    this->db.cursor(nullptr, &cursor, 0);
+    int found = cursor->get(&key, &data, DB_LAST);
+    cursor->close();
+    return found == 0 ? block_id : 0;
 }
 
-void HeapFile::db_open(uint flags) {
+void HeapFile::db_open(uint flags, uint block_size) {
     if (!this->closed) return;
     this->db.set_message_stream(_DB_ENV->get_message_stream());
     this->db.set_error_stream(_DB_ENV->get_error_stream());
-    this->db.set_re_len(DbBlock::BLOCK_SZ); // record length - will be ignored if file already exists
+    this->db.set_re_len(block_size); // record length - will be ignored if file already exists
     this->db.open(nullptr, this->dbfilename.c_str(), nullptr, DB_RECNO, flags, 0644);
+    u32 re_len;
+    this->db.get_re_len(&re_len);  // the block size the file was created with
+    this->block_size = re_len;
     this->last = flags ? 0 : this->get_block_count();
     this->closed = false;
 }
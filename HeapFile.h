@@ -10,15 +10,19 @@
 
 #include "db_cxx.h"
 #include "SlottedPage.h"
+#include "BufferPool.h"
 
 
 /**
  * @class HeapFile - heap file implementation of DbFile
  *
  * Heap file organization. Built on top of Berkeley DB RecNo file. There is one
- * of our database blocks for each Berkeley DB record in the RecNo file.
- * In this way we are using Berkeley DB for buffer management and file
- * management. Uses SlottedPage for storing records within blocks.
+ * of our database blocks for each Berkeley DB record in the RecNo file. The block
+ * size is chosen when the file is created and kept as the RecNo file's record length.
+ * Berkeley DB handles file management; blocks are cached in the shared
+ * BufferPool, so the SlottedPage returned by get() or get_new() is a view of a
+ * pinned frame (deleting it unpins the frame) and put() only marks the frame
+ * dirty. Uses SlottedPage for storing records within blocks.
  */
 class HeapFile : public DbFile {
 public:
@@ -28,7 +32,7 @@ public:
      */
     HeapFile(std::string name);
 
-    virtual ~HeapFile() {}
+    virtual ~HeapFile();
 
     HeapFile(const HeapFile& other) = delete;
 
@@ -43,6 +47,12 @@ public:
      */
     virtual void create(void);
 
+    /**
+     * Create physical database file with blocks of a given size
+     * @param block_size Bytes per block: a power of 2 from DbBlock::BLOCK_SZ to DbBlock::MAX_BLOCK_SZ
+     */
+    virtual void create(uint block_size);
+
     /**
      * Remove physical database file
      */
@@ -61,43 +71,88 @@ public:
     /**
      * Allocate a new block for the database file.
      * Returns the new empty DbBlock that is managing the records in this block and its block id.
+     * The block is pinned in the buffer pool until the returned page is deleted.
      */
     virtual SlottedPage* get_new(void);
 
     /**
      * Retrieves a block from the database file
+     * The block is pinned in the buffer pool until the returned page is deleted.
      * @param block_id The id of the block to retrieve
      * @return A slotted page, the data of the block requested
      */
     virtual SlottedPage* get(BlockID block_id);
 
     /**
-     * Writes a block to the database file
+     * Writes a block to the database file (written back from the buffer pool later)
      * @param block The block to write to the database file
      */
     virtual void put(DbBlock* block);
 
+    /**
+     * Give back the blocks after a given one (they must be empty and unpinned); the file ends at that block.
+     * @param last_block The block to keep as the last one (at least 1)
+     */
+    virtual void truncate(BlockID last_block);
+
     /**
      *  Retrieves all block IDs of blocks within the database file
      */
     virtual BlockIDs* block_ids() const;
 
+    /**
+     * Iterate over the block IDs within the database file (as of now) without building a list
+     */
+    virtual BlockIDRange blocks() const { return BlockIDRange(1, last); }
+
     /**
      * Retrieves the last block ID within the file
      */
     virtual u_int32_t get_last_block_id() { return last; }
 
+    /**
+     * Retrieves the size of the file's blocks (the file must be open)
+     */
+    uint get_block_size() const { return block_size; }
+
+    /**
+     * Retrieves the id the buffer pool uses for this file
+     */
+    u_int32_t get_file_id() const { return file_id; }
+
 protected:
     std::string dbfilename;
     u_int32_t last;
+    uint block_size;
     bool closed;
+    u_int32_t file_id;
     Db db;
 
     /**
      * Open the Berkeley DB database file
      * @param flags Flags to provide the Berkeley DB database file
+     * @param block_size Size of the blocks of a new file (an existing file has its own)
      */ 
-    virtual void db_open(uint flags = 0);
+    virtual void db_open(uint flags = 0, uint block_size = DbBlock::BLOCK_SZ);
 
+    /**
+     * Number of the file's last block (the file's blocks are numbered from 1 with no gaps)
+     */
     virtual uint32_t get_block_count();
+
+    /**
+     * Read a block from the Berkeley DB file into the given memory
+     * @param block_id The id of the block to read
+     * @param data Where to put the block (get_block_size() bytes)
+     */
+    virtual void read_block(BlockID block_id, char* data);
+
+    /**
+     * Write a block from the given memory to the Berkeley DB file
+     * @param block_id The id of the block to write
+     * @param data The block's bytes (get_block_size() bytes)
+     */
+    virtual void write_block(BlockID block_id, const char* data);
+
+    friend class BufferPool;
 };
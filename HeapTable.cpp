@@ -3,17 +3,176 @@
  * @authors Kevin Lundeen, Justin Thoreson
  * @see Seattle University, CPSC5300
  */
+#include <algorithm>
 #include <cstring>
+#include <random>
 #include "HeapTable.h"
 
 using u16 = u_int16_t;
 
+/**
+ * Every record of a heap table starts with one of these bytes.
+ */
+enum RecordKind : char {
+    ROW = 0,      // the encoded row follows
+    FORWARD = 1,  // the row has moved: its handle (block id, record id) follows
+    MOVED = 2     // a row that moved here: the handle it is known by follows, then the encoded row
+};
+
+static const u16 LINK_SIZE = 1 + sizeof(BlockID) + sizeof(RecordID);  // kind byte and a handle
+
+static void write_link(char* bytes, RecordKind kind, Handle handle) {
+    bytes[0] = kind;
+    std::memcpy(bytes + 1, &handle.first, sizeof(BlockID));
+    std::memcpy(bytes + 1 + sizeof(BlockID), &handle.second, sizeof(RecordID));
+}
+
+static Handle read_link(const char* bytes) {
+    Handle handle;
+    std::memcpy(&handle.first, bytes + 1, sizeof(BlockID));
+    std::memcpy(&handle.second, bytes + 1 + sizeof(BlockID), sizeof(RecordID));
+    return handle;
+}
+
+/**
+ * Find the encoded row of a record, following a forwarding record to the block the row moved to.
+ * @param file       the table's file
+ * @param block      block the record is in
+ * @param record_id  the record
+ * @param moved_to   returns the block the row moved to, if it did (freed by caller), otherwise nullptr
+ * @return           the row's bytes, or nullptr if the record is deleted or is itself a moved row (which is
+ *                   reached through its forwarding record instead)
+ */
+static const char* find_row(HeapFile& file, const SlottedPage* block, RecordID record_id, SlottedPage*& moved_to) {
+    moved_to = nullptr;
+    u16 size;
+    const char* bytes = block->get_record(record_id, size);
+    if (bytes == nullptr || bytes[0] == ROW)
+        return bytes == nullptr ? nullptr : bytes + 1;
+    if (bytes[0] != FORWARD)
+        return nullptr;
+    Handle moved = read_link(bytes);
+    moved_to = file.get(moved.first);
+    bytes = moved_to->get_record(moved.second, size);
+    return bytes == nullptr ? nullptr : bytes + LINK_SIZE;
+}
+
+/**
+ * @class HeapTableScan - streams the handles of a heap table's rows that meet some predicates, block by block
+ */
+class HeapTableScan : public HandleCursor {
+public:
+    HeapTableScan(HeapFile& file, const FreeSpaceMap& fsm, const RowCodec& codec, const ColumnPredicates& predicates)
+        : file(file), fsm(fsm), codec(codec), predicates(predicates), blocks(file.blocks()),
+          block_it(blocks.begin()), block(nullptr), record_it(), record_end() {}
+
+    virtual ~HeapTableScan() { delete block; }
+
+    HeapTableScan(const HeapTableScan& other) = delete;
+
+    HeapTableScan& operator=(const HeapTableScan& other) = delete;
+
+    virtual bool next(Handle& handle) {
+        while (true) {
+            if (block == nullptr) {
+                while (block_it != blocks.end() && fsm.is_empty(*block_it))
+                    ++block_it;  // nothing to read there
+                if (!(block_it != blocks.end()))
+                    return false;
+                block = file.get(*block_it);
+                ++block_it;
+                record_it = block->records().begin();
+                record_end = block->records().end();
+            }
+            while (record_it != record_end) {
+                RecordID record_id = *record_it;
+                ++record_it;
+                SlottedPage* moved_to;
+                const char* row = find_row(file, block, record_id, moved_to);
+                bool matched = row != nullptr && codec.matches(row, predicates);
+                delete moved_to;
+                if (matched) {
+                    handle = Handle(block->get_block_id(), record_id);
+                    return true;
+                }
+            }
+            delete block;
+            block = nullptr;
+        }
+    }
+
+protected:
+    HeapFile& file;
+    const FreeSpaceMap& fsm;
+    const RowCodec& codec;
+    ColumnPredicates predicates;
+    BlockIDRange blocks;
+    BlockIDRange::iterator block_it;
+    SlottedPage* block;
+    SlottedPage::Records::iterator record_it;
+    SlottedPage::Records::iterator record_end;
+};
+
+/**
+ * @class HeapTableFilter - streams the handles from another cursor whose rows meet some predicates
+ */
+class HeapTableFilter : public HandleCursor {
+public:
+    HeapTableFilter(HeapFile& file, const RowCodec& codec, const ColumnPredicates& predicates, HandleCursor* source)
+        : file(file), codec(codec), predicates(predicates), source(source), block(nullptr) {}
+
+    virtual ~HeapTableFilter() {
+        delete block;
+        delete source;
+    }
+
+    HeapTableFilter(const HeapTableFilter& other) = delete;
+
+    HeapTableFilter& operator=(const HeapTableFilter& other) = delete;
+
+    virtual bool next(Handle& handle) {
+        Handle candidate;
+        while (source->next(candidate)) {
+            // consecutive handles in the same block share one fetch of it
+            if (block == nullptr || block->get_block_id() != candidate.first) {
+                delete block;
+                block = nullptr;
+                block = file.get(candidate.first);
+            }
+            SlottedPage* moved_to;
+            const char* row = find_row(file, block, candidate.second, moved_to);
+            bool matched = row != nullptr && codec.matches(row, predicates);
+            delete moved_to;
+            if (matched) {
+                handle = candidate;
+                return true;
+            }
+        }
+        return false;
+    }
+
+protected:
+    HeapFile& file;
+    const RowCodec& codec;
+    ColumnPredicates predicates;
+    HandleCursor* source;
+    SlottedPage* block;
+};
+
 HeapTable::HeapTable(Identifier table_name, ColumnNames column_names, ColumnAttributes column_attributes)
-    : DbRelation(table_name, column_names, column_attributes), file(table_name) {
+    : DbRelation(table_name, column_names, column_attributes), file(table_name), fsm(file, table_name),
+      codec(column_attributes), column_numbers() {
+    for (uint i = 0; i < this->column_names.size(); i++)
+        this->column_numbers[this->column_names[i]] = i;
 }
 
 void HeapTable::create() {
-    this->file.create();
+    this->create(DbBlock::BLOCK_SZ);
+}
+
+void HeapTable::create(uint block_size) {
+    this->file.create(block_size);
+    this->fsm.create();
 }
 
 void HeapTable::create_if_not_exists() {
@@ -25,14 +184,18 @@ void HeapTable::create_if_not_exists() {
 }
 
 void HeapTable::drop() {
+    this->open();  // so a table from before free-space maps has one to drop
+    this->fsm.drop();
     this->file.drop();
 }
 
 void HeapTable::open() {
     this->file.open();
+    this->fsm.open();
 }
 
 void HeapTable::close() {
+    this->fsm.close();
     this->file.close();
 }
 
@@ -44,8 +207,163 @@ Handle HeapTable::insert(const ValueDict* row) {
     return handle;
 }
 
+Handles* HeapTable::insert_batch(const ValueDicts* rows) {
+    this->open();
+
+    // check and size every row before writing any of them
+    std::vector<std::vector<const Value*>> row_values;
+    std::vector<u16> sizes;
+    row_values.reserve(rows->size());
+    sizes.reserve(rows->size());
+    for (auto const row: *rows) {
+        for (auto const& column_name: this->column_names)
+            if (row->find(column_name) == row->end())
+                throw DbRelationError("don't know how to handle NULLs, defaults, etc. yet");
+        row_values.push_back(this->row_values(row));
+        sizes.push_back(this->record_size(row_values.back()));
+    }
+
+    // fill the last block, then one new block after another, each put (and mapped) once it is full
+    Handles* handles = new Handles();
+    handles->reserve(rows->size());
+    SlottedPage* block = nullptr;
+    try {
+        for (uint i = 0; i < sizes.size(); i++) {
+            if (block == nullptr)
+                block = this->file.get(this->file.get_last_block_id());
+            RecordID record_id;
+            char* bytes;
+            try {
+                bytes = block->allocate(sizes[i], record_id);
+            } catch (DbBlockNoRoomError& e) {
+                this->file.put(block);
+                this->fsm.update(block);
+                delete block;
+                block = nullptr;
+                block = this->file.get_new();
+                bytes = block->allocate(sizes[i], record_id);  // a row always fits in an empty block
+            }
+            bytes[0] = ROW;
+            this->codec.encode(row_values[i], bytes + 1);
+            handles->push_back(Handle(block->get_block_id(), record_id));
+        }
+        if (block != nullptr) {
+            this->file.put(block);
+            this->fsm.update(block);
+        }
+    } catch (...) {
+        delete block;
+        delete handles;
+        throw;
+    }
+    delete block;
+    return handles;
+}
+
 void HeapTable::update(const Handle handle, const ValueDict* new_values) {
-    throw DbRelationError("Not implemented");
+    this->open();
+    SlottedPage* home = this->file.get(handle.first);
+    SlottedPage* moved_to = nullptr;
+    try {
+        // the row as it is, wherever it lives, with the new values in it
+        u16 size;
+        const char* bytes = home->get_record(handle.second, size);
+        if (bytes == nullptr || bytes[0] == MOVED)
+            throw DbRelationError("no row at handle (" + std::to_string(handle.first) + ", " +
+                                  std::to_string(handle.second) + ")");
+        Handle moved(0, 0);
+        const char* row = bytes + 1;
+        if (bytes[0] == FORWARD) {
+            moved = read_link(bytes);
+            moved_to = this->file.get(moved.first);
+            row = moved_to->get_record(moved.second, size) + LINK_SIZE;
+        }
+        std::vector<Value> values;
+        this->codec.decode(row, values);
+        for (auto const& new_value: *new_values)
+            values[this->column_number(new_value.first)] = new_value.second;
+        std::vector<const Value*> value_ptrs;
+        for (auto const& value: values)
+            value_ptrs.push_back(&value);
+        std::vector<char> row_record(this->record_size(value_ptrs), 0);
+        row_record[0] = ROW;
+        uint encoded_size = this->codec.encode(value_ptrs, row_record.data() + 1);
+        std::vector<char> moved_record(LINK_SIZE + encoded_size);
+        write_link(moved_record.data(), MOVED, handle);
+        std::memcpy(moved_record.data() + LINK_SIZE, row_record.data() + 1, encoded_size);
+
+        // overwrite it in place if it fits (first where it is, then back at its handle), otherwise move it
+        if (moved_to != nullptr && this->put_if_room(moved_to, moved.second, moved_record)) {
+            // stays where it moved to
+        } else if (this->put_if_room(home, handle.second, row_record)) {
+            if (moved_to != nullptr) {
+                moved_to->del(moved.second);  // back home
+                this->file.put(moved_to);
+                this->fsm.update(moved_to);
+            }
+        } else {
+            this->relocate(handle, home, moved_to, moved.second, moved_record);
+        }
+    } catch (...) {
+        delete moved_to;
+        delete home;
+        throw;
+    }
+    delete moved_to;
+    delete home;
+}
+
+bool HeapTable::put_if_room(SlottedPage* block, RecordID record_id, const std::vector<char>& record) {
+    try {
+        block->put(record_id, Dbt((void*) record.data(), (u_int32_t) record.size()));
+    } catch (DbBlockNoRoomError& e) {
+        return false;
+    }
+    this->file.put(block);
+    this->fsm.update(block);
+    return true;
+}
+
+void HeapTable::relocate(Handle handle, SlottedPage* home, SlottedPage* moved_to, RecordID moved_id,
+                         const std::vector<char>& record) {
+    // a block other than the ones the row did not fit in
+    u16 size = (u16) record.size();
+    SlottedPage* block;
+    RecordID record_id;
+    char* bytes = nullptr;
+    while (bytes == nullptr) {
+        BlockID block_id = this->fsm.find(size);
+        if (block_id == home->get_block_id() || (moved_to != nullptr && block_id == moved_to->get_block_id()))
+            block_id = 0;
+        block = block_id ? this->file.get(block_id) : this->file.get_new();
+        try {
+            bytes = block->allocate(size, record_id);
+        } catch (DbBlockNoRoomError &e) {
+            if (!block_id) {
+                delete block;
+                throw;
+            }
+            this->fsm.update(block);  // the map was behind; try another block
+            delete block;
+        }
+    }
+    std::memcpy(bytes, record.data(), size);
+    this->file.put(block);
+    this->fsm.update(block);
+    Handle moved(block->get_block_id(), record_id);
+    delete block;
+
+    // the record at the handle just says where the row went (and is never smaller than that)
+    char link[LINK_SIZE];
+    write_link(link, FORWARD, moved);
+    home->put(handle.second, Dbt(link, LINK_SIZE));  // shrinks (or stays the same size) in place
+    this->file.put(home);
+    this->fsm.update(home);
+    if (moved_to != nullptr) {
+        moved_to->del(moved_id);
+        this->file.put(moved_to);
+        this->fsm.update(moved_to);
+    }
 }
 
 void HeapTable::del(const Handle handle) {
@@ -53,64 +371,390 @@ void HeapTable::del(const Handle handle) {
     BlockID block_id = handle.first;
     RecordID record_id = handle.second;
     SlottedPage* block = this->file.get(block_id);
+    try {
+        u16 size;
+        const char* bytes = block->get_record(record_id, size);
+        if (bytes != nullptr && bytes[0] == FORWARD) {
+            Handle moved = read_link(bytes);
+            SlottedPage* moved_to = this->file.get(moved.first);
+            moved_to->del(moved.second);
+            this->file.put(moved_to);
+            this->fsm.update(moved_to);
+            delete moved_to;
+        }
+    } catch (...) {
+        delete block;
+        throw;
+    }
     block->del(record_id);
     this->file.put(block);
+    this->fsm.update(block);
     delete block;
 }
 
+Handles* HeapTable::vacuum_rows(uint max_rows) {
+    this->open();
+    Handles* handles = new Handles();
+    try {
+        bool stuck = false;
+        for (BlockID block_id = this->file.get_last_block_id(); block_id > 1 && !stuck; block_id--) {
+            if (this->fsm.is_empty(block_id))
+                continue;
+            SlottedPage* block = this->file.get(block_id);
+            try {
+                for (RecordID record_id: block->records()) {
+                    if (handles->size() >= max_rows)
+                        break;
+                    u16 size;
+                    const char* bytes = block->get_record(record_id, size);
+                    if (bytes[0] == MOVED)
+                        stuck = !this->vacuum_moved(block, record_id);
+                    else if (bytes[0] == FORWARD || this->fsm.find(size, block_id) != 0)
+                        handles->push_back(Handle(block_id, record_id));
+                    else
+                        stuck = true;
+                    if (stuck)
+                        break;
+                }
+            } catch (...) {
+                delete block;
+                throw;
+            }
+            delete block;
+            if (handles->size() >= max_rows)
+                break;
+        }
+    } catch (...) {
+        delete handles;
+        throw;
+    }
+    return handles;
+}
+
+bool HeapTable::vacuum_moved(SlottedPage* block, RecordID record_id) {
+    u16 size;
+    const char* bytes = block->get_record(record_id, size);
+    Handle home_handle = read_link(bytes);
+    std::vector<char> moved_record(bytes, bytes + size);
+    std::vector<char> row_record(std::max(size - LINK_SIZE + 1U, (uint) LINK_SIZE), 0);
+    row_record[0] = ROW;
+    std::memcpy(row_record.data() + 1, bytes + LINK_SIZE, size - LINK_SIZE);
+
+    SlottedPage* home = this->file.get(home_handle.first);
+    SlottedPage* to = nullptr;
+    try {
+        if (!this->put_if_room(home, home_handle.second, row_record)) {
+            RecordID moved_id;
+            char* at = this->allocate_before(size, block->get_block_id(), to, moved_id);
+            if (at == nullptr) {
+                delete home;
+                return false;
+            }
+            std::memcpy(at, moved_record.data(), size);
+            this->file.put(to);
+            this->fsm.update(to);
+            char link[LINK_SIZE];
+            write_link(link, FORWARD, Handle(to->get_block_id(), moved_id));
+            home->put(home_handle.second, Dbt(link, LINK_SIZE));
+            this->file.put(home);
+        }
+    } catch (...) {
+        delete to;
+        delete home;
+        throw;
+    }
+    delete to;
+    delete home;
+    block->del(record_id);
+    this->file.put(block);
+    this->fsm.update(block);
+    return true;
+}
+
+Handles* HeapTable::vacuum_move(const Handles* handles) {
+    this->open();
+    Handles* moved = new Handles();
+    moved->reserve(handles->size());
+    try {
+        for (auto const& handle: *handles) {
+            SlottedPage* block = this->file.get(handle.first);
+            SlottedPage* to = nullptr;
+            try {
+                u16 size;
+                const char* bytes = block->get_record(handle.second, size);
+                if (bytes == nullptr || bytes[0] == MOVED)
+                    throw DbRelationError("no row at handle (" + std::to_string(handle.first) + ", " +
+                                          std::to_string(handle.second) + ")");
+                Handle new_handle = handle;
+                if (bytes[0] == FORWARD) {
+                    // becomes a plain row where it moved to (shrinking in place)
+                    new_handle = read_link(bytes);
+                    to = this->file.get(new_handle.first);
+                    u16 moved_size;
+                    const char* moved_bytes = to->get_record(new_handle.second, moved_size);
+                    std::vector<char> row_record(std::max(moved_size - LINK_SIZE + 1U, (uint) LINK_SIZE), 0);
+                    row_record[0] = ROW;
+                    std::memcpy(row_record.data() + 1, moved_bytes + LINK_SIZE, moved_size - LINK_SIZE);
+                    to->put(new_handle.second, Dbt(row_record.data(), (u_int32_t) row_record.size()));
+                } else {
+                    RecordID record_id;
+                    char* at = this->allocate_before(size, handle.first, to, record_id);
+                    if (at != nullptr) {
+                        std::memcpy(at, bytes, size);
+                        new_handle = Handle(to->get_block_id(), record_id);
+                    }
+                }
+                if (to != nullptr) {
+                    this->file.put(to);
+                    this->fsm.update(to);
+                    block->del(handle.second);
+                    this->file.put(block);
+                    this->fsm.update(block);
+                }
+                moved->push_back(new_handle);
+            } catch (...) {
+                delete to;
+                delete block;
+                throw;
+            }
+            delete to;
+            delete block;
+        }
+    } catch (...) {
+        delete moved;
+        throw;
+    }
+    return moved;
+}
+
+uint HeapTable::vacuum_truncate() {
+    this->open();
+    BlockID last = this->file.get_last_block_id();
+    BlockID keep = last;
+    while (keep > 1 && this->fsm.is_empty(keep))
+        keep--;
+    if (keep == last)
+        return 0;
+    this->fsm.truncate(keep);
+    this->file.truncate(keep);
+    return last - keep;
+}
+
+char* HeapTable::allocate_before(u16 size, BlockID before, SlottedPage*& block, RecordID& record_id) {
+    block = nullptr;
+    while (true) {
+        BlockID block_id = this->fsm.find(size, before);
+        if (block_id == 0)
+            return nullptr;
+        block = this->file.get(block_id);
+        try {
+            return block->allocate(size, record_id);
+        } catch (DbBlockNoRoomError& e) {
+            this->fsm.update(block);  // the map was behind; try another block
+            delete block;
+            block = nullptr;
+        }
+    }
+}
+
 Handles* HeapTable::select() {
     return this->select(nullptr);
 }
 
 Handles* HeapTable::select(const ValueDict* where) {
-    this->open();
+    HandleCursor* cursor = this->scan(where);
     Handles* handles = new Handles();
-    BlockIDs* block_ids = this->file.block_ids();
-    for (BlockID& block_id: *block_ids) {
-        SlottedPage* block = this->file.get(block_id);
-        RecordIDs* record_ids = block->ids();
-        for (RecordID& record_id: *record_ids) {
-            Handle handle(block_id, record_id);
-            if (this->selected(handle, where))
-                handles->push_back(handle);
-        }
-        delete record_ids;
-        delete block;
-    }
-    delete block_ids;
+    Handle handle;
+    while (cursor->next(handle))
+        handles->push_back(handle);
+    delete cursor;
     return handles;
 }
 
 Handles* HeapTable::select(Handles* current_selection, const ValueDict* where) {
+    this->open();
+    ColumnPredicates predicates = this->compile(where);
     Handles* handles = new Handles();
-    for (auto const& handle: *current_selection)
-        if (selected(handle, where))
+    SlottedPage* block = nullptr;
+    for (auto const& handle: *current_selection) {
+        // consecutive handles in the same block share one fetch of it
+        if (block == nullptr || block->get_block_id() != handle.first) {
+            delete block;
+            block = this->file.get(handle.first);
+        }
+        SlottedPage* moved_to;
+        const char* row = find_row(this->file, block, handle.second, moved_to);
+        bool matched = row != nullptr && this->codec.matches(row, predicates);
+        delete moved_to;
+        if (matched)
             handles->push_back(handle);
+    }
+    delete block;
     return handles;
 }
 
+HandleCursor* HeapTable::scan(const ValueDict* where) {
+    this->open();
+    return new HeapTableScan(this->file, this->fsm, this->codec, this->compile(where));
+}
+
+HandleCursor* HeapTable::scan(HandleCursor* source, const ValueDict* where) {
+    this->open();
+    ColumnPredicates predicates;
+    try {
+        predicates = this->compile(where);
+    } catch (DbRelationError& e) {
+        delete source;
+        throw;
+    }
+    return new HeapTableFilter(this->file, this->codec, predicates, source);
+}
+
 ValueDict* HeapTable::project(Handle handle) {
     return this->project(handle, &this->column_names);
 }
 
 ValueDict* HeapTable::project(Handle handle, const ColumnNames* column_names) {
-    BlockID block_id = handle.first;
-    RecordID record_id = handle.second;
-    SlottedPage* block = this->file.get(block_id);
-    Dbt* data = block->get(record_id);
-    ValueDict* row = this->unmarshal(data);
-    delete data;
+    if (column_names->empty())
+        column_names = &this->column_names;
+    std::vector<uint> columns = this->lookup_columns(column_names);
+    SlottedPage* block = this->file.get(handle.first);
+    ValueDict* row;
+    try {
+        row = this->decode_row(block, handle.second, columns, column_names);
+    } catch (DbRelationError& e) {
+        delete block;
+        throw;
+    }
     delete block;
+    return row;
+}
+
+ValueDicts* HeapTable::project(Handles* handles) {
+    return this->project(handles, &this->column_names);
+}
+
+ValueDicts* HeapTable::project(Handles* handles, const ColumnNames* column_names) {
     if (column_names->empty())
-        return row;
-    ValueDict* result = new ValueDict();
-    for (auto const& column_name: *column_names) {
-        if (row->find(column_name) == row->end())
-            throw DbRelationError("table does not have column named '" + column_name + "'");
-        (*result)[column_name] = (*row)[column_name];
+        column_names = &this->column_names;
+    std::vector<uint> columns = this->lookup_columns(column_names);
+
+    // visit the handles grouped by block, keeping their relative order within each block
+    std::vector<uint> order(handles->size());
+    for (uint i = 0; i < order.size(); i++)
+        order[i] = i;
+    std::stable_sort(order.begin(), order.end(),
+                     [handles](uint a, uint b) { return (*handles)[a].first < (*handles)[b].first; });
+
+    ValueDicts* rows = new ValueDicts(handles->size(), nullptr);
+    SlottedPage* block = nullptr;
+    try {
+        for (auto i: order) {
+            Handle handle = (*handles)[i];
+            if (block == nullptr || block->get_block_id() != handle.first) {
+                delete block;
+                block = nullptr;
+                block = this->file.get(handle.first);
+            }
+            (*rows)[i] = this->decode_row(block, handle.second, columns, column_names);
+        }
+    } catch (...) {
+        delete block;
+        for (auto row: *rows)
+            delete row;
+        delete rows;
+        throw;
     }
-    delete row;
-    return result;
+    delete block;
+    return rows;
+}
+
+ValueDicts* HeapTable::sample(uint max_rows, u_long& row_count, uint& page_count) {
+    std::mt19937 random(5300);  // the same seed each time, so an unchanged table gets the same sample
+    this->open();
+    page_count = this->file.get_last_block_id();
+
+    // reservoir of the blocks with rows, read in file order
+    std::vector<BlockID> blocks;
+    u_long live_blocks = 0;
+    for (BlockID block_id: this->file.blocks()) {
+        if (this->fsm.is_empty(block_id))
+            continue;
+        live_blocks++;
+        if (blocks.size() < max_rows) {
+            blocks.push_back(block_id);
+        } else {
+            u_long i = std::uniform_int_distribution<u_long>(0, live_blocks - 1)(random);
+            if (i < max_rows)
+                blocks[i] = block_id;
+        }
+    }
+    std::sort(blocks.begin(), blocks.end());
+
+    // reservoir of their rows, decoding just the ones that get into it
+    std::vector<uint> columns = this->lookup_columns(&this->column_names);
+    ValueDicts* rows = new ValueDicts();
+    u_long seen = 0;
+    SlottedPage* block = nullptr;
+    try {
+        for (BlockID block_id: blocks) {
+            block = this->file.get(block_id);
+            for (RecordID record_id: block->records()) {
+                SlottedPage* moved_to;
+                bool live = find_row(this->file, block, record_id, moved_to) != nullptr;
+                delete moved_to;
+                if (!live)
+                    continue;
+                seen++;
+                u_long i = rows->size();
+                if (i == max_rows)
+                    i = std::uniform_int_distribution<u_long>(0, seen - 1)(random);
+                if (i >= max_rows)
+                    continue;
+                ValueDict* row = this->decode_row(block, record_id, columns, &this->column_names);
+                if (i == rows->size()) {
+                    rows->push_back(row);
+                } else {
+                    delete (*rows)[i];
+                    (*rows)[i] = row;
+                }
+            }
+            delete block;
+            block = nullptr;
+        }
+    } catch (...) {
+        delete block;
+        for (auto row: *rows)
+            delete row;
+        delete rows;
+        throw;
+    }
+    row_count = blocks.empty() ? 0 : seen * live_blocks / blocks.size();
+    return rows;
+}
+
+std::vector<uint> HeapTable::lookup_columns(const ColumnNames* column_names) const {
+    std::vector<uint> columns;
+    columns.reserve(column_names->size());
+    for (auto const& column_name: *column_names)
+        columns.push_back(this->column_number(column_name));
+    return columns;
+}
+
+ValueDict* HeapTable::decode_row(SlottedPage* block, RecordID record_id, const std::vector<uint>& columns,
+                                 const ColumnNames* column_names) {
+    SlottedPage* moved_to;
+    const char* bytes = find_row(this->file, block, record_id, moved_to);
+    if (bytes == nullptr)
+        throw DbRelationError("no row at handle (" + std::to_string(block->get_block_id()) + ", " +
+                              std::to_string(record_id) + ")");
+    std::vector<Value> values;
+    this->codec.decode(bytes, columns, values);
+    delete moved_to;
+    ValueDict* row = new ValueDict();
+    for (uint i = 0; i < columns.size(); i++)
+        (*row)[(*column_names)[i]] = values[i];
+    return row;
 }
 
 ValueDict* HeapTable::validate(const ValueDict* row) const {
@@ -128,99 +772,83 @@ ValueDict* HeapTable::validate(const ValueDict* row) const {
 }
 
 Handle HeapTable::append(const ValueDict* row) {
-    Dbt* data = marshal(row);
-    SlottedPage* block = this->file.get(this->file.get_last_block_id());
+    std::vector<const Value*> values = this->row_values(row);
+    u16 size = this->record_size(values);
+    SlottedPage* block;
     RecordID record_id;
-    try {
-        record_id = block->add(data);
-    } catch (DbBlockNoRoomError &e) {
-        // need a new block
-        delete block;
-        block = this->file.get_new();
-        record_id = block->add(data);
+    char* bytes = nullptr;
+    while (bytes == nullptr) {
+        BlockID block_id = this->fsm.find(size);
+        block = block_id ? this->file.get(block_id) : this->file.get_new();  // need a new block if none has room
+        try {
+            bytes = block->allocate(size, record_id);
+        } catch (DbBlockNoRoomError &e) {
+            if (!block_id) {
+                delete block;
+                throw;
+            }
+            this->fsm.update(block);  // the map was behind; try another block
+            delete block;
+        }
     }
+    bytes[0] = ROW;
+    this->codec.encode(values, bytes + 1);  // straight into the block
     this->file.put(block);
+    this->fsm.update(block);
+    Handle handle(block->get_block_id(), record_id);
     delete block;
-    delete[] (char*)data->get_data();
-    delete data;
-    return Handle(this->file.get_last_block_id(), record_id);
+    return handle;
 }
 
-Dbt* HeapTable::marshal(const ValueDict* row) const {
-    char* bytes = new char[DbBlock::BLOCK_SZ]; // more than we need (we insist that one row fits into DbBlock::BLOCK_SZ)
-    uint offset = 0;
-    uint col_num = 0;
-    for (auto const& column_name: this->column_names) {
-        ColumnAttribute ca = this->column_attributes[col_num++];
-        ValueDict::const_iterator column = row->find(column_name);
-        Value value = column->second;
-        if (ca.get_data_type() == ColumnAttribute::DataType::INT) {
-            if (offset + 4 > DbBlock::BLOCK_SZ - 4)
-                throw DbRelationError("row too big to marshal");
-            *(int32_t*)(bytes + offset) = value.n;
-            offset += sizeof(int32_t);
-        } else if (ca.get_data_type() == ColumnAttribute::DataType::TEXT) {
-            u_long size = value.s.length();
-            if (size > UINT16_MAX)
-                throw DbRelationError("text field too long to marshal");
-            if (offset + 2 + size > DbBlock::BLOCK_SZ)
-                throw DbRelationError("row too big to marshal");
-            *(u16*)(bytes + offset) = size;
-            offset += sizeof(u16);
-            std::memcpy(bytes + offset, value.s.c_str(), size); // assume ascii for now
-            offset += size;
-        } else if (ca.get_data_type() == ColumnAttribute::DataType::BOOLEAN) {
-            if (offset + 1 > DbBlock::BLOCK_SZ - 1)
-                throw DbRelationError("row too big to marshal");
-            *(uint8_t*)(bytes + offset) = (uint8_t) value.n;
-            offset += sizeof(uint8_t);
-        } else {
-            throw DbRelationError("Only know how to marshal INT, TEXT, and BOOLEAN");
-        }
-    }
-    char* right_size_bytes = new char[offset];
-    std::memcpy(right_size_bytes, bytes, offset);
-    delete[] bytes;
-    Dbt* data = new Dbt(right_size_bytes, offset);
-    return data;
+// A row's record is its kind byte and the encoded row, padded to room for a forwarding record in case the row
+// has to move. The row must fit in a block even once it has moved (behind the handle it is known by).
+u_int16_t HeapTable::record_size(const std::vector<const Value*>& values) const {
+    uint encoded_size = this->codec.size(values);
+    if (encoded_size + LINK_SIZE + SlottedPage::HEADER_SIZE + 4U >= this->file.get_block_size())
+        throw DbRelationError("row too big for a " + std::to_string(this->file.get_block_size()) + "-byte block of " +
+                              this->table_name);
+    return (u16) std::max(1U + encoded_size, (uint) LINK_SIZE);
 }
 
-ValueDict* HeapTable::unmarshal(Dbt* data) const {
-    ValueDict* row = new ValueDict();
-    Value value;
-    char* bytes = (char*)data->get_data();
-    uint offset = 0;
-    uint col_num = 0;
-    for (auto const& column_name: this->column_names) {
-        ColumnAttribute ca = this->column_attributes[col_num++];
-        value.data_type = ca.get_data_type();
-        if (ca.get_data_type() == ColumnAttribute::DataType::INT) {
-            value.n = *(int32_t*)(bytes + offset);
-            offset += sizeof(int32_t);
-        } else if (ca.get_data_type() == ColumnAttribute::DataType::TEXT) {
-            u16 size = *(u16*)(bytes + offset);
-            offset += sizeof(u16);
-            char buffer[DbBlock::BLOCK_SZ];
-            std::memcpy(buffer, bytes + offset, size);
-            buffer[size] = '\0';
-            value.s = std::string(buffer);  // assume ascii for now
-            offset += size;
-        } else if (ca.get_data_type() == ColumnAttribute::DataType::BOOLEAN) {
-            value.n = *(uint8_t *) (bytes + offset);
-            offset += sizeof(uint8_t);
-        } else {
-            throw DbRelationError("Only know how to unmarshal INT, TEXT, and BOOLEAN");
-        }
-        (*row)[column_name] = value;
-    }
-    return row;
+uint HeapTable::get_block_size() {
+    this->open();
+    return this->file.get_block_size();
+}
+
+uint HeapTable::column_number(const Identifier& column_name) const {
+    auto it = this->column_numbers.find(column_name);
+    if (it == this->column_numbers.end())
+        throw DbRelationError("table does not have column named '" + column_name + "'");
+    return it->second;
+}
+
+std::vector<const Value*> HeapTable::row_values(const ValueDict* row) const {
+    std::vector<const Value*> values;
+    values.reserve(this->column_names.size());
+    for (auto const& column_name: this->column_names)
+        values.push_back(&row->at(column_name));
+    return values;
 }
 
 bool HeapTable::selected(Handle handle, const ValueDict* where) {
     if (where == nullptr)
         return true;
-    ValueDict* row = this->project(handle, where);
-    bool is_selected = *row == *where;
-    delete row;
+    SlottedPage* block = this->file.get(handle.first);
+    SlottedPage* moved_to;
+    const char* row = find_row(this->file, block, handle.second, moved_to);
+    bool is_selected = row != nullptr && this->codec.matches(row, this->compile(where));
+    delete moved_to;
+    delete block;
     return is_selected;
 }
+
+ColumnPredicates HeapTable::compile(const ValueDict* where) const {
+    ColumnPredicates predicates;
+    if (where == nullptr)
+        return predicates;
+    for (auto const& condition: *where)
+        predicates.push_back(ColumnPredicate(this->column_number(condition.first), &condition.second));
+    std::sort(predicates.begin(), predicates.end(),
+              [](const ColumnPredicate& a, const ColumnPredicate& b) { return a.first < b.first; });
+    return predicates;
+}
@@ -8,13 +8,24 @@
 
 #pragma once
 
+#include <map>
 #include <string>
+#include <vector>
 #include "storage_engine.h"
 #include "SlottedPage.h"
 #include "HeapFile.h"
+#include "FreeSpaceMap.h"
+#include "RowCodec.h"
 
 /**
  * @class HeapTable - Heap storage engine (implementation of DbRelation)
+ *
+ * A free-space map of the table's blocks points inserts at space left by deletes, and lets scans skip
+ * blocks with no live rows.
+ *
+ * Each record starts with a byte saying what it is: a row, a forwarding record holding the handle of the block and
+ * record a row has moved to (when an update made it too big for its block), or such a moved row, which readers
+ * only reach through its forwarding record. So a row keeps its handle for as long as it exists.
  */
 class HeapTable : public DbRelation {
 public:
@@ -41,6 +52,12 @@ public:
      */
     virtual void create();
 
+    /**
+     * Creates the HeapTable relation with blocks of a given size (see HeapFile::create)
+     * @param block_size  bytes per block
+     */
+    virtual void create(uint block_size);
+
     /** 
      * Creates the HeapTable relation if it doesn't already exist
      */ 
@@ -69,12 +86,46 @@ public:
     virtual Handle insert(const ValueDict* row);
 
     /**
-     * Updates a record to a database
+     * Inserts many data tuples, filling one block at a time and writing each block once. Rows go into the last
+     * block and then into new blocks, not into the room deletes left elsewhere. Every row is checked before any
+     * is written, so a bad row leaves the table as it was.
+     * @param rows The data tuples to insert
+     * @return Handles locating the inserted tuples, in the same order as rows (freed by caller)
+     */
+    virtual Handles* insert_batch(const ValueDicts* rows);
+
+    /**
+     * Changes some of a row's values. The row is overwritten in place if it still fits in its block; otherwise
+     * it moves to another block and the record at its handle becomes a forwarding record pointing there. Either
+     * way the handle stays the row's handle, so indices on columns that did not change need no maintenance.
      * @param handle The location (block ID, record ID) of the record
      * @param new_values The new fields to replace the existing fields with
      */
     virtual void update(const Handle handle, const ValueDict* new_values);
 
+    /**
+     * Picks rows from the last blocks that fit in room in earlier blocks, walking back from the last block until
+     * a row does not fit. Moved rows (see update) met on the way are moved at once, back to their handle's block
+     * if there is room there: their handles do not change.
+     * @param max_rows Most rows to pick
+     * @return Handles of the picked rows, empty once no more can move (freed by caller)
+     */
+    virtual Handles* vacuum_rows(uint max_rows);
+
+    /**
+     * Moves each row into the first earlier block with room for it (a row that has no room left stays put).
+     * A row that had moved to another block just stays there, under a new handle.
+     * @param handles Rows picked by vacuum_rows
+     * @return Their new handles, in the same order (freed by caller)
+     */
+    virtual Handles* vacuum_move(const Handles* handles);
+
+    /**
+     * Cuts the file (and the free-space map) short after the last block with any rows
+     * @return Number of blocks given back
+     */
+    virtual uint vacuum_truncate();
+
     /**
      * Deletes a row from the table using the given handle for the row
      * @param handle The handle for the row being deleted
@@ -101,6 +152,21 @@ public:
      */
     virtual Handles* select(Handles* current_selection, const ValueDict* where);
 
+    /**
+     * Stream the handles of the rows matching where, holding just one block at a time
+     * @param where predicates to match (must outlive the cursor)
+     * @return      cursor over the matching rows (freed by caller)
+     */
+    virtual HandleCursor* scan(const ValueDict* where = nullptr);
+
+    /**
+     * Stream the handles from source that match where
+     * @param source cursor over rows of this table (freed by the returned cursor)
+     * @param where  predicates to match (must outlive the cursor)
+     * @return       cursor over the matching rows (freed by caller)
+     */
+    virtual HandleCursor* scan(HandleCursor* source, const ValueDict* where);
+
     /**
      * Return a sequence of all values for handle (SELECT *).
      * @param handle Location of row to get values from
@@ -116,10 +182,45 @@ public:
      */
     virtual ValueDict* project(Handle handle, const ColumnNames* column_names);
 
+    /**
+     * Return all values for each of the handles (SELECT *), reading each block once.
+     * @param handles Locations of rows to get values from
+     * @returns List of rows in the same order as handles
+     */
+    virtual ValueDicts* project(Handles* handles);
+
+    /**
+     * Return values given by column_names for each of the handles. The handles are visited grouped by
+     * block so that each block is read only once, however they are ordered.
+     * @param handles Locations of rows to get values from
+     * @param column_names List of column names to project
+     * @returns List of rows (keyed by column_names) in the same order as handles
+     */
+    virtual ValueDicts* project(Handles* handles, const ColumnNames* column_names);
+
     using DbRelation::project;
 
+    /**
+     * Pick rows at random in two stages, as PostgreSQL's ANALYZE does: first up to max_rows of the blocks that
+     * have rows, then up to max_rows of the rows in those blocks. So however big the table, no more than max_rows
+     * blocks are read. The row count is scaled up from the rows in the blocks read.
+     * @param max_rows Most rows (and blocks) to pick
+     * @param row_count Returned by reference: estimate of the number of rows in the table
+     * @param page_count Returned by reference: the number of blocks in the table's file
+     * @return The picked rows (freed by caller)
+     */
+    virtual ValueDicts* sample(uint max_rows, u_long& row_count, uint& page_count);
+
+    /**
+     * Size of the table's blocks, as its file was created with
+     */
+    virtual uint get_block_size();
+
 protected:
     HeapFile file;
+    FreeSpaceMap fsm;
+    RowCodec codec;
+    std::map<Identifier, uint> column_numbers;
 
     /**
      * Checks if a row is valid to the table
@@ -129,22 +230,90 @@ protected:
     virtual ValueDict* validate(const ValueDict* row) const;
 
     /**
-     * Writes a data tuple to the database file
+     * Writes a data tuple to the database file, in the first block the free-space map has room in
+     * (or in a new block)
      * @param row The data tuple to add
      * @return A handle locating the block ID and record ID of the written tuple
      */
     virtual Handle append(const ValueDict* row);
 
     /**
-     * Return the bits to go into the file. Caller responsible for freeing the
-     * returned Dbt and its enclosed ret->get_data().
+     * Overwrite a record with a new version of it, and save the block, if the block has room for it
+     * @param block The block the record is in
+     * @param record_id The record
+     * @param record The new bytes of the record
+     * @return False if the block did not have room (and is unchanged)
+     */
+    bool put_if_room(SlottedPage* block, RecordID record_id, const std::vector<char>& record);
+
+    /**
+     * Move an updated row that does not fit where it is to another block, and forward its handle there
+     * @param handle The row's handle
+     * @param home The block of the handle
+     * @param moved_to The block the row had already moved to (and is now leaving), or nullptr
+     * @param moved_id The row's record in moved_to
+     * @param record The row's new record as a moved row: its kind byte, handle, then the encoded row
+     */
+    void relocate(Handle handle, SlottedPage* home, SlottedPage* moved_to, RecordID moved_id,
+                  const std::vector<char>& record);
+
+    /**
+     * Allocate a record in a block before a given one, the first that has room
+     * @param size The size of the record
+     * @param before Only blocks before this one will do
+     * @param block Returned by reference: the block (freed by caller), or nullptr if none has room
+     * @param record_id Returned by reference: the new record
+     * @return Where to write the record's bytes, or nullptr if no block before has room
+     */
+    char* allocate_before(u_int16_t size, BlockID before, SlottedPage*& block, RecordID& record_id);
+
+    /**
+     * VACUUM a moved row: back to its handle's block if there is room there, otherwise to an earlier block
+     * @param block The block the moved row is in
+     * @param record_id The moved row's record
+     * @return False if there was no room for it anywhere before block
+     */
+    bool vacuum_moved(SlottedPage* block, RecordID record_id);
+
+    /**
+     * Size of a row's record, checking that it fits in a block
+     * @param values The row's values in column order
+     * @return Bytes the row's record takes
+     */
+    u_int16_t record_size(const std::vector<const Value*>& values) const;
+
+    /**
+     * Get a column's position in the table
+     * @param column_name The column to look up
+     * @return The column number (0-based)
      */
-    virtual Dbt* marshal(const ValueDict* row) const;
-    
+    virtual uint column_number(const Identifier& column_name) const;
+
     /**
-     * Converts data bytes into concrete types
+     * Line up a row's values in column order for the codec
+     * @param row The data tuple (must have every column)
+     * @return Pointers into row, one per column
      */
-    virtual ValueDict* unmarshal(Dbt* data) const;
+    virtual std::vector<const Value*> row_values(const ValueDict* row) const;
+
+    /**
+     * Get the column numbers for a list of column names
+     * @param column_names Columns to look up
+     * @return Column number of each, in the same order
+     */
+    virtual std::vector<uint> lookup_columns(const ColumnNames* column_names) const;
+
+    /**
+     * Decode the given columns of a record in a block that has already been read (reading the block its row
+     * moved to, if it did)
+     * @param block The block holding the record
+     * @param record_id The record within the block
+     * @param columns Column numbers to decode
+     * @param column_names Names of those columns (keys of the returned row)
+     * @return The row's values, freed by caller
+     */
+    virtual ValueDict* decode_row(SlottedPage* block, RecordID record_id, const std::vector<uint>& columns,
+                                  const ColumnNames* column_names);
 
     /**
      * See if the row at the given handle satisfies the given where clause
@@ -153,4 +322,11 @@ protected:
      * @return        true if conditions met, false otherwise
      */
     virtual bool selected(Handle handle, const ValueDict* where);
+
+    /**
+     * Turn a where clause into predicates on column numbers, ordered by column number
+     * @param where  conditions to compile (must outlive the returned predicates)
+     * @return       the predicates
+     */
+    virtual ColumnPredicates compile(const ValueDict* where) const;
 };
@@ -339,6 +339,32 @@ string ParseTreeToString::del(const DeleteStatement* stmt) {
     return ret;
 }
 
+string ParseTreeToString::import(const ImportStatement* stmt) {
+    string ret("COPY ");
+    ret += stmt->tableName;
+    ret += " FROM '";
+    ret += stmt->filePath;
+    ret += "'";
+    return ret;
+}
+
+string ParseTreeToString::update(const UpdateStatement* stmt) {
+    string ret("UPDATE ");
+    ret += table_ref(stmt->table) + " SET ";
+    bool doComma = false;
+    for (UpdateClause* clause : *stmt->updates) {
+        if (doComma)
+            ret += ", ";
+        ret += string(clause->column) + " = " + expression(clause->value);
+        doComma = true;
+    }
+    if (stmt->where) {
+        ret += " WHERE ";
+        ret += expression(stmt->where);
+    }
+    return ret;
+}
+
 string ParseTreeToString::statement(const SQLStatement* stmt) {
     switch (stmt->type()) {
         case kStmtSelect:
@@ -353,9 +379,11 @@ string ParseTreeToString::statement(const SQLStatement* stmt) {
             return drop((const DropStatement*) stmt);
         case kStmtShow:
             return show((const ShowStatement*) stmt);
-        case kStmtError:
         case kStmtImport:
+            return import((const ImportStatement*) stmt);
         case kStmtUpdate:
+            return update((const UpdateStatement*) stmt);
+        case kStmtError:
         case kStmtPrepare:
         case kStmtExecute:
         case kStmtExport:
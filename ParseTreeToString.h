@@ -45,6 +45,10 @@ private:
 
     static std::string del(const hsql::DeleteStatement* stmt);
 
+    static std::string import(const hsql::ImportStatement* stmt);
+
+    static std::string update(const hsql::UpdateStatement* stmt);
+
     static std::string create(const hsql::CreateStatement* stmt);
 
     static std::string drop(const hsql::DropStatement* stmt);
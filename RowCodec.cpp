@@ -0,0 +1,297 @@
+/**
+ * @file RowCodec.cpp - implementation of RowCodec
+ * @author Justin Thoreson
+ * @see "Seattle University, CPSC5300, Winter 2023"
+ */
+
+#include <cstring>
+#include "RowCodec.h"
+
+using u16 = u_int16_t;
+
+RowCodec::RowCodec(const DataTypes& data_types) : data_types(data_types), fixed_offsets() {
+    this->precompute();
+}
+
+RowCodec::RowCodec(const ColumnAttributes& column_attributes) : data_types(), fixed_offsets() {
+    for (auto ca: column_attributes)
+        this->data_types.push_back(ca.get_data_type());
+    this->precompute();
+}
+
+void RowCodec::precompute() {
+    uint offset = 0;
+    for (auto const& data_type: this->data_types) {
+        if (data_type != ColumnAttribute::DataType::INT && data_type != ColumnAttribute::DataType::TEXT &&
+            data_type != ColumnAttribute::DataType::BOOLEAN)
+            throw DbRelationError("Only know how to marshal INT, TEXT, and BOOLEAN");
+        this->fixed_offsets.push_back(offset);
+        if (data_type == ColumnAttribute::DataType::TEXT)
+            break;
+        offset += data_type == ColumnAttribute::DataType::INT ? sizeof(int32_t) : sizeof(uint8_t);
+    }
+}
+
+uint RowCodec::field_size(ColumnAttribute::DataType data_type, const char* bytes) {
+    if (data_type == ColumnAttribute::DataType::INT)
+        return sizeof(int32_t);
+    if (data_type == ColumnAttribute::DataType::TEXT)
+        return sizeof(u16) + *(u16*) bytes;
+    return sizeof(uint8_t);
+}
+
+uint RowCodec::encoded_size(ColumnAttribute::DataType data_type, const Value& value) {
+    if (data_type == ColumnAttribute::DataType::INT)
+        return sizeof(int32_t);
+    if (data_type == ColumnAttribute::DataType::TEXT) {
+        if (value.s.length() > UINT16_MAX)
+            throw DbRelationError("text field too long to marshal");
+        return sizeof(u16) + (uint) value.s.length();
+    }
+    return sizeof(uint8_t);
+}
+
+Value RowCodec::decode_field(ColumnAttribute::DataType data_type, const char* bytes) {
+    Value value;
+    value.data_type = data_type;
+    if (data_type == ColumnAttribute::DataType::INT) {
+        value.n = *(int32_t*) bytes;
+    } else if (data_type == ColumnAttribute::DataType::TEXT) {
+        u16 size = *(u16*) bytes;
+        value.s.assign(bytes + sizeof(u16), size);  // assume ascii for now
+    } else {
+        value.n = *(uint8_t*) bytes;
+    }
+    return value;
+}
+
+uint RowCodec::encode_field(ColumnAttribute::DataType data_type, const Value& value, char* bytes) {
+    if (data_type == ColumnAttribute::DataType::INT) {
+        *(int32_t*) bytes = value.n;
+        return sizeof(int32_t);
+    }
+    if (data_type == ColumnAttribute::DataType::TEXT) {
+        u16 size = (u16) value.s.length();
+        *(u16*) bytes = size;
+        std::memcpy(bytes + sizeof(u16), value.s.data(), size);  // assume ascii for now
+        return sizeof(u16) + size;
+    }
+    *(uint8_t*) bytes = (uint8_t) value.n;
+    return sizeof(uint8_t);
+}
+
+uint RowCodec::size(const std::vector<const Value*>& values) const {
+    uint total = 0;
+    for (uint i = 0; i < this->data_types.size(); i++)
+        total += encoded_size(this->data_types[i], *values[i]);
+    if (total > DbBlock::MAX_BLOCK_SZ)
+        throw DbRelationError("row too big to marshal");
+    return total;
+}
+
+uint RowCodec::size(const std::vector<Value>& values) const {
+    uint total = 0;
+    for (uint i = 0; i < this->data_types.size(); i++)
+        total += encoded_size(this->data_types[i], values[i]);
+    if (total > DbBlock::MAX_BLOCK_SZ)
+        throw DbRelationError("row too big to marshal");
+    return total;
+}
+
+uint RowCodec::encode(const std::vector<const Value*>& values, char* bytes) const {
+    uint offset = 0;
+    for (uint i = 0; i < this->data_types.size(); i++)
+        offset += encode_field(this->data_types[i], *values[i], bytes + offset);
+    return offset;
+}
+
+uint RowCodec::encode(const std::vector<Value>& values, char* bytes) const {
+    uint offset = 0;
+    for (uint i = 0; i < this->data_types.size(); i++)
+        offset += encode_field(this->data_types[i], values[i], bytes + offset);
+    return offset;
+}
+
+uint RowCodec::offset(const char* bytes, uint column) const {
+    uint n_fixed = (uint) this->fixed_offsets.size();
+    if (column < n_fixed)
+        return this->fixed_offsets[column];
+    uint col_num = n_fixed - 1;
+    uint offset = this->fixed_offsets[col_num];
+    for (; col_num < column; col_num++)
+        offset += field_size(this->data_types[col_num], bytes + offset);
+    return offset;
+}
+
+Value RowCodec::decode(const char* bytes, uint column) const {
+    return decode_field(this->data_types[column], bytes + this->offset(bytes, column));
+}
+
+void RowCodec::decode(const char* bytes, const std::vector<uint>& columns, std::vector<Value>& values) const {
+    // find every field's offset once, as far as the last column needed
+    uint last = 0;
+    for (auto column: columns)
+        if (column > last)
+            last = column;
+    uint offsets[DbIndex::MAX_COMPOSITE];
+    std::vector<uint> more_offsets;
+    uint* offset = offsets;
+    if (last >= DbIndex::MAX_COMPOSITE) {
+        more_offsets.resize(last + 1);
+        offset = more_offsets.data();
+    }
+    uint n_fixed = (uint) this->fixed_offsets.size();
+    for (uint col_num = 0; col_num <= last; col_num++) {
+        if (col_num < n_fixed)
+            offset[col_num] = this->fixed_offsets[col_num];
+        else
+            offset[col_num] = offset[col_num - 1] + field_size(this->data_types[col_num - 1], bytes + offset[col_num - 1]);
+    }
+
+    values.clear();
+    values.reserve(columns.size());
+    for (auto column: columns)
+        values.push_back(decode_field(this->data_types[column], bytes + offset[column]));
+}
+
+void RowCodec::decode(const char* bytes, std::vector<Value>& values) const {
+    values.clear();
+    values.reserve(this->data_types.size());
+    uint offset = 0;
+    for (auto const& data_type: this->data_types) {
+        values.push_back(decode_field(data_type, bytes + offset));
+        offset += field_size(data_type, bytes + offset);
+    }
+}
+
+bool RowCodec::matches(const char* bytes, const ColumnPredicates& predicates) const {
+    uint n_fixed = (uint) this->fixed_offsets.size();
+    uint offset = 0;
+    uint col_num = 0;
+    for (auto const& predicate: predicates) {
+        // skip over the columns in front of the predicate's column
+        if (predicate.first < n_fixed) {
+            col_num = predicate.first;
+            offset = this->fixed_offsets[col_num];
+        } else {
+            if (col_num < n_fixed - 1) {
+                col_num = n_fixed - 1;
+                offset = this->fixed_offsets[col_num];
+            }
+            for (; col_num < predicate.first; col_num++)
+                offset += field_size(this->data_types[col_num], bytes + offset);
+        }
+
+        // compare in place
+        ColumnAttribute::DataType data_type = this->data_types[col_num];
+        const Value& value = *predicate.second;
+        if (value.data_type != data_type)
+            return false;
+        if (data_type == ColumnAttribute::DataType::INT) {
+            if (*(int32_t*) (bytes + offset) != value.n)
+                return false;
+        } else if (data_type == ColumnAttribute::DataType::TEXT) {
+            u16 size = *(u16*) (bytes + offset);
+            if (size != value.s.length() || std::memcmp(bytes + offset + sizeof(u16), value.s.data(), size) != 0)
+                return false;
+        } else {
+            if (*(uint8_t*) (bytes + offset) != value.n)
+                return false;
+        }
+    }
+    return true;
+}
+
+
+/************
+ * KeyCodec
+ ************/
+
+KeyCodec::KeyCodec(const DataTypes& data_types) : data_types(data_types) {
+    for (auto const& data_type: this->data_types)
+        if (data_type != ColumnAttribute::DataType::INT && data_type != ColumnAttribute::DataType::TEXT &&
+            data_type != ColumnAttribute::DataType::BOOLEAN)
+            throw DbRelationError("Only know how to marshal INT, TEXT, and BOOLEAN");
+}
+
+bool KeyCodec::accepts(const std::vector<Value>& values) const {
+    for (uint i = 0; i < this->data_types.size(); i++)
+        if (values[i].data_type != this->data_types[i])
+            return false;
+    return true;
+}
+
+KeyBytes KeyCodec::encode(const std::vector<Value>& values) const {
+    if (!this->accepts(values))
+        throw DbRelationError("key value is not of its column's type");
+    KeyBytes key;
+    for (uint i = 0; i < this->data_types.size(); i++) {
+        const Value& value = values[i];
+        if (this->data_types[i] == ColumnAttribute::DataType::INT) {
+            u_int32_t n = (u_int32_t) value.n ^ 0x80000000U;  // negatives sort first
+            for (int shift = 24; shift >= 0; shift -= 8)
+                key.push_back((char) (n >> shift));
+        } else if (this->data_types[i] == ColumnAttribute::DataType::TEXT) {
+            for (char c: value.s) {
+                key.push_back(c);
+                if (c == '\0')
+                    key.push_back((char) 0xFF);
+            }
+            key.push_back('\0');
+            key.push_back('\0');
+        } else {
+            key.push_back((char) (value.n ? 1 : 0));
+        }
+    }
+    if (key.size() > DbBlock::BLOCK_SZ)
+        throw DbRelationError("key too big to marshal");
+    return key;
+}
+
+void KeyCodec::decode(const char* bytes, std::vector<Value>& values) const {
+    values.clear();
+    values.reserve(this->data_types.size());
+    const unsigned char* p = (const unsigned char*) bytes;
+    for (auto const& data_type: this->data_types) {
+        Value value;
+        value.data_type = data_type;
+        if (data_type == ColumnAttribute::DataType::INT) {
+            u_int32_t n = 0;
+            for (int i = 0; i < 4; i++)
+                n = (n << 8) | *p++;
+            value.n = (int32_t) (n ^ 0x80000000U);
+        } else if (data_type == ColumnAttribute::DataType::TEXT) {
+            while (!(p[0] == 0 && p[1] == 0)) {
+                value.s.push_back((char) *p);
+                p += *p == 0 ? 2 : 1;  // skip the 0xFF after an escaped 0x00
+            }
+            p += 2;
+        } else {
+            value.n = *p++;
+        }
+        values.push_back(value);
+    }
+}
+
+uint KeyCodec::size(const char* bytes) const {
+    const unsigned char* p = (const unsigned char*) bytes;
+    for (auto const& data_type: this->data_types) {
+        if (data_type == ColumnAttribute::DataType::INT) {
+            p += 4;
+        } else if (data_type == ColumnAttribute::DataType::TEXT) {
+            while (!(p[0] == 0 && p[1] == 0))
+                p += *p == 0 ? 2 : 1;
+            p += 2;
+        } else {
+            p++;
+        }
+    }
+    return (uint) (p - (const unsigned char*) bytes);
+}
+
+int KeyCodec::compare(const char* a, uint a_size, const char* b, uint b_size) {
+    int cmp = std::memcmp(a, b, a_size < b_size ? a_size : b_size);
+    if (cmp != 0)
+        return cmp;
+    return a_size < b_size ? -1 : (a_size > b_size ? 1 : 0);
+}
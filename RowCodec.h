@@ -0,0 +1,202 @@
+/**
+ * @file RowCodec.h - Schema-specialized encoding and decoding of rows and index keys.
+ * RowCodec
+ * KeyCodec
+ *
+ * @author Justin Thoreson
+ * @see "Seattle University, CPSC5300, Winter 2023"
+ */
+
+#pragma once
+
+#include <string>
+#include <utility>
+#include <vector>
+#include "storage_engine.h"
+
+using DataTypes = std::vector<ColumnAttribute::DataType>;
+
+/**
+ * A predicate on an encoded row: (column number, value the column must equal)
+ */
+using ColumnPredicate = std::pair<uint, const Value*>;
+using ColumnPredicates = std::vector<ColumnPredicate>;
+
+/**
+ * An encoded search key (see KeyCodec); std::string's ordering is the keys' ordering
+ */
+using KeyBytes = std::string;
+
+/**
+ * @class RowCodec - encodes/decodes rows of a fixed list of column data types
+ *
+ * Built once per table (or index key profile). Fields are stored in column order:
+ *     INT:     4 bytes
+ *     BOOLEAN: 1 byte
+ *     TEXT:    2-byte length followed by that many bytes
+ * Every column up to and including the first TEXT column is at a fixed offset, which is precomputed;
+ * columns after it are found by skipping over the variable-length fields in front of them.
+ * Columns are addressed by number, so decoding a few columns never touches the others.
+ */
+class RowCodec {
+public:
+    RowCodec(const DataTypes& data_types);
+
+    RowCodec(const ColumnAttributes& column_attributes);
+
+    virtual ~RowCodec() {}
+
+    /**
+     * Number of columns in a row.
+     */
+    uint get_column_count() const { return (uint) this->data_types.size(); }
+
+    ColumnAttribute::DataType get_data_type(uint column) const { return this->data_types[column]; }
+
+    /**
+     * Number of bytes needed to encode a row.
+     * @param values  one value per column, in column order
+     * @returns       encoded size
+     * @throws        DbRelationError if the row is bigger than the biggest block
+     */
+    uint size(const std::vector<const Value*>& values) const;
+
+    uint size(const std::vector<Value>& values) const;
+
+    /**
+     * Encode a row into the given memory (which must have room for size(values) bytes).
+     * @param values  one value per column, in column order
+     * @param bytes   where to put the encoded row
+     * @returns       number of bytes written
+     */
+    uint encode(const std::vector<const Value*>& values, char* bytes) const;
+
+    uint encode(const std::vector<Value>& values, char* bytes) const;
+
+    /**
+     * Find where a column's field starts within an encoded row.
+     * @param bytes   encoded row
+     * @param column  column number
+     * @returns       offset of the field from bytes
+     */
+    uint offset(const char* bytes, uint column) const;
+
+    /**
+     * Decode a single column.
+     * @param bytes   encoded row
+     * @param column  column number
+     * @returns       the column's value
+     */
+    Value decode(const char* bytes, uint column) const;
+
+    /**
+     * Decode some of the columns in one pass over the row.
+     * @param bytes    encoded row
+     * @param columns  column numbers to decode (any order)
+     * @param values   returned by reference: values[i] is the value of columns[i]
+     */
+    void decode(const char* bytes, const std::vector<uint>& columns, std::vector<Value>& values) const;
+
+    /**
+     * Decode every column.
+     * @param bytes   encoded row
+     * @param values  returned by reference: one value per column, in column order
+     */
+    void decode(const char* bytes, std::vector<Value>& values) const;
+
+    /**
+     * Check predicates against an encoded row without decoding anything. Predicates must be ordered by
+     * column number; a value of another data type than its column never matches (as in Value::operator==).
+     * @param bytes       encoded row
+     * @param predicates  (column number, value) pairs ordered by column number
+     * @returns           true if every predicate is met
+     */
+    bool matches(const char* bytes, const ColumnPredicates& predicates) const;
+
+protected:
+    DataTypes data_types;
+    std::vector<uint> fixed_offsets;  // offsets of the columns up to and including the first TEXT column
+
+    /**
+     * Size of the field of the given data type at bytes.
+     */
+    static uint field_size(ColumnAttribute::DataType data_type, const char* bytes);
+
+    /**
+     * Decode the field of the given data type at bytes.
+     */
+    static Value decode_field(ColumnAttribute::DataType data_type, const char* bytes);
+
+    /**
+     * Encode one field, returning the number of bytes written.
+     */
+    static uint encode_field(ColumnAttribute::DataType data_type, const Value& value, char* bytes);
+
+    /**
+     * Size one field would take when encoded.
+     */
+    static uint encoded_size(ColumnAttribute::DataType data_type, const Value& value);
+
+    void precompute();
+};
+
+
+/**
+ * @class KeyCodec - encodes search keys as byte strings that sort the same way the keys do
+ *
+ * Built once per index key profile. Comparing two encoded keys is a single memcmp, whatever the column types,
+ * so encoded keys can be used directly as map keys, sort keys and hash keys and searched in place on a page.
+ * Fields are stored in key column order:
+ *     INT:     4 bytes, big-endian with the sign bit flipped
+ *     BOOLEAN: 1 byte
+ *     TEXT:    the text with each 0x00 byte written as 0x00 0xFF, then 0x00 0x00
+ * No encoded key is a prefix of another, so keys of different lengths compare correctly too.
+ */
+class KeyCodec {
+public:
+    KeyCodec(const DataTypes& data_types);
+
+    virtual ~KeyCodec() {}
+
+    /**
+     * Number of columns in a key.
+     */
+    uint get_column_count() const { return (uint) this->data_types.size(); }
+
+    /**
+     * Whether a key's values are each of their key column's type, so that it can be encoded.
+     * @param values  one value per key column, in key column order
+     */
+    bool accepts(const std::vector<Value>& values) const;
+
+    /**
+     * Encode a key.
+     * @param values  one value per key column, in key column order
+     * @returns       the encoded key
+     * @throws        DbRelationError if a value is not of its column's type or the key is bigger than a block
+     */
+    KeyBytes encode(const std::vector<Value>& values) const;
+
+    /**
+     * Decode an encoded key.
+     * @param bytes   encoded key
+     * @param values  returned by reference: one value per key column, in key column order
+     */
+    void decode(const char* bytes, std::vector<Value>& values) const;
+
+    /**
+     * Size of an encoded key, which may have more bytes after it (e.g. another codec's key).
+     * @param bytes  encoded key
+     * @returns      number of bytes it takes
+     */
+    uint size(const char* bytes) const;
+
+    /**
+     * Compare two encoded keys (memcmp, then length).
+     * @returns  negative, zero or positive as a is less than, equal to or greater than b
+     */
+    static int compare(const char* a, uint a_size, const char* b, uint b_size);
+
+protected:
+    DataTypes data_types;
+};
@@ -3,6 +3,8 @@
  * @authors Kevin Lundeen, Justin Thoreson
  * @see "Seattle University, CPSC5300, Winter 2023"
  */
+#include <cstdint>
+#include <fstream>
 #include "SQLExec.h"
 
 using namespace std;
@@ -11,6 +13,7 @@ using namespace hsql;
 // define static data
 Tables* SQLExec::tables = nullptr;
 Indices* SQLExec::indices = nullptr;
+Statistics* SQLExec::statistics = nullptr;
 
 // make query result be printable
 ostream& operator<<(ostream& out, const QueryResult& qres) {
@@ -59,12 +62,24 @@ QueryResult::~QueryResult() {
 }
 
 QueryResult* SQLExec::execute(const SQLStatement* statement) {
+    return execute(statement, ColumnNames());
+}
+
+QueryResult* SQLExec::execute(const SQLStatement* statement, const ColumnNames& include_columns) {
     if (!SQLExec::tables)
         SQLExec::tables = new Tables();
     if (!SQLExec::indices)
         SQLExec::indices = new Indices();
+    if (!SQLExec::statistics)
+        SQLExec::statistics = new Statistics();
 
     try {
+        if (!include_columns.empty()) {
+            if (statement->type() != kStmtCreate ||
+                ((const CreateStatement*) statement)->type != CreateStatement::kIndex)
+                throw SQLExecError("only CREATE INDEX can include columns");
+            return create_index((const CreateStatement*) statement, include_columns);
+        }
         switch (statement->type()) {
             case kStmtCreate:
                 return create((const CreateStatement*) statement);
@@ -74,8 +89,12 @@ QueryResult* SQLExec::execute(const SQLStatement* statement) {
                 return show((const ShowStatement*) statement);
             case kStmtInsert:
                 return insert((const InsertStatement*) statement);
+            case kStmtImport:
+                return import((const ImportStatement*) statement);
             case kStmtDelete:
                 return del((const DeleteStatement*) statement);
+            case kStmtUpdate:
+                return update((const UpdateStatement*) statement);
             case kStmtSelect:
                 return select((const SelectStatement*) statement);
             default:
@@ -86,6 +105,110 @@ QueryResult* SQLExec::execute(const SQLStatement* statement) {
     }
 }
 
+QueryResult* SQLExec::execute(const SQLStatement* statement, uint page_size) {
+    if (!SQLExec::tables)
+        SQLExec::tables = new Tables();
+    if (!SQLExec::indices)
+        SQLExec::indices = new Indices();
+    if (!SQLExec::statistics)
+        SQLExec::statistics = new Statistics();
+
+    try {
+        if (statement->type() != kStmtCreate || ((const CreateStatement*) statement)->type != CreateStatement::kTable)
+            throw SQLExecError("only CREATE TABLE can set a page size");
+        return create_table((const CreateStatement*) statement, page_size);
+    } catch (DbRelationError& e) {
+        throw SQLExecError("DbRelationError: " + string(e.what()));
+    }
+}
+
+QueryResult* SQLExec::vacuum(const Identifier& table_name) {
+    static const uint CHUNK_SIZE = 1000;  // rows moved between consistent points
+    if (!SQLExec::tables)
+        SQLExec::tables = new Tables();
+    if (!SQLExec::indices)
+        SQLExec::indices = new Indices();
+    if (!SQLExec::statistics)
+        SQLExec::statistics = new Statistics();
+
+    try {
+        // check table exists
+        ValueDict where = {{"table_name", Value(table_name)}};
+        Handles* tabMeta = SQLExec::tables->select(&where);
+        bool tableExists = !tabMeta->empty();
+        delete tabMeta;
+        if (!tableExists)
+            throw SQLExecError("attempting to vacuum non-existent table " + table_name);
+        DbRelation& table = SQLExec::tables->get_table(table_name);
+        IndexNames indices = SQLExec::indices->get_index_names(table_name);
+
+        size_t rows_n = 0;
+        uint blocks_n = 0;
+        while (true) {
+            Handles* handles = table.vacuum_rows(CHUNK_SIZE);
+            if (handles->empty()) {
+                delete handles;
+                break;
+            }
+            Handles* moved = nullptr;
+            try {
+                for (const Identifier& index : indices) {
+                    DbIndex& idx = SQLExec::indices->get_index(table_name, index);
+                    for (const Handle& handle : *handles)
+                        idx.del(handle);
+                }
+                moved = table.vacuum_move(handles);
+                for (const Identifier& index : indices)
+                    SQLExec::indices->get_index(table_name, index).insert_batch(moved);
+            } catch (...) {
+                delete handles;
+                delete moved;
+                throw;
+            }
+            for (size_t i = 0; i < handles->size(); i++)
+                if ((*moved)[i] != (*handles)[i])
+                    rows_n++;
+            delete handles;
+            delete moved;
+            blocks_n += table.vacuum_truncate();
+        }
+        blocks_n += table.vacuum_truncate();
+
+        string suffix = indices.size() ? " and fixed up " + to_string(indices.size()) + " indices" : "";
+        return new QueryResult("vacuumed " + table_name + ": moved " + to_string(rows_n) + " rows, released " +
+                               to_string(blocks_n) + " blocks" + suffix);
+    } catch (DbRelationError& e) {
+        throw SQLExecError("DbRelationError: " + string(e.what()));
+    }
+}
+
+QueryResult* SQLExec::analyze(const Identifier& table_name) {
+    if (!SQLExec::tables)
+        SQLExec::tables = new Tables();
+    if (!SQLExec::statistics)
+        SQLExec::statistics = new Statistics();
+
+    try {
+        // check table exists
+        ValueDict where = {{"table_name", Value(table_name)}};
+        Handles* tabMeta = SQLExec::tables->select(&where);
+        bool tableExists = !tabMeta->empty();
+        delete tabMeta;
+        if (!tableExists)
+            throw SQLExecError("attempting to analyze non-existent table " + table_name);
+        DbRelation& table = SQLExec::tables->get_table(table_name);
+
+        u_long sampled, row_count, changed_rows;
+        uint page_count;
+        SQLExec::statistics->analyze(table_name, table, sampled);
+        SQLExec::statistics->get_table(table_name, row_count, page_count, changed_rows);
+        return new QueryResult("analyzed " + table_name + ": about " + to_string(row_count) + " rows in " +
+                               to_string(page_count) + " blocks, from a sample of " + to_string(sampled) + " rows");
+    } catch (DbRelationError& e) {
+        throw SQLExecError("DbRelationError: " + string(e.what()));
+    }
+}
+
 QueryResult* SQLExec::insert(const InsertStatement* statement) {
     Identifier table_name = statement->tableName;
 
@@ -124,32 +247,195 @@ QueryResult* SQLExec::insert(const InsertStatement* statement) {
         DbIndex &index = SQLExec::indices->get_index(table_name, idx);
         index.insert(insertion);
     }
+    SQLExec::statistics->count_changes(table_name, 1, 1);
     string suffix = indices.size() ? " and into " + to_string(indices.size()) + " indices" : "";
     return new QueryResult("successfully inserted 1 row into " + table_name + suffix);
 }
 
-void get_where_conjunction(const Expr* where, ValueDict* conjunction) {
+/**
+ * Read one record of a CSV file. Fields are separated by commas; a field in double quotes may hold commas, line
+ * breaks and doubled double quotes.
+ * @param in      the file
+ * @param fields  returns the record's fields
+ * @returns       false at the end of the file
+ */
+bool read_csv_record(istream& in, vector<string>& fields) {
+    fields.clear();
+    int c = in.get();
+    if (c == EOF)
+        return false;
+    string field;
+    bool quoted = false;
+    for (; c != EOF; c = in.get()) {
+        if (quoted) {
+            if (c != '"')
+                field += (char) c;
+            else if (in.peek() == '"')
+                field += (char) in.get();
+            else
+                quoted = false;
+        } else if (c == '"') {
+            quoted = true;
+        } else if (c == ',') {
+            fields.push_back(field);
+            field.clear();
+        } else if (c == '\n') {
+            break;
+        } else if (c != '\r') {
+            field += (char) c;
+        }
+    }
+    fields.push_back(field);
+    return true;
+}
+
+/**
+ * Convert a CSV field to a value of a column's type.
+ * @param field      the text of the field
+ * @param attribute  the column's attributes
+ * @returns          the value
+ */
+Value csv_value(const string& field, ColumnAttribute attribute) {
+    switch (attribute.get_data_type()) {
+        case ColumnAttribute::INT:
+            try {
+                size_t end;
+                long n = stol(field, &end);
+                if (end != field.size() || n < INT32_MIN || n > INT32_MAX)
+                    throw invalid_argument(field);
+                return Value((int32_t) n);
+            } catch (logic_error& e) {
+                throw SQLExecError("not an INT: " + field);
+            }
+        case ColumnAttribute::TEXT:
+            return Value(field);
+        case ColumnAttribute::BOOLEAN: {
+            Value value(field == "true" || field == "1" ? 1 : 0);
+            if (value.n == 0 && field != "false" && field != "0")
+                throw SQLExecError("not a BOOLEAN: " + field);
+            value.data_type = ColumnAttribute::BOOLEAN;
+            return value;
+        }
+        default:
+            throw SQLExecError("column attribute unrecognized");
+    }
+}
+
+QueryResult* SQLExec::import(const ImportStatement* statement) {
+    static const size_t BATCH_SIZE = 10000;  // rows read before they go into the table and indices
+    Identifier table_name = statement->tableName;
+    if (statement->type != ImportStatement::kImportCSV)
+        throw SQLExecError("only CSV files can be imported");
+
+    // check table exists
+    ValueDict where = {{"table_name", Value(table_name)}};
+    Handles* tabMeta = SQLExec::tables->select(&where);
+    bool tableExists = !tabMeta->empty();
+    delete tabMeta;
+    if (!tableExists)
+        throw SQLExecError("attempting to copy into non-existent table " + table_name);
+    DbRelation& table = SQLExec::tables->get_table(table_name);
+    const ColumnNames& cn = table.get_column_names();
+    const ColumnAttributes ca = table.get_column_attributes();
+    IndexNames indices = SQLExec::indices->get_index_names(table_name);
+
+    ifstream in(statement->filePath);
+    if (!in)
+        throw SQLExecError("cannot read file " + string(statement->filePath));
+    ValueDicts rows;
+    size_t rows_n = 0, line_n = 0;
+    try {
+        vector<string> fields;
+        bool more = true;
+        while (more) {
+            more = read_csv_record(in, fields);
+            if (more) {
+                line_n++;
+                if (fields.size() == 1 && fields[0].empty())
+                    continue;  // blank line
+                if (fields.size() != cn.size())
+                    throw SQLExecError("line " + to_string(line_n) + " has " + to_string(fields.size()) +
+                                       " fields, but " + table_name + " has " + to_string(cn.size()) + " columns");
+                ValueDict* row = new ValueDict();
+                rows.push_back(row);
+                for (size_t i = 0; i < cn.size(); i++)
+                    (*row)[cn[i]] = csv_value(fields[i], ca[i]);
+            }
+            if (rows.size() == BATCH_SIZE || (!more && !rows.empty())) {
+                Handles* handles = table.insert_batch(&rows);
+                try {
+                    for (const Identifier& index : indices)
+                        SQLExec::indices->get_index(table_name, index).insert_batch(handles);
+                } catch (...) {
+                    delete handles;
+                    throw;
+                }
+                rows_n += handles->size();
+                delete handles;
+                for (ValueDict* row : rows)
+                    delete row;
+                rows.clear();
+            }
+        }
+    } catch (...) {
+        for (ValueDict* row : rows)
+            delete row;
+        SQLExec::statistics->count_changes(table_name, (long) rows_n, rows_n);
+        throw;
+    }
+    SQLExec::statistics->count_changes(table_name, (long) rows_n, rows_n);
+
+    string suffix = indices.size() ? " and into " + to_string(indices.size()) + " indices" : "";
+    return new QueryResult("successfully copied " + to_string(rows_n) + " rows into " + table_name + suffix);
+}
+
+void get_where_conjunction(const Expr* where, ValueDict* conjunction, ValueRanges* ranges) {
     if (where->opType == Expr::OperatorType::AND) {
-        get_where_conjunction(where->expr, conjunction);
-        get_where_conjunction(where->expr2, conjunction);
-    } else if (where->opType == Expr::OperatorType::SIMPLE_OP && where->opChar == '=') {
+        get_where_conjunction(where->expr, conjunction, ranges);
+        get_where_conjunction(where->expr2, conjunction, ranges);
+    } else if ((where->opType == Expr::OperatorType::SIMPLE_OP &&
+                (where->opChar == '=' || where->opChar == '<' || where->opChar == '>')) ||
+               where->opType == Expr::OperatorType::LESS_EQ || where->opType == Expr::OperatorType::GREATER_EQ) {
+        Value value;
         switch (where->expr2->type) {
             case kExprLiteralInt:
-                (*conjunction)[where->expr->name] = Value(where->expr2->ival);
+                value = Value(where->expr2->ival);
                 break;
             case kExprLiteralString:
-                (*conjunction)[where->expr->name] = Value(where->expr2->name);
+                value = Value(where->expr2->name);
                 break;
             default:
                 throw SQLExecError("unrecognized expression");
         }
+        Identifier column = where->expr->name;
+        if (where->opType == Expr::OperatorType::LESS_EQ)
+            (*ranges)[column].restrict_max(value, true);
+        else if (where->opType == Expr::OperatorType::GREATER_EQ)
+            (*ranges)[column].restrict_min(value, true);
+        else if (where->opChar == '<')
+            (*ranges)[column].restrict_max(value, false);
+        else if (where->opChar == '>')
+            (*ranges)[column].restrict_min(value, false);
+        else
+            (*conjunction)[column] = value;
     }
 }
 
-ValueDict* get_where_conjunction(const Expr* where) {
+EvalPlan* get_where_selection(const Expr* where, EvalPlan* relation) {
     ValueDict* conjunction = new ValueDict();
-    get_where_conjunction(where, conjunction);
-    return conjunction;
+    ValueRanges* ranges = new ValueRanges();
+    try {
+        get_where_conjunction(where, conjunction, ranges);
+    } catch (...) {
+        delete conjunction;
+        delete ranges;
+        throw;
+    }
+    if (ranges->empty()) {
+        delete ranges;
+        ranges = nullptr;
+    }
+    return new EvalSelect(conjunction, relation, ranges);
 }
 
 
@@ -166,13 +452,20 @@ QueryResult* SQLExec::del(const DeleteStatement* statement) {
     DbRelation& table = SQLExec::tables->get_table(table_name);
     
     // evaluation plan
-    EvalPlan* plan = new EvalPlan(table);
+    EvalPlan* plan = new EvalTableScan(table);
     if (statement->expr)
-        plan = new EvalPlan(get_where_conjunction(statement->expr), plan);
-    plan = plan->optimize();
-
-    // get handles to remove tuples from table and indices
-    Handles* handles = plan->pipeline().second;
+        plan = get_where_selection(statement->expr, plan);
+    EvalPlan* optimized = plan->optimize(SQLExec::indices, SQLExec::statistics);
+    delete plan;
+    plan = optimized;
+
+    // get handles to remove tuples from table and indices (all of them before deleting any)
+    Handles* handles = new Handles();
+    Handle selected;
+    plan->open();
+    while (plan->next_handle(selected))
+        handles->push_back(selected);
+    plan->close();
     IndexNames indices = SQLExec::indices->get_index_names(table_name);
     for (const Handle& handle : *handles) {
         for (const Identifier& index : indices)
@@ -182,13 +475,136 @@ QueryResult* SQLExec::del(const DeleteStatement* statement) {
 
     size_t rows_n = handles->size();
     size_t indices_n = indices.size();
+    SQLExec::statistics->count_changes(table_name, -(long) rows_n, rows_n);
     string suffix = indices_n ? " and from " + to_string(indices_n) + " indices" : "";
     delete plan;
     delete handles;
     return new QueryResult("successfully deleted " + to_string(rows_n) + " rows" + suffix);
 }
 
-QueryResult* SQLExec::select(const SelectStatement* statement) {
+QueryResult* SQLExec::update(const UpdateStatement* statement) {
+    Identifier table_name = statement->table->name;
+
+    // check table exists
+    ValueDict where = {{"table_name", Value(table_name)}};
+    Handles* tabMeta = SQLExec::tables->select(&where);
+    bool tableExists = !tabMeta->empty();
+    delete tabMeta;
+    if (!tableExists)
+        throw SQLExecError("attempting to update non-existent table " + table_name);
+    DbRelation& table = SQLExec::tables->get_table(table_name);
+
+    // new values
+    ValueDict new_values;
+    const ColumnNames& cn = table.get_column_names();
+    for (UpdateClause* clause : *statement->updates) {
+        Identifier column = clause->column;
+        auto position = find(cn.begin(), cn.end(), column);
+        if (position == cn.end())
+            throw SQLExecError("no such column " + column + " in table " + table_name);
+        switch (clause->value->type) {
+            case kExprLiteralInt:
+                new_values[column] = Value(clause->value->ival);
+                break;
+            case kExprLiteralString:
+                new_values[column] = Value(clause->value->name);
+                break;
+            default:
+                throw SQLExecError("column attribute unrecognized");
+        }
+        ColumnAttribute attribute = table.get_column_attributes()[position - cn.begin()];
+        if (new_values[column].data_type != attribute.get_data_type())
+            throw SQLExecError("new value for column " + column + " is not of its type");
+    }
+
+    // rows keep their handles, so only the indices holding a changed column need their entries redone
+    vector<DbIndex*> changed;
+    for (const Identifier& index_name : SQLExec::indices->get_index_names(table_name)) {
+        DbIndex& index = SQLExec::indices->get_index(table_name, index_name);
+        const ColumnNames& key_columns = index.get_key_columns();
+        for (auto const& new_value : new_values)
+            if (find(key_columns.begin(), key_columns.end(), new_value.first) != key_columns.end() ||
+                index.covers(ColumnNames(1, new_value.first))) {
+                changed.push_back(&index);
+                break;
+            }
+    }
+
+    // evaluation plan
+    EvalPlan* plan = new EvalTableScan(table);
+    if (statement->where)
+        plan = get_where_selection(statement->where, plan);
+    EvalPlan* optimized = plan->optimize(SQLExec::indices, SQLExec::statistics);
+    delete plan;
+    plan = optimized;
+
+    // get handles of the rows to update (all of them before changing any)
+    Handles handles;
+    Handle selected;
+    try {
+        plan->open();
+        while (plan->next_handle(selected))
+            handles.push_back(selected);
+        plan->close();
+    } catch (...) {
+        delete plan;
+        throw;
+    }
+    delete plan;
+
+    // the old values are kept so that a failure part way (a duplicate key in a unique index) can be undone
+    ColumnNames updated_columns;
+    for (auto const& new_value : new_values)
+        updated_columns.push_back(new_value.first);
+    vector<ValueDict*> old_values;
+    size_t done = 0;  // rows updated along with all their index entries
+    size_t deleted = 0, inserted = 0;  // index entries of the row being updated, taken out and put back
+    bool row_updated = false;
+    try {
+        for (const Handle& handle : handles) {
+            deleted = inserted = 0;
+            row_updated = false;
+            old_values.push_back(table.project(handle, &updated_columns));
+            for (DbIndex* index : changed) {
+                index->del(handle);
+                deleted++;
+            }
+            table.update(handle, &new_values);
+            row_updated = true;
+            for (DbIndex* index : changed) {
+                index->insert(handle);
+                inserted++;
+            }
+            done++;
+        }
+    } catch (...) {
+        // back out in reverse order, so each step finds the rows and entries as it left them
+        for (size_t i = old_values.size(); i-- > 0;) {
+            const Handle& handle = handles[i];
+            if (i < done) {
+                deleted = inserted = changed.size();
+                row_updated = true;
+            }
+            for (size_t k = inserted; k-- > 0;)
+                changed[k]->del(handle);
+            if (row_updated)
+                table.update(handle, old_values[i]);
+            for (size_t k = deleted; k-- > 0;)
+                changed[k]->insert(handle);
+        }
+        for (ValueDict* row : old_values)
+            delete row;
+        throw;
+    }
+    for (ValueDict* row : old_values)
+        delete row;
+    SQLExec::statistics->count_changes(table_name, 0, handles.size());
+
+    string suffix = changed.size() ? " and " + to_string(changed.size()) + " indices" : "";
+    return new QueryResult("successfully updated " + to_string(handles.size()) + " rows" + suffix);
+}
+
+EvalPlan* SQLExec::select_plan(const SelectStatement* statement, ColumnNames* column_names) {
     Identifier table_name = statement->fromTable->getName();
 
     // check table exists
@@ -199,32 +615,66 @@ QueryResult* SQLExec::select(const SelectStatement* statement) {
     if (!tableExists)
         throw SQLExecError("attempting to select from non-existent table " + table_name);
     DbRelation& table = SQLExec::tables->get_table(table_name);
-    ColumnNames* cn = new ColumnNames();
     for (const Expr* expr : *statement->selectList) {
         if (expr->type == kExprStar)
             for (const Identifier& col : table.get_column_names())
-                cn->push_back(col);
+                column_names->push_back(col);
         else
-            cn->push_back(expr->name);
+            column_names->push_back(expr->name);
     }
 
     // start base of plan at a TableScan
-    EvalPlan* plan = new EvalPlan(table);
+    EvalPlan* plan = new EvalTableScan(table);
 
     // enclose in selection if where clause exists
     if (statement->whereClause)
-        plan = new EvalPlan(get_where_conjunction(statement->whereClause), plan);
+        plan = get_where_selection(statement->whereClause, plan);
     
     // wrap in project
-    plan = new EvalPlan(cn, plan);
+    plan = new EvalProject(*column_names, plan);
 
-    // optimize and evaluate
-    plan = plan->optimize();
+    // optimize
+    EvalPlan* optimized = plan->optimize(SQLExec::indices, SQLExec::statistics);
+    delete plan;
+    return optimized;
+}
+
+QueryResult* SQLExec::select(const SelectStatement* statement) {
+    ColumnNames* cn = new ColumnNames();
+    EvalPlan* plan;
+    try {
+        plan = select_plan(statement, cn);
+    } catch (...) {
+        delete cn;
+        throw;
+    }
+    DbRelation& table = plan->get_relation();
     ValueDicts* rows = plan->evaluate();
     delete plan;
     return new QueryResult(cn, table.get_column_attributes(*cn), rows, "successfully return " + to_string(rows->size()) + " rows");
 }
 
+QueryResult* SQLExec::explain(const SQLStatement* statement) {
+    if (!SQLExec::tables)
+        SQLExec::tables = new Tables();
+    if (!SQLExec::indices)
+        SQLExec::indices = new Indices();
+    if (!SQLExec::statistics)
+        SQLExec::statistics = new Statistics();
+
+    try {
+        if (statement->type() != kStmtSelect)
+            throw SQLExecError("only SELECT can be explained");
+        ColumnNames column_names;
+        EvalPlan* plan = select_plan((const SelectStatement*) statement, &column_names);
+        string description = plan->explain();
+        delete plan;
+        return new QueryResult(description);
+    } catch (DbRelationError& e) {
+        throw SQLExecError("DbRelationError: " + string(e.what()));
+    }
+}
+
 void SQLExec::column_definition(const ColumnDefinition* col, Identifier& column_name, ColumnAttribute& column_attribute) {
     column_name = col->name;
     switch (col->type) {
@@ -250,7 +700,10 @@ QueryResult* SQLExec::create(const CreateStatement* statement) {
     }
 }
 
-QueryResult* SQLExec::create_table(const CreateStatement* statement) {
+QueryResult* SQLExec::create_table(const CreateStatement* statement, uint page_size) {
+    if (statement->ifNotExists && page_size != DbBlock::BLOCK_SZ)
+        throw SQLExecError("a page size cannot be given with IF NOT EXISTS");
+
     // update _tables schema
     ValueDict row = {{"table_name", Value(statement->tableName)}};
     Handle tableHandle = SQLExec::tables->insert(&row);
@@ -259,6 +712,7 @@ QueryResult* SQLExec::create_table(const CreateStatement* statement) {
         Handles columnHandles;
         DbRelation& columns = SQLExec::tables->get_table(Columns::TABLE_NAME);
         try {
+            int ordinal_position = 0;
             for (ColumnDefinition* column : *statement->columns) {
                 Identifier cn;
                 ColumnAttribute ca;
@@ -267,7 +721,8 @@ QueryResult* SQLExec::create_table(const CreateStatement* statement) {
                 ValueDict row = {
                     {"table_name", Value(statement->tableName)},
                     {"column_name", Value(cn)},
-                    {"data_type", Value(type)}
+                    {"data_type", Value(type)},
+                    {"ordinal_position", Value(++ordinal_position)}
                 };
                 columnHandles.push_back(columns.insert(&row));
             }
@@ -277,7 +732,7 @@ QueryResult* SQLExec::create_table(const CreateStatement* statement) {
             if (statement->ifNotExists)
                 table.create_if_not_exists();
             else
-                table.create();
+                table.create(page_size);
         } catch (...) {
             // attempt to undo the insertions into _columns
             try {
@@ -297,7 +752,7 @@ QueryResult* SQLExec::create_table(const CreateStatement* statement) {
     return new QueryResult("created table " + string(statement->tableName));
 }
 
-QueryResult* SQLExec::create_index(const CreateStatement* statement) {
+QueryResult* SQLExec::create_index(const CreateStatement* statement, const ColumnNames& include_columns) {
     DbRelation& table = SQLExec::tables->get_table(statement->tableName);
 
     // check that all the index columns exist in the table
@@ -305,6 +760,21 @@ QueryResult* SQLExec::create_index(const CreateStatement* statement) {
     for (char* column_name : *statement->indexColumns)
         if (find(cn.begin(), cn.end(), string(column_name)) == cn.end())
             throw SQLExecError("no such column " + string(column_name) + " in table " + statement->tableName);
+    for (const Identifier& column_name : include_columns) {
+        if (find(cn.begin(), cn.end(), column_name) == cn.end())
+            throw SQLExecError("no such column " + column_name + " in table " + statement->tableName);
+        for (char* key_column : *statement->indexColumns)
+            if (column_name == key_column)
+                throw SQLExecError("column " + column_name + " is already in the index key");
+    }
+
+    // USING BTREE is a unique B-tree; USING MULTI_BTREE is a B-tree that allows duplicate keys
+    string index_type = statement->indexType;
+    bool is_unique = index_type == "BTREE";
+    if (index_type == "MULTI_BTREE")
+        index_type = "BTREE";
+    if (!include_columns.empty() && index_type != "BTREE")
+        throw SQLExecError("only a B-tree index can include columns");
 
     // insert a row for each column in index key into _indices
     ValueDict row = {
@@ -312,8 +782,8 @@ QueryResult* SQLExec::create_index(const CreateStatement* statement) {
         {"index_name", Value(statement->indexName)},
         {"column_name", Value("")},
         {"seq_in_index", Value()},
-        {"index_type", Value(statement->indexType)},
-        {"is_unique", Value(string(statement->indexType) == "BTREE")}
+        {"index_type", Value(index_type)},
+        {"is_unique", Value(is_unique)}
     };
     for (char* column_name : *statement->indexColumns) {
         row["column_name"] = Value(column_name);
@@ -321,6 +791,14 @@ QueryResult* SQLExec::create_index(const CreateStatement* statement) {
         SQLExec::indices->insert(&row);
     }
 
+    // and one for each included column, numbered -1, -2, ...
+    row["seq_in_index"].n = 0;
+    for (const Identifier& column_name : include_columns) {
+        row["column_name"] = Value(column_name);
+        row["seq_in_index"].n -= 1;
+        SQLExec::indices->insert(&row);
+    }
+
     // call get_index to get a reference to the new index and then invoke the create method on it
     DbIndex& index = SQLExec::indices->get_index(string(statement->tableName), string(statement->indexName));
     index.create();
@@ -345,7 +823,8 @@ QueryResult* SQLExec::drop_table(const DropStatement* statement) {
     
     // get table name
     Identifier table_name = statement->name;
-    if (table_name == Tables::TABLE_NAME || table_name == Columns::TABLE_NAME || table_name == Indices::TABLE_NAME)
+    if (table_name == Tables::TABLE_NAME || table_name == Columns::TABLE_NAME || table_name == Indices::TABLE_NAME ||
+        table_name == Statistics::TABLE_NAME)
         throw SQLExecError("Cannot drop a schema table!");
     ValueDict where = {{"table_name", Value(table_name)}};
 
@@ -357,11 +836,16 @@ QueryResult* SQLExec::drop_table(const DropStatement* statement) {
         throw SQLExecError("attempting to drop non-existent table " + table_name);
 
     // before dropping the table, drop each index on the table
+    for (Identifier& index_name : SQLExec::indices->get_index_names(table_name))
+        SQLExec::indices->get_index(table_name, index_name).drop();
     Handles* selected = SQLExec::indices->select(&where);
     for (Handle& row : *selected)
         SQLExec::indices->del(row);
     delete selected;
 
+    // remove statistics
+    SQLExec::statistics->forget(table_name);
+
     // remove columns    
     DbRelation& columns = SQLExec::tables->get_table(Columns::TABLE_NAME);
     Handles* rows = columns.select(&where);
@@ -432,7 +916,8 @@ QueryResult* SQLExec::show_tables() {
     for (Handle& table : *tables) {
         ValueDict* row = SQLExec::tables->project(table, cn);
         Identifier table_name = (*row)["table_name"].s;
-        if (table_name != Tables::TABLE_NAME && table_name != Columns::TABLE_NAME && table_name != Indices::TABLE_NAME)
+        if (table_name != Tables::TABLE_NAME && table_name != Columns::TABLE_NAME && table_name != Indices::TABLE_NAME &&
+            table_name != Statistics::TABLE_NAME)
             rows->push_back(row);
         else
             delete row;
@@ -447,9 +932,13 @@ QueryResult* SQLExec::show_columns(const ShowStatement* statement) {
     DbRelation& columns = SQLExec::tables->get_table(Columns::TABLE_NAME);
     ValueDict where = {{"table_name", Value(statement->tableName)}};
     Handles* selected = columns.select(&where);
-    ValueDicts* rows = new ValueDicts();
-    for (Handle& row : *selected)
-        rows->push_back(columns.project(row, cn));
+    ValueDicts* rows = new ValueDicts(selected->size());
+    for (Handle& handle : *selected) {
+        ValueDict* row = columns.project(handle);
+        int ordinal_position = row->at("ordinal_position").n;
+        row->erase("ordinal_position");
+        (*rows)[ordinal_position - 1] = row;  // in the table's column order
+    }
     delete selected;
     return new QueryResult(cn, ca, rows, "successfully returned " + to_string(rows->size()) + " rows");
 }
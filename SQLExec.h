@@ -65,17 +65,65 @@ public:
      */
     static QueryResult* execute(const hsql::SQLStatement* statement);
 
+    /**
+     * Execute a CREATE INDEX statement that had an INCLUDE clause (which the parser does not know). The B-tree's
+     * entries hold the values of the included columns too, so queries needing only those and the key columns
+     * can be answered from the index alone.
+     * @param statement        the Hyrise AST of the CREATE INDEX statement, without its INCLUDE clause
+     * @param include_columns  the columns of the INCLUDE clause
+     * @returns                the query result (freed by caller)
+     */
+    static QueryResult* execute(const hsql::SQLStatement* statement, const ColumnNames& include_columns);
+
+    /**
+     * Execute a CREATE TABLE statement that had a WITH (PAGE_SIZE = n) clause (which the parser does not know).
+     * The table's file, and the files of the B-tree indices later created on it, use blocks of that many bytes.
+     * @param statement  the Hyrise AST of the CREATE TABLE statement, without its WITH clause
+     * @param page_size  block size for the table, a power of 2 from DbBlock::BLOCK_SZ to DbBlock::MAX_BLOCK_SZ
+     * @returns          the query result (freed by caller)
+     */
+    static QueryResult* execute(const hsql::SQLStatement* statement, uint page_size);
+
+    /**
+     * Execute VACUUM <table_name> (which the parser does not know): move rows from the end of the table into the
+     * room deletes left nearer its start, fixing up the index entries of every row that moves, and give back the
+     * blocks that end up empty. Works a chunk of rows at a time; the table and its indices are consistent between
+     * chunks.
+     * @param table_name  the table to vacuum
+     * @returns           the query result (freed by caller)
+     */
+    static QueryResult* vacuum(const Identifier& table_name);
+
+    /**
+     * Execute ANALYZE <table_name> (which the parser does not know): sample the table's rows and keep what they
+     * show about its size and each column's values in _statistics, for the optimizer. Statements that change
+     * the table's rows keep its row count there up to date until the next ANALYZE.
+     * @param table_name  the table to analyze
+     * @returns           the query result (freed by caller)
+     */
+    static QueryResult* analyze(const Identifier& table_name);
+
+    /**
+     * Execute EXPLAIN <statement> (which the parser does not know): describe the plan the optimizer picks for a
+     * SELECT statement, with the rows and cost it estimates for each operator, without running it.
+     * @param statement  the Hyrise AST of the statement to explain
+     * @returns          the query result (freed by caller)
+     */
+    static QueryResult* explain(const hsql::SQLStatement* statement);
+
 protected:
-    // the one place in the system that holds the _tables and _indices tables
+    // the one place in the system that holds the _tables, _indices and _statistics tables
     static Tables* tables;
     static Indices* indices;
+    static Statistics* statistics;
 
     // recursive decent into the AST
     static QueryResult* create(const hsql::CreateStatement* statement);
     
-    static QueryResult* create_table(const hsql::CreateStatement* statement);
+    static QueryResult* create_table(const hsql::CreateStatement* statement, uint page_size = DbBlock::BLOCK_SZ);
     
-    static QueryResult* create_index(const hsql::CreateStatement* statement);
+    static QueryResult* create_index(const hsql::CreateStatement* statement,
+                                     const ColumnNames& include_columns = ColumnNames());
 
     static QueryResult* drop(const hsql::DropStatement* statement);
     
@@ -93,10 +141,30 @@ protected:
 
     static QueryResult* insert(const hsql::InsertStatement* statement);
 
+    /**
+     * Bulk load a table from a CSV file (COPY table FROM 'file', or IMPORT FROM CSV FILE 'file' INTO table).
+     * Each line is a row with the table's columns in order. Rows go into the table and its indices a batch at a
+     * time, through DbRelation::insert_batch and DbIndex::insert_batch. A bad line stops the load; the batches
+     * before it stay loaded.
+     * @param statement  the Hyrise AST of the IMPORT statement
+     * @returns          the query result (freed by caller)
+     */
+    static QueryResult* import(const hsql::ImportStatement* statement);
+
     static QueryResult* del(const hsql::DeleteStatement* statement);
 
+    static QueryResult* update(const hsql::UpdateStatement* statement);
+
     static QueryResult* select(const hsql::SelectStatement* statement);
 
+    /**
+     * Build the optimized plan for a SELECT statement.
+     * @param statement     the Hyrise AST of the SELECT statement
+     * @param column_names  returned by reference: the columns the statement selects
+     * @returns             the plan (freed by caller)
+     */
+    static EvalPlan* select_plan(const hsql::SelectStatement* statement, ColumnNames* column_names);
+
     /**
      * Pull out column name and attributes from AST's column definition clause
      * @param col                AST column definition
@@ -105,6 +173,15 @@ protected:
      */
     static void
     column_definition(const hsql::ColumnDefinition* col, Identifier& column_name, ColumnAttribute& column_attribute);
+
+    /**
+     * Test function in tests.h must be friend for convenience
+     */
+    friend bool test_index_select();
+
+    friend bool test_analyze();
+
+    friend bool test_optimizer();
 };
 
 /**
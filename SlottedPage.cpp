@@ -5,6 +5,7 @@
  */
 
 #include <cstring>
+#include <vector>
 #include "SlottedPage.h"
 
 using u16 = u_int16_t;
@@ -18,24 +19,42 @@ using u16 = u_int16_t;
 SlottedPage::SlottedPage(Dbt& block, BlockID block_id, bool is_new) : DbBlock(block, block_id, is_new) {
     if (is_new) {
         this->num_records = 0;
-        this->end_free = DbBlock::BLOCK_SZ - 1;
+        this->end_free = (u16) (this->get_block_size() - 1);
+        this->dead = 0;
+        this->free_slot = 0;
         this->put_header();
     } else {
         this->get_header(this->num_records, this->end_free);
+        this->dead = this->get_n(4);
+        this->free_slot = this->get_n(6);
     }
 }
 
 RecordID SlottedPage::add(const Dbt* data) {
-    if (!this->has_room(data->get_size()))
+    RecordID id;
+    char* bytes = this->allocate((u16)data->get_size(), id);
+    std::memcpy(bytes, data->get_data(), data->get_size());
+    return id;
+}
+
+char* SlottedPage::allocate(u16 size, RecordID& record_id) {
+    if (!this->has_room(size))
         throw DbBlockNoRoomError("not enough room for new record");
-    u16 id = ++this->num_records;
-    u16 size = (u16)data->get_size();
+    if (!this->has_contiguous_room(size))
+        this->compact();
+    if (this->free_slot) {
+        u16 next, loc;
+        record_id = this->free_slot;
+        this->get_header(next, loc, record_id);
+        this->free_slot = next;
+    } else {
+        record_id = ++this->num_records;
+    }
     this->end_free -= size;
     u16 loc = this->end_free + 1U;
     this->put_header();
-    this->put_header(id, size, loc);
-    std::memcpy(this->address(loc), data->get_data(), size);
-    return id;
+    this->put_header(record_id, size, loc);
+    return (char*) this->address(loc);
 }
 
 Dbt* SlottedPage::get(RecordID record_id) const {
@@ -45,45 +64,71 @@ Dbt* SlottedPage::get(RecordID record_id) const {
     return new Dbt(this->address(loc), size);
 }
 
+const char* SlottedPage::get_record(RecordID record_id, u16& size) const {
+    u16 loc;
+    this->get_header(size, loc, record_id);
+    if (!loc) return nullptr; // Tombstone
+    return (const char*) this->address(loc);
+}
+
 void SlottedPage::put(RecordID record_id, const Dbt& data) {
     u16 size, loc;
     this->get_header(size, loc, record_id);
     u16 new_size = (u16)data.get_size();
-    if (new_size > size) {
-        u16 extra = new_size - size;
-        if (!this->has_room(extra))
-            throw DbBlockNoRoomError("not enough room for enlarged record");
-        this->slide(loc, loc - extra);
-        std::memcpy(this->address(loc - extra), data.get_data(), new_size);
-    } else {
+    if (new_size <= size) {
+        // shrink in place; the bytes it no longer uses are dead
         std::memcpy(this->address(loc), data.get_data(), new_size);
-        this->slide(loc + new_size, loc + size);
+        this->dead += size - new_size;
+        this->put_header();
+        this->put_header(record_id, new_size, loc);
+        return;
     }
-    this->get_header(size, loc, record_id);
+
+    // enlarged: the record moves to the free space and its old bytes are dead
+    if (!this->has_room(new_size - size))
+        throw DbBlockNoRoomError("not enough room for enlarged record");
+    std::vector<char> copy;
+    const void* bytes = data.get_data();
+    this->put_header(record_id);  // out of the way of compact()
+    this->dead += size;
+    if (!this->has_contiguous_room(new_size)) {
+        copy.assign((const char*) bytes, (const char*) bytes + new_size);  // data may be in this block
+        bytes = copy.data();
+        this->compact();
+    }
+    this->end_free -= new_size;
+    loc = this->end_free + 1U;
+    std::memmove(this->address(loc), bytes, new_size);
+    this->put_header();
     this->put_header(record_id, new_size, loc);
 }
 
 void SlottedPage::del(RecordID record_id) {
     u16 size, loc;
     this->get_header(size, loc, record_id);
-    this->put_header(record_id);
-    this->slide(loc, loc + size);
+    if (!loc)
+        return;  // already deleted
+    this->put_header(record_id, this->free_slot);
+    this->free_slot = (u16) record_id;
+    if (loc == this->end_free + 1U)
+        this->end_free += size;  // next to the free space, so it just joins it
+    else
+        this->dead += size;
+    this->put_header();
 }
 
 RecordIDs* SlottedPage::ids(void) const {
     RecordIDs* record_ids = new RecordIDs();
-    u16 size, loc;
-    for (RecordID record_id = 1; record_id <= this->num_records; record_id++) {
-        this->get_header(size, loc, record_id);
-        if (loc) 
-            record_ids->push_back(record_id);
-    }
+    for (RecordID record_id: this->records())
+        record_ids->push_back(record_id);
     return record_ids;
 }
 
 void SlottedPage::clear() {
     this->num_records = 0;
-    this->end_free = DbBlock::BLOCK_SZ - 1;
+    this->end_free = (u16) (this->get_block_size() - 1);
+    this->dead = 0;
+    this->free_slot = 0;
     put_header();
 }
 
@@ -98,57 +143,65 @@ u16 SlottedPage::size() const {
     return count;
 }
 
+// Offset of a record's header, or of the block header for id 0.
+static u16 header_offset(RecordID id) {
+    return id == 0 ? (u16) 0 : (u16) (SlottedPage::HEADER_SIZE + 4 * (id - 1));
+}
+
 void SlottedPage::get_header(u16& size, u16& loc, RecordID id) const {
-    size = this->get_n((u16) 4 * id);
-    loc = this->get_n((u16) (4 * id + 2));
+    size = this->get_n(header_offset(id));
+    loc = this->get_n((u16) (header_offset(id) + 2));
 }
 
 void SlottedPage::put_header(RecordID id, u16 size, u16 loc) {
     if (id == 0) { // called the put_header() version and using the default params
         size = this->num_records;
         loc = this->end_free;
+        this->put_n(4, this->dead);
+        this->put_n(6, this->free_slot);
     }
-    this->put_n((u16) 4 * id, size);
-    this->put_n((u16) (4 * id + 2), loc);
+    this->put_n(header_offset(id), size);
+    this->put_n((u16) (header_offset(id) + 2), loc);
 }
 
 bool SlottedPage::has_room(u16 size) const {
-    return size + (u16)4 <= this->unused_bytes();
+    return size + (this->free_slot ? 0U : 4U) <= this->unused_bytes();
+}
+
+bool SlottedPage::has_contiguous_room(u16 size) const {
+    return size + (this->free_slot ? 0U : 4U) + this->dead <= this->unused_bytes();
 }
 
 u16 SlottedPage::unused_bytes() const {
-    u16 headers = (u16) (4 * (this->num_records + 1));
+    u16 headers = (u16) (HEADER_SIZE + 4 * this->num_records);
     u16 unused;
     if (this->end_free <= headers)
         unused = 0;
     else
         unused = this->end_free - headers;
-    return unused;
+    return unused + this->dead;
 }
 
-void SlottedPage::slide(u_int16_t start, u_int16_t end) {
-    int shift = end - start;
-    if (shift == 0)
+void SlottedPage::compact() {
+    if (this->dead == 0)
         return;
 
-    // slide data
-    void* to = this->address((u16) (this->end_free + 1 + shift));
-    void* from = this->address((u16) (this->end_free + 1));
-    int bytes = start - (this->end_free + 1U);
-    std::memmove(to, from, bytes);
-
-    // fix up headers to the right
-    RecordIDs *record_ids = ids();
-    for (RecordID& record_id : *record_ids) {
+    // pack the live records' data at the end of a copy, then copy it back over the data area
+    std::vector<char> packed(this->get_block_size() - 1U - this->end_free - this->dead);
+    u16 end = (u16) (this->get_block_size() - 1U - packed.size());
+    u16 at = (u16) packed.size();
+    for (RecordID record_id = 1; record_id <= this->num_records; record_id++) {
         u16 size, loc;
         this->get_header(size, loc, record_id);
-        if (loc <= start) {
-            loc += shift;
-            this->put_header(record_id, size, loc);
-        }
+        if (!loc)
+            continue;
+        at -= size;
+        std::memcpy(&packed[at], this->address(loc), size);
+        this->put_header(record_id, size, (u16) (end + 1U + at));
     }
-    delete record_ids;
-    this->end_free += shift;
+    std::memcpy(this->address((u16) (end + 1U)), packed.data(), packed.size());
+    this->end_free = end;
+    this->dead = 0;
     put_header();
 }
 
@@ -17,17 +17,78 @@
  *
  * Manage a database block that contains several records.
  * Modeled after slotted-page from Database Systems Concepts, 6ed, Figure 10-9.
+ * The block is as big as its Dbt, up to DbBlock::MAX_BLOCK_SZ, so 16 bits are enough for sizes and offsets.
  *
- * Record id are handed out sequentially starting with 1 as records are added with add().
+ * Record id are handed out sequentially starting with 1 as records are added with add(), except that the id of
+ * a deleted record is handed out again before a new one is, so pages with a lot of turnover do not fill up with
+ * record headers. A deleted record's header is a tombstone (offset 0) whose size field links it to the next free
+ * record id, or 0 at the end of the list. An id names only one record at a time, but once the record is deleted
+ * its id may name a later one, so whatever refers to a record must forget it when it is deleted (as indices do).
  * Each record has a header which is a fixed offset from the beginning of the block:
- *     Bytes 0x00 - Ox01: number of records
+ *     Bytes 0x00 - Ox01: number of records (including deleted ones)
  *     Bytes 0x02 - 0x03: offset to end of free space
- *     Bytes 0x04 - 0x05: size of record 1
- *     Bytes 0x06 - 0x07: offset to record 1
+ *     Bytes 0x04 - 0x05: number of dead bytes
+ *     Bytes 0x06 - 0x07: first free (deleted) record id, or 0
+ *     Bytes 0x08 - 0x09: size of record 1
+ *     Bytes 0x0A - 0x0B: offset to record 1
  *     etc.
+ *
+ * Deleting or shrinking a record leaves its bytes where they are and only counts them as dead. The records
+ * are slid together over the dead bytes all at once (compacted), the next time add() or put() needs more
+ * contiguous free space than there is, so deleting many records from a page does not move the rest each time.
  */
 class SlottedPage : public DbBlock {
 public:
+    static const u_int16_t HEADER_SIZE = 8;  // bytes before the first record header
+
+    /**
+     * @class Records - the live (undeleted) record ids of a page, for range-based for loops
+     * without building a RecordIDs list
+     */
+    class Records {
+    public:
+        class iterator {
+        public:
+            iterator() : page(nullptr), record_id(0) {}
+
+            iterator(const SlottedPage* page, RecordID record_id) : page(page), record_id(record_id) {
+                skip_deleted();
+            }
+
+            RecordID operator*() const { return record_id; }
+
+            iterator& operator++() {
+                record_id++;
+                skip_deleted();
+                return *this;
+            }
+
+            bool operator!=(const iterator& other) const { return record_id != other.record_id; }
+
+        protected:
+            const SlottedPage* page;
+            RecordID record_id;
+
+            void skip_deleted() {
+                u_int16_t size, loc;
+                for (; record_id <= page->num_records; record_id++) {
+                    page->get_header(size, loc, record_id);
+                    if (loc)
+                        break;
+                }
+            }
+        };
+
+        Records(const SlottedPage* page) : page(page) {}
+
+        iterator begin() const { return iterator(page, 1); }
+
+        iterator end() const { return iterator(page, page->num_records + 1U); }
+
+    protected:
+        const SlottedPage* page;
+    };
+
     SlottedPage(Dbt& block, BlockID block_id, bool is_new = false);
 
      // Big 5 - use the defaults
@@ -40,6 +101,14 @@ public:
      */
     virtual RecordID add(const Dbt* data);
 
+    /**
+     * Adds a new record of the given size to a slotted page without filling it in
+     * @param size The size of the new record
+     * @param record_id Returned by reference: the record ID of the new record
+     * @return Address within the block where the caller writes the record's bytes
+     */
+    virtual char* allocate(u_int16_t size, RecordID& record_id);
+
     /**
      * Retrieves a record from a slotted page
      * @param record_id The ID of the record to retrieve
@@ -47,6 +116,14 @@ public:
      */
     virtual Dbt* get(RecordID record_id) const;
 
+    /**
+     * Looks at a record's bytes in place (no copy, nothing to free)
+     * @param record_id The ID of the record to look at
+     * @param size Returned by reference: the size of the record
+     * @return Address of the record within the block, or nullptr if it was deleted
+     */
+    virtual const char* get_record(RecordID record_id, u_int16_t& size) const;
+
     /**
      * Puts a new record in the place of an existing record in a slotted page
      * @param record_id The ID of the record to replace
@@ -65,6 +142,11 @@ public:
      */
     virtual RecordIDs* ids(void) const;
 
+    /**
+     * Iterate over the IDs of all records in a slotted page (the page must outlive the iteration)
+     */
+    Records records() const { return Records(this); }
+
     /**
      * Erase all the records
      */
@@ -77,7 +159,7 @@ public:
     virtual u_int16_t size() const;
 
     /**
-     * Get the number of bytes not currently used to store data or for overhead.
+     * Get the number of bytes not currently used to store data or for overhead (dead bytes included).
      * @return number of bytes
      */
     virtual u_int16_t unused_bytes() const;
@@ -85,6 +167,8 @@ public:
 protected:
     u_int16_t num_records;
     u_int16_t end_free;
+    u_int16_t dead;  // bytes of deleted or shrunken records not yet reclaimed by compact()
+    u_int16_t free_slot;  // most recently deleted record id, whose header is reused first
 
     /**
      * Retrieves the header (size and location) of the record within a slotted page
@@ -103,23 +187,25 @@ protected:
     void put_header(RecordID id = 0, u_int16_t size = 0, u_int16_t loc = 0);
 
     /**
-     * Checks the slotted page if there is enough free memory to add a new record
+     * Checks the slotted page if there is enough free memory to add a new record (a new record header too,
+     * unless there is a free one)
      * @param size The size of the new record
      * @return True if the record can fit into the slotted page, false otherwise
      */
     bool has_room(u_int16_t size) const;
 
     /**
-     * If start < end, then remove data from offset start up to but not including
-     * offset end by sliding data that is to the left of start to the right. If
-     * start > end, then make room for extra data from end to start by sliding data
-     * that is to the left of start to the left. Also fix up any record headers
-     * whose data has slid. Assumes there is enough room if it is a left shift 
-     * (end < start).
-     * @param start The begining of section of memory in a slotted page
-     * @param end The end of section of memory in a slotted page
+     * Checks whether a new record's bytes fit between the headers and the data without compacting
+     * @param size The size of the new record's bytes
+     * @return True if they fit
+     */
+    bool has_contiguous_room(u_int16_t size) const;
+
+    /**
+     * Slide all the live records' data to the end of the block, so the dead bytes become part of
+     * the free space, and fix up their record headers.
      */
-    virtual void slide(u_int16_t start, u_int16_t end);
+    virtual void compact();
 
     /** 
      * Get 2-byte integer at given offset in block.
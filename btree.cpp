@@ -3,39 +3,430 @@
  * @author Kevin Lundeen, Justin Thoreson
  * @see "Seattle University, CPSC5300, Winter 2023"
  */
+#include <algorithm>
+#include <cstring>
+#include <functional>
+#include <queue>
 #include "btree.h"
 
-BTreeIndex::BTreeIndex(DbRelation& relation, Identifier name, ColumnNames key_columns, bool unique) 
+using KeyEntry = std::pair<KeyBytes, Handle>;
+using KeyEntries = std::vector<KeyEntry>;
+
+/**
+ * @class BTreeSortRun - sorted (key, handle) entries spilled to a scratch heap file while bulk loading
+ */
+class BTreeSortRun {
+public:
+    explicit BTreeSortRun(const std::string &name)
+        : file(name), page(nullptr), block_id(0), record_id(0) {
+        this->file.create();
+    }
+
+    virtual ~BTreeSortRun() {
+        delete this->page;
+        this->file.drop();
+    }
+
+    BTreeSortRun(const BTreeSortRun &other) = delete;
+
+    BTreeSortRun &operator=(const BTreeSortRun &other) = delete;
+
+    // Write the entries, each as its handle followed by its key bytes.
+    void write(const KeyEntries &entries) {
+        SlottedPage *block = this->file.get(this->file.get_last_block_id());
+        try {
+            for (auto const &entry: entries) {
+                u_int16_t size = (u_int16_t) (sizeof(BlockID) + sizeof(RecordID) + entry.first.size());
+                RecordID id;
+                char *bytes;
+                try {
+                    bytes = block->allocate(size, id);
+                } catch (DbBlockNoRoomError &e) {
+                    this->file.put(block);
+                    delete block;
+                    block = nullptr;
+                    block = this->file.get_new();
+                    bytes = block->allocate(size, id);
+                }
+                *(BlockID *) bytes = entry.second.first;
+                *(RecordID *) (bytes + sizeof(BlockID)) = entry.second.second;
+                std::memcpy(bytes + sizeof(BlockID) + sizeof(RecordID), entry.first.data(), entry.first.size());
+            }
+        } catch (...) {
+            delete block;
+            throw;
+        }
+        this->file.put(block);
+        delete block;
+    }
+
+    // Read the entries back in the order they were written, holding one block at a time.
+    bool next(KeyEntry &entry) {
+        while (this->page == nullptr || this->record_id >= this->page->size()) {
+            delete this->page;  // releases its pinned block
+            this->page = nullptr;
+            if (this->block_id >= this->file.get_last_block_id())
+                return false;
+            this->page = this->file.get(++this->block_id);
+            this->record_id = 0;
+        }
+        u_int16_t size;
+        const char *bytes = this->page->get_record(++this->record_id, size);
+        entry.second = Handle(*(BlockID *) bytes, *(RecordID *) (bytes + sizeof(BlockID)));
+        entry.first.assign(bytes + sizeof(BlockID) + sizeof(RecordID), size - sizeof(BlockID) - sizeof(RecordID));
+        return true;
+    }
+
+protected:
+    HeapFile file;
+    SlottedPage *page;
+    BlockID block_id;
+    RecordID record_id;
+};
+
+/**
+ * @class BTreeSorter - puts (key, handle) entries in key order: in memory if they fit in one run, otherwise by
+ * spilling sorted runs to scratch files and merging them
+ */
+class BTreeSorter {
+public:
+    BTreeSorter(const std::string &name, uint run_size)
+        : name(name), run_size(run_size), entries(), runs(), heads(), i(0) {
+    }
+
+    virtual ~BTreeSorter() {
+        for (auto run: this->runs)
+            delete run;
+    }
+
+    BTreeSorter(const BTreeSorter &other) = delete;
+
+    BTreeSorter &operator=(const BTreeSorter &other) = delete;
+
+    void add(const KeyBytes &key, Handle handle) {
+        this->entries.push_back(KeyEntry(key, handle));
+        if (this->entries.size() >= this->run_size)
+            this->spill();
+    }
+
+    // Done adding; get ready for next().
+    void sort() {
+        if (this->runs.empty()) {
+            std::sort(this->entries.begin(), this->entries.end());
+        } else {
+            if (!this->entries.empty())
+                this->spill();
+            for (uint r = 0; r < this->runs.size(); r++) {
+                KeyEntry entry;
+                if (this->runs[r]->next(entry))
+                    this->heads.push(Head(entry, r));
+            }
+        }
+        this->i = 0;
+    }
+
+    bool next(KeyEntry &entry) {
+        if (this->runs.empty()) {
+            if (this->i >= this->entries.size())
+                return false;
+            entry = std::move(this->entries[this->i++]);
+            return true;
+        }
+        if (this->heads.empty())
+            return false;
+        Head head = this->heads.top();
+        this->heads.pop();
+        entry = head.first;
+        KeyEntry following;
+        if (this->runs[head.second]->next(following))
+            this->heads.push(Head(following, head.second));
+        return true;
+    }
+
+protected:
+    using Head = std::pair<KeyEntry, uint>;  // smallest entry not yet handed out from a run, and which run
+
+    std::string name;
+    size_t run_size;
+    KeyEntries entries;
+    std::vector<BTreeSortRun *> runs;
+    std::priority_queue<Head, std::vector<Head>, std::greater<Head>> heads;
+    size_t i;
+
+    void spill() {
+        std::sort(this->entries.begin(), this->entries.end());
+        auto *run = new BTreeSortRun(this->name + "-sort" + std::to_string(this->runs.size()));
+        this->runs.push_back(run);  // so it is dropped even if the write fails
+        run->write(this->entries);
+        this->entries.clear();
+    }
+};
+
+/**
+ * @class BTreeRangeCursor - walks the leaf chain from the first key in range, one leaf at a time, handing out
+ * each key's handles in block order. Entry keys are compared with the bounds on the bounds' length, so the
+ * included values an entry key may have after the search key do not matter.
+ */
+class BTreeRangeCursor : public HandleCursor {
+public:
+    BTreeRangeCursor(BTreeLeaf *leaf, KeyBytes *min_key, bool min_inclusive, KeyBytes *max_key, bool max_inclusive)
+        : leaf(leaf), min_key(min_key), min_inclusive(min_inclusive), max_key(max_key),
+          max_inclusive(max_inclusive), postings(), p(0) {
+        this->i = min_key ? leaf->lower_bound(min_key) : 0;
+    }
+
+    virtual ~BTreeRangeCursor() {
+        delete leaf;
+        delete min_key;
+        delete max_key;
+    }
+
+    BTreeRangeCursor(const BTreeRangeCursor &other) = delete;
+
+    BTreeRangeCursor &operator=(const BTreeRangeCursor &other) = delete;
+
+    virtual bool next(Handle &handle) {
+        if (this->p < this->postings.size()) {
+            handle = this->postings[this->p++];
+            return true;
+        }
+        while (this->leaf != nullptr) {
+            if (this->i < this->leaf->size()) {
+                uint at = this->i++;
+                if (this->max_key || (this->min_key && !this->min_inclusive)) {
+                    KeyBytes key = this->leaf->get_key(at);
+                    int max_cmp = this->max_key ? key.compare(0, this->max_key->size(), *this->max_key) : -1;
+                    if (max_cmp > 0 || (max_cmp == 0 && !this->max_inclusive)) {
+                        this->done();
+                        return false;
+                    }
+                    if (this->min_key && !this->min_inclusive &&
+                        key.compare(0, this->min_key->size(), *this->min_key) == 0)
+                        continue;
+                }
+                this->postings.clear();
+                this->leaf->get_handles(at, this->postings);
+                this->p = 1;
+                handle = this->postings[0];
+                return true;
+            }
+            BTreeLeaf *next_leaf = this->leaf->next();
+            delete this->leaf;  // releases its pinned block
+            this->leaf = next_leaf;
+            if (this->leaf != nullptr)
+                this->i = 0;
+        }
+        return false;
+    }
+
+protected:
+    BTreeLeaf *leaf;
+    uint i;  // position of the next entry in leaf
+    KeyBytes *min_key;
+    bool min_inclusive;
+    KeyBytes *max_key;
+    bool max_inclusive;
+    Handles postings;  // handles for the last key reached
+    u_long p;  // position of the next one to hand out
+
+    void done() {
+        delete this->leaf;
+        this->leaf = nullptr;
+    }
+};
+
+double BTreeIndex::fill_factor = 0.9;
+uint BTreeIndex::sort_run_size = BTreeIndex::DEFAULT_SORT_RUN_SIZE;
+uint BTreeIndex::node_cache_size = BTreeIndex::DEFAULT_NODE_CACHE_SIZE;
+uint BTreeIndex::cached_nodes = 0;
+
+void BTreeIndex::set_fill_factor(double fill_factor) {
+    BTreeIndex::fill_factor = std::min(1.0, std::max(0.5, fill_factor));
+}
+
+void BTreeIndex::set_sort_run_size(uint sort_run_size) {
+    BTreeIndex::sort_run_size = std::max(1U, sort_run_size);
+}
+
+void BTreeIndex::set_node_cache_size(uint node_cache_size) {
+    BTreeIndex::node_cache_size = node_cache_size;
+}
+
+BTreeIndex::BTreeIndex(DbRelation& relation, Identifier name, ColumnNames key_columns, bool unique,
+                       ColumnNames include_columns)
     : DbIndex(relation, name, key_columns, unique),
       closed(true),
       stat(nullptr),
       root(nullptr),
+      node_cache(),
       file(relation.get_table_name() + "-" + name),
-      key_profile() {
-    if (!unique)
-        throw DbRelationError("BTree index must have unique key");
+      key_profile(),
+      key_codec(KeyProfile()),
+      include_columns(include_columns),
+      include_profile(),
+      include_codec(KeyProfile()) {
     build_key_profile();
+    key_codec = KeyCodec(key_profile);
+    include_codec = KeyCodec(include_profile);
 }
 
 BTreeIndex::~BTreeIndex() {
+    clear_cache();
     delete stat;
     delete root;
 }
 
 // Create the index.
 void BTreeIndex::create() {
-    file.create();
-    stat = new BTreeStat(file, STAT, STAT + 1, key_profile);
-    root = new BTreeLeaf(file, stat->get_root_id(), key_profile, true);
+    file.create(relation.get_block_size());  // bigger blocks for the table mean bigger nodes (more fanout)
+    stat = new BTreeStat(file, STAT, STAT + 1, key_codec);
+    root = new BTreeLeaf(file, stat->get_root_id(), key_codec, true);
     closed = false;
-    Handles* table_rows = relation.select();
-    for (auto const& row: *table_rows)
-        insert(row);
-    delete table_rows;
+    bulk_load();
+}
+
+void BTreeIndex::bulk_load() {
+    static const uint PROJECT_BATCH_SIZE = 256;
+    BTreeSorter sorter(relation.get_table_name() + "-" + name, sort_run_size);
+
+    // one pass over the table, reading just the key (and included) columns a batch of rows at a time
+    ColumnNames entry_columns = key_columns;
+    entry_columns.insert(entry_columns.end(), include_columns.begin(), include_columns.end());
+    HandleCursor* cursor = relation.scan();
+    try {
+        Handles batch;
+        Handle handle;
+        bool more = true;
+        while (more) {
+            more = cursor->next(handle);
+            if (more)
+                batch.push_back(handle);
+            if (batch.size() == PROJECT_BATCH_SIZE || (!more && !batch.empty())) {
+                ValueDicts* rows = relation.project(&batch, &entry_columns);
+                for (size_t i = 0; i < batch.size(); i++) {
+                    KeyBytes* key = encode_entry((*rows)[i]);
+                    sorter.add(*key, batch[i]);
+                    delete key;
+                }
+                for (auto row: *rows)
+                    delete row;
+                delete rows;
+                batch.clear();
+            }
+        }
+    } catch (...) {
+        delete cursor;
+        throw;
+    }
+    delete cursor;
+    sorter.sort();
+
+    // pack the leaves left to right, starting with the empty root leaf, noting each one's lowest key
+    uint limit = (uint) (root->capacity() * fill_factor);
+    std::vector<Insertion> level;
+    BTreeLeaf* leaf = dynamic_cast<BTreeLeaf*>(root);
+    BTreeLeaf* prev_leaf = nullptr;
+    root = nullptr;
+    level.push_back(Insertion(leaf->get_id(), KeyBytes()));
+    try {
+        KeyEntry entry;
+        KeyBytes key, search_key, prev_search_key;
+        Handles handles;
+        bool more = sorter.next(entry);
+        while (more) {
+            // gather the key's handles, which the sort has put in block order
+            key = entry.first;
+            handles.clear();
+            do {
+                handles.push_back(entry.second);
+                more = sorter.next(entry);
+            } while (more && entry.first == key);
+            bool duplicate = handles.size() > 1;
+            if (unique && !include_columns.empty()) {
+                // rows with the same search key but different included values are in neighboring entries
+                search_key = key.substr(0, key_codec.size(key.data()));
+                duplicate = duplicate || search_key == prev_search_key;
+                prev_search_key = search_key;
+            }
+            if (unique && duplicate)
+                throw DbRelationError("Duplicate keys are not allowed in unique index");
+            if (!leaf->append(&key, handles, limit)) {
+                auto* next_leaf = new BTreeLeaf(file, 0, key_codec, true);
+                leaf->set_next(next_leaf->get_id());
+                if (prev_leaf != nullptr) {
+                    prev_leaf->save();
+                    delete prev_leaf;  // releases its pinned block
+                }
+                prev_leaf = leaf;
+                leaf = next_leaf;
+                level.push_back(Insertion(leaf->get_id(), key));
+                leaf->append(&key, handles, limit);
+            }
+        }
+        // don't leave the last leaf nearly empty
+        if (prev_leaf != nullptr && leaf->is_underfull())
+            level.back().second = prev_leaf->redistribute(leaf);
+        if (prev_leaf != nullptr)
+            prev_leaf->save();
+        leaf->save();
+    } catch (...) {
+        delete prev_leaf;
+        delete leaf;
+        root = new BTreeLeaf(file, stat->get_root_id(), key_codec, false);
+        throw;
+    }
+    delete prev_leaf;
+    delete leaf;
+
+    // each level of interior nodes points to the nodes of the level below, until one node covers everything
+    uint height = 1;
+    while (level.size() > 1) {
+        std::vector<Insertion> parents;
+        BTreeInterior* node = nullptr;
+        BTreeInterior* prev_node = nullptr;
+        for (auto const& child: level) {
+            if (node != nullptr && node->append(&child.second, child.first, limit))
+                continue;
+            auto* next_node = new BTreeInterior(file, 0, key_codec, true);
+            next_node->set_first(child.first);
+            if (prev_node != nullptr) {
+                prev_node->save();
+                delete prev_node;  // releases its pinned block
+            }
+            prev_node = node;
+            node = next_node;
+            parents.push_back(Insertion(node->get_id(), child.second));
+        }
+        // an interior node needs at least two children
+        if (prev_node != nullptr && node->is_underfull())
+            parents.back().second = prev_node->redistribute(&parents.back().second, node);
+        if (prev_node != nullptr) {
+            prev_node->save();
+            delete prev_node;
+        }
+        node->save();
+        delete node;
+        level = parents;
+        height++;
+    }
+
+    stat->set_root_id(level.front().first);
+    stat->set_height(height);
+    stat->save();
+    if (height == 1)
+        root = new BTreeLeaf(file, stat->get_root_id(), key_codec, false);
+    else
+        root = new BTreeInterior(file, stat->get_root_id(), key_codec, false);
 }
 
 // Drop the index.
 void BTreeIndex::drop() {
+    clear_cache();
+    delete stat;
+    stat = nullptr;
+    delete root;
+    root = nullptr;
+    closed = true;
     file.drop();
 }
 
@@ -43,59 +434,230 @@ void BTreeIndex::drop() {
 void BTreeIndex::open() {
     if (closed) {
         file.open();
-        stat = new BTreeStat(file, STAT, key_profile);
+        stat = new BTreeStat(file, STAT, key_codec);
         if (stat->get_height() == 1)
-            root = new BTreeLeaf(file, stat->get_root_id(), key_profile, false);
+            root = new BTreeLeaf(file, stat->get_root_id(), key_codec, false);
         else
-            root = new BTreeInterior(file, stat->get_root_id(), key_profile, false);
-        closed = true;
+            root = new BTreeInterior(file, stat->get_root_id(), key_codec, false);
+        closed = false;
     }
 }
 
 // Closes the index. Disables: lookup, range, insert, delete, update.
 void BTreeIndex::close() {
     if (!closed) {
-        file.close();
+        clear_cache();
         delete stat;
         stat = nullptr;
         delete root;
         root = nullptr;
+        file.close();  // after the nodes are gone so their blocks are unpinned
         closed = true;
     }
 }
 
 // Find all the rows whose columns are equal to key. Assumes key is a dictionary whose keys are the column
-// names in the index. Returns a list of row handles.
+// names in the index. Returns a list of row handles in block order.
 Handles* BTreeIndex::lookup(ValueDict* key_dict) const {
-    return _lookup(root, stat->get_height(), tkey(key_dict));
+    if (!accepts(key_dict))
+        return new Handles();
+    if (!include_columns.empty()) {
+        // the key's rows are spread over an entry for each of their distinct included values
+        Handles* handles = range(key_dict, key_dict);
+        std::sort(handles->begin(), handles->end());
+        return handles;
+    }
+    KeyBytes* key = encode_key(key_dict);
+    Handles* handles = _lookup(root, stat->get_height(), key);
+    delete key;
+    return handles;
 }
 
-Handles* BTreeIndex::_lookup(BTreeNode* node, uint height, const KeyValue* key) const {
+Handles* BTreeIndex::_lookup(BTreeNode* node, uint height, const KeyBytes* key) const {
     if (height == 1) {
         BTreeLeaf* leaf = dynamic_cast<BTreeLeaf*>(node);
         Handles* found = new Handles();
-        try {
-            found->push_back(leaf->find_eq(key));
-        } catch (...) {}
+        leaf->find_eq(key, *found);
         return found;
     }
     BTreeInterior* interiorNode = dynamic_cast<BTreeInterior*>(node);
-    BTreeNode* nextNode = interiorNode->find(key, height);
-    return _lookup(nextNode, height - 1, key);
+    BTreeNode* nextNode = fetch(interiorNode->get_child_id(interiorNode->find_child(key)), height - 1);
+    Handles* found;
+    try {
+        found = _lookup(nextNode, height - 1, key);
+    } catch (...) {
+        release(nextNode);
+        throw;
+    }
+    release(nextNode);
+    return found;
 }
 
+// Find all the rows whose keys are between min_key and max_key inclusive (either may be nullptr for no bound).
 Handles* BTreeIndex::range(ValueDict* min_key, ValueDict* max_key) const {
-    throw DbRelationError("Don't know how to do a range query on Btree index yet"); // FIXME
+    HandleCursor* cursor = range_scan(min_key, true, max_key, true);
+    Handles* handles = new Handles();
+    Handle handle;
+    while (cursor->next(handle))
+        handles->push_back(handle);
+    delete cursor;
+    return handles;
+}
+
+HandleCursor* BTreeIndex::range_scan(const ValueDict* min_key, bool min_inclusive, const ValueDict* max_key,
+                                     bool max_inclusive) const {
+    if (closed)
+        throw DbRelationError("index " + name + " is not open");
+    KeyBytes* tmin = min_key ? encode_key(min_key) : nullptr;
+    KeyBytes* tmax;
+    try {
+        tmax = max_key ? encode_key(max_key) : nullptr;
+    } catch (DbRelationError& e) {
+        delete tmin;
+        throw;
+    }
+    return new BTreeRangeCursor(find_leaf(tmin), tmin, min_inclusive, tmax, max_inclusive);
+}
+
+BTreeLeaf* BTreeIndex::find_leaf(const KeyBytes* key) const {
+    uint height = stat->get_height();
+    if (height == 1)
+        return new BTreeLeaf(file, root->get_id(), key_codec, false);  // a copy the caller can free
+    BTreeNode* node = root;
+    for (; height > 1; height--) {
+        auto* interior = dynamic_cast<BTreeInterior*>(node);
+        BTreeNode* child = fetch(interior->get_child_id(key ? interior->find_child(key) : 0), height - 1);
+        release(node);
+        node = child;
+    }
+    return dynamic_cast<BTreeLeaf*>(node);  // leaves are never cached, so this one is the caller's
+}
+
+bool BTreeIndex::covers(const ColumnNames& column_names) const {
+    for (auto const& column_name: column_names)
+        if (std::find(key_columns.begin(), key_columns.end(), column_name) == key_columns.end() &&
+            std::find(include_columns.begin(), include_columns.end(), column_name) == include_columns.end())
+            return false;
+    return true;
+}
+
+// Find the rows whose columns are equal to key, like lookup, but decode the values of column_names out of the
+// entry keys rather than reading the rows. One row of values per handle, in key order.
+ValueDicts* BTreeIndex::lookup_covered(ValueDict* key_dict, const ColumnNames& column_names) const {
+    if (closed)
+        throw DbRelationError("index " + name + " is not open");
+    if (!covers(column_names))
+        throw DbRelationError("index " + name + " does not hold all the columns asked for");
+    if (!accepts(key_dict))
+        return new ValueDicts();
+    KeyBytes* key = encode_key(key_dict);
+    BTreeLeaf* leaf = find_leaf(key);
+    ValueDicts* rows = new ValueDicts();
+    try {
+        KeyValue key_values, include_values;
+        Handles handles;
+        uint i = leaf->lower_bound(key);
+        while (leaf != nullptr) {
+            if (i >= leaf->size()) {
+                BTreeLeaf* next_leaf = leaf->next();
+                delete leaf;  // releases its pinned block
+                leaf = next_leaf;
+                i = 0;
+                continue;
+            }
+            KeyBytes entry_key = leaf->get_key(i);
+            if (entry_key.compare(0, key->size(), *key) != 0)
+                break;
+            key_codec.decode(entry_key.data(), key_values);
+            include_codec.decode(entry_key.data() + key->size(), include_values);
+            ValueDict entry;
+            for (uint c = 0; c < key_columns.size(); c++)
+                entry[key_columns[c]] = key_values[c];
+            for (uint c = 0; c < include_columns.size(); c++)
+                entry[include_columns[c]] = include_values[c];
+            ValueDict row;
+            for (auto const& column_name: column_names)
+                row[column_name] = entry[column_name];
+            handles.clear();
+            leaf->get_handles(i++, handles);
+            for (size_t h = 0; h < handles.size(); h++)
+                rows->push_back(new ValueDict(row));
+        }
+    } catch (...) {
+        delete leaf;
+        delete key;
+        for (auto row: *rows)
+            delete row;
+        delete rows;
+        throw;
+    }
+    delete leaf;
+    delete key;
+    return rows;
 }
 
 // Insert a row with the given handle. Row must exist in relation already.
 void BTreeIndex::insert(Handle handle) {
     open();
     ValueDict* key = relation.project(handle);
-    KeyValue* tkey = this->tkey(key);
-    Insertion insertion = _insert(root, stat->get_height(), tkey, handle);
+    KeyBytes* tkey = nullptr;
+    try {
+        tkey = encode_entry(key);
+        insert_entry(key, tkey, handle);
+    } catch (...) {
+        delete key;
+        delete tkey;
+        throw;
+    }
+    delete key;
+    delete tkey;
+}
+
+// Insert the entries for many rows: read their keys a block at a time, then insert them in key order so that
+// each insert mostly finds the leaf and interior nodes the one before it used still in memory.
+void BTreeIndex::insert_batch(const Handles* handles) {
+    open();
+    ColumnNames entry_columns = key_columns;
+    entry_columns.insert(entry_columns.end(), include_columns.begin(), include_columns.end());
+    Handles batch(*handles);
+    ValueDicts* rows = relation.project(&batch, &entry_columns);
+    try {
+        std::vector<KeyBytes> entries;
+        entries.reserve(rows->size());
+        for (auto const row: *rows) {
+            KeyBytes* entry = encode_entry(row);
+            entries.push_back(*entry);
+            delete entry;
+        }
+        std::vector<uint> order(entries.size());
+        for (uint i = 0; i < order.size(); i++)
+            order[i] = i;
+        std::stable_sort(order.begin(), order.end(), [&entries](uint a, uint b) { return entries[a] < entries[b]; });
+        for (auto i: order)
+            insert_entry((*rows)[i], &entries[i], batch[i]);
+    } catch (...) {
+        for (auto row: *rows)
+            delete row;
+        delete rows;
+        throw;
+    }
+    for (auto row: *rows)
+        delete row;
+    delete rows;
+}
+
+void BTreeIndex::insert_entry(ValueDict* row, const KeyBytes* entry, Handle handle) {
+    if (unique && !include_columns.empty()) {
+        // the leaf only catches a duplicate entry key, which has the included values as well
+        Handles* found = lookup(row);
+        bool duplicate = !found->empty();
+        delete found;
+        if (duplicate)
+            throw DbRelationError("Duplicate keys are not allowed in unique index");
+    }
+    Insertion insertion = _insert(root, stat->get_height(), entry, handle);
     if (!BTreeNode::insertion_is_none(insertion)) {
-        auto *new_root = new BTreeInterior(file, 0, key_profile, true);
+        auto *new_root = new BTreeInterior(file, 0, key_codec, true);
         new_root->set_first(root->get_id());
         new_root->insert(&insertion.second, insertion.first);
         new_root->save();
@@ -106,36 +668,222 @@ void BTreeIndex::insert(Handle handle) {
         root = new_root;
         std::cout << "new root: " << *new_root << std::endl;
     }
-    delete key;
-    delete tkey;
 }
 
 // Recursive insert. If a split happens at this level, return the (new node, boundary) of the split.
-Insertion BTreeIndex::_insert(BTreeNode* node, uint height, const KeyValue* key, Handle handle) {
+Insertion BTreeIndex::_insert(BTreeNode* node, uint height, const KeyBytes* key, Handle handle) {
     if (height == 1) {
         auto* leaf = dynamic_cast<BTreeLeaf*>(node);
-        return leaf->insert(key, handle);
+        return leaf->insert(key, handle, unique);
     } else {
         auto* interior = dynamic_cast<BTreeInterior*>(node);
-        Insertion insertion = _insert(interior->find(key, height), height - 1, key, handle);
+        BTreeNode* child = fetch(interior->get_child_id(interior->find_child(key)), height - 1);
+        Insertion insertion;
+        try {
+            insertion = _insert(child, height - 1, key, handle);
+        } catch (...) {
+            release(child);
+            throw;
+        }
+        release(child);
         if (!BTreeNode::insertion_is_none(insertion))
             insertion = interior->insert(&insertion.second, insertion.first);
         return insertion;
     }
 }
 
+// Delete the entry for the row with the given handle. Row must still exist in relation.
 void BTreeIndex::del(Handle handle) {
-    throw DbRelationError("Don't know how to delete from a BTree index yet"); // FIXME
+    open();
+    ValueDict* key = relation.project(handle);
+    KeyBytes* tkey;
+    try {
+        tkey = encode_entry(key);
+    } catch (DbRelationError& e) {
+        delete key;
+        throw;
+    }
+    delete key;
+    try {
+        _del(root, stat->get_height(), tkey, handle);
+    } catch (DbRelationError& e) {
+        delete tkey;
+        throw;
+    }
+    delete tkey;
+
+    // a root with a single child is replaced by the child
+    while (stat->get_height() > 1) {
+        auto* interior = dynamic_cast<BTreeInterior*>(root);
+        if (interior->child_count() > 1)
+            break;
+        BTreeNode* new_root = fetch(interior->get_child_id(0), stat->get_height() - 1);
+        uncache(new_root);  // owned as the root from now on
+        interior->discard();
+        stat->set_root_id(new_root->get_id());
+        stat->set_height(stat->get_height() - 1);
+        stat->save();
+        delete root;
+        root = new_root;
+    }
+}
+
+bool BTreeIndex::_del(BTreeNode* node, uint height, const KeyBytes* key, Handle handle) {
+    if (height == 1) {
+        auto* leaf = dynamic_cast<BTreeLeaf*>(node);
+        leaf->del(key, handle);
+        return leaf->is_underfull();
+    }
+    auto* interior = dynamic_cast<BTreeInterior*>(node);
+    uint k = interior->find_child(key);
+    BTreeNode* child = fetch(interior->get_child_id(k), height - 1);
+    bool underfull;
+    try {
+        underfull = _del(child, height - 1, key, handle);
+    } catch (DbRelationError& e) {
+        release(child);
+        throw;
+    }
+    if (underfull && interior->child_count() > 1) {
+        // pair the child with its left sibling, or with its right one if it is the leftmost
+        uint left_k = k > 0 ? k - 1 : k;
+        BTreeNode* sibling = fetch(interior->get_child_id(k > 0 ? k - 1 : k + 1), height - 1);
+        if (k > 0)
+            rebalance(interior, left_k, sibling, child, height);
+        else
+            rebalance(interior, left_k, child, sibling, height);
+        release(sibling);
+    }
+    release(child);
+    return interior->is_underfull();
+}
+
+void BTreeIndex::rebalance(BTreeInterior* parent, uint k, BTreeNode* left, BTreeNode* right, uint height) {
+    if (height == 2) {
+        auto* lleaf = dynamic_cast<BTreeLeaf*>(left);
+        auto* rleaf = dynamic_cast<BTreeLeaf*>(right);
+        if (lleaf->can_merge(rleaf)) {
+            lleaf->merge(rleaf);
+            rleaf->discard();
+            parent->remove_child(k + 1);
+        } else {
+            parent->set_boundary(k, lleaf->redistribute(rleaf));
+            rleaf->save();
+        }
+        lleaf->save();
+    } else {
+        auto* linterior = dynamic_cast<BTreeInterior*>(left);
+        auto* rinterior = dynamic_cast<BTreeInterior*>(right);
+        KeyBytes separator = parent->get_boundary(k);
+        if (linterior->can_merge(&separator, rinterior)) {
+            linterior->merge(&separator, rinterior);
+            rinterior->discard();
+            uncache(rinterior);  // no longer in the tree, so the caller's release frees it
+            parent->remove_child(k + 1);
+        } else {
+            parent->set_boundary(k, linterior->redistribute(&separator, rinterior));
+            rinterior->save();
+        }
+        linterior->save();
+    }
+    parent->save();
+}
+
+BTreeNode* BTreeIndex::fetch(BlockID block_id, uint height) const {
+    if (height == 1)
+        return new BTreeLeaf(file, block_id, key_codec, false);
+    auto it = node_cache.find(block_id);
+    if (it != node_cache.end())
+        return it->second;
+    auto* interior = new BTreeInterior(file, block_id, key_codec, false);
+    uint budget = std::min(node_cache_size, BufferPool::instance().get_capacity() / NODE_CACHE_SHARE);
+    if (cached_nodes < budget) {
+        node_cache[block_id] = interior;  // stays parsed and pinned until the index is closed
+        cached_nodes++;
+    }
+    return interior;
+}
+
+void BTreeIndex::release(BTreeNode* node) const {
+    if (node == root)
+        return;
+    auto it = node_cache.find(node->get_id());
+    if (it == node_cache.end() || it->second != node)
+        delete node;  // releases its pinned block
+}
+
+void BTreeIndex::uncache(BTreeNode* node) const {
+    auto it = node_cache.find(node->get_id());
+    if (it != node_cache.end() && it->second == node) {
+        node_cache.erase(it);
+        cached_nodes--;
+    }
+}
+
+void BTreeIndex::clear_cache() {
+    for (auto const& entry: node_cache)
+        delete entry.second;
+    cached_nodes -= (uint) node_cache.size();
+    node_cache.clear();
 }
 
 KeyValue* BTreeIndex::tkey(const ValueDict* key) const {
     KeyValue* key_value = new KeyValue();
-    for (auto const& column_name: key_columns)
-        key_value->push_back(key->find(column_name)->second);
+    for (auto const& column_name: key_columns) {
+        auto it = key->find(column_name);
+        if (it == key->end()) {
+            delete key_value;
+            throw DbRelationError("key for index " + name + " has no value for column " + column_name);
+        }
+        key_value->push_back(it->second);
+    }
     return key_value;
 }
 
+bool BTreeIndex::accepts(const ValueDict* key) const {
+    KeyValue* key_value = tkey(key);
+    bool accepted = key_codec.accepts(*key_value);
+    delete key_value;
+    return accepted;
+}
+
+KeyBytes* BTreeIndex::encode_key(const ValueDict* key) const {
+    KeyValue* key_value = tkey(key);
+    KeyBytes* key_bytes;
+    try {
+        key_bytes = new KeyBytes(key_codec.encode(*key_value));
+    } catch (DbRelationError& e) {
+        delete key_value;
+        throw;
+    }
+    delete key_value;
+    return key_bytes;
+}
+
+KeyBytes* BTreeIndex::encode_entry(const ValueDict* row) const {
+    KeyBytes* entry_key = encode_key(row);
+    if (include_columns.empty())
+        return entry_key;
+    KeyValue include_values;
+    for (auto const& column_name: include_columns) {
+        auto it = row->find(column_name);
+        if (it == row->end()) {
+            delete entry_key;
+            throw DbRelationError("row for index " + name + " has no value for column " + column_name);
+        }
+        include_values.push_back(it->second);
+    }
+    try {
+        entry_key->append(include_codec.encode(include_values));
+    } catch (DbRelationError& e) {
+        delete entry_key;
+        throw;
+    }
+    return entry_key;
+}
+
 // Figure out the data types of each key component and encode them in key_profile, a list of int/str classes.
+// Likewise for the included columns in include_profile.
 void BTreeIndex::build_key_profile() {
     std::map<const Identifier, ColumnAttribute::DataType> types_by_colname;
     const ColumnAttributes column_attributes = relation.get_column_attributes();
@@ -146,4 +894,6 @@ void BTreeIndex::build_key_profile() {
     }
     for (auto const& column_name: key_columns)
         key_profile.push_back(types_by_colname[column_name]);
+    for (auto const& column_name: include_columns)
+        include_profile.push_back(types_by_colname[column_name]);
 }
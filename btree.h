@@ -10,7 +10,28 @@
 
 class BTreeIndex : public DbIndex {
 public:
-    BTreeIndex(DbRelation &relation, Identifier name, ColumnNames key_columns, bool unique);
+    /**
+     * Number of (key, handle) entries bulk loading sorts in memory before spilling a sorted run to disk
+     */
+    static const uint DEFAULT_SORT_RUN_SIZE = 100000U;
+
+    /**
+     * The open indices between them keep at most 1/NODE_CACHE_SHARE of the buffer pool's frames pinned for their
+     * cached interior nodes, however many indices are open
+     */
+    static const uint NODE_CACHE_SHARE = 8U;
+
+    /**
+     * No limit on cached interior nodes other than the buffer pool's share
+     */
+    static const uint DEFAULT_NODE_CACHE_SIZE = UINT32_MAX;
+
+    /**
+     * @param include_columns  other columns whose values the leaf entries hold as well, after the key (see
+     *                         lookup_covered); entries are ordered by key then by these values
+     */
+    BTreeIndex(DbRelation &relation, Identifier name, ColumnNames key_columns, bool unique,
+               ColumnNames include_columns = ColumnNames());
 
     virtual ~BTreeIndex();
 
@@ -26,23 +47,145 @@ public:
 
     virtual Handles *range(ValueDict *min_key, ValueDict *max_key) const;
 
+    virtual HandleCursor *range_scan(const ValueDict *min_key, bool min_inclusive, const ValueDict *max_key,
+                                     bool max_inclusive) const;
+
+    virtual bool covers(const ColumnNames &column_names) const;
+
+    virtual ValueDicts *lookup_covered(ValueDict *key_values, const ColumnNames &column_names) const;
+
     virtual void insert(Handle handle);
 
+    virtual void insert_batch(const Handles *handles);
+
     virtual void del(Handle handle);
 
+    const ColumnNames &get_include_columns() const { return this->include_columns; }
+
     virtual KeyValue *tkey(const ValueDict *key) const; // pull out the key values from the ValueDict in order
 
+    /**
+     * Set how full create() packs each node; the rest of the block is left for later inserts.
+     * @param fill_factor  fraction of a block, clamped to between 0.5 and 1.0
+     */
+    static void set_fill_factor(double fill_factor);
+
+    /**
+     * Set how many entries create() sorts in memory at a time.
+     * @param sort_run_size  entries per sorted run (at least 1)
+     */
+    static void set_sort_run_size(uint sort_run_size);
+
+    /**
+     * Set how many interior nodes the open indices may keep in memory between them (never more than their share
+     * of the buffer pool). Each one holds a buffer pool frame pinned.
+     * Takes effect as nodes are next read; nodes already cached stay until their index is closed.
+     * @param node_cache_size  number of nodes (0 for none)
+     */
+    static void set_node_cache_size(uint node_cache_size);
+
 protected:
     static const BlockID STAT = 1;
+    static double fill_factor;
+    static uint sort_run_size;
+    static uint node_cache_size;
+    static uint cached_nodes;  // in the node caches of all the open indices
     bool closed;
     BTreeStat *stat;
     BTreeNode *root;
-    HeapFile file;
+    mutable std::map<BlockID, BTreeInterior *> node_cache;  // interior nodes below the root, by block
+    mutable HeapFile file;  // const operations still pin blocks
     KeyProfile key_profile;
+    KeyCodec key_codec;  // built from key_profile, shared by all the nodes
+    ColumnNames include_columns;
+    KeyProfile include_profile;
+    KeyCodec include_codec;  // built from include_profile
 
     void build_key_profile();
 
-    Handles *_lookup(BTreeNode *node, uint height, const KeyValue *key) const;
-
-    Insertion _insert(BTreeNode *node, uint height, const KeyValue *key, Handle handle);
+    /**
+     * Whether a key's values are of the key columns' types (a key that is not equals no row's key).
+     * @param key  values for (at least) the key columns
+     */
+    bool accepts(const ValueDict *key) const;
+
+    /**
+     * Pull out the key values from a ValueDict and encode them the way the nodes store them.
+     * @param key  values for (at least) the key columns
+     * @returns    the encoded key (freed by caller)
+     */
+    KeyBytes *encode_key(const ValueDict *key) const;
+
+    /**
+     * Encode the key a row's entry is stored under: its search key followed by its included values, if any.
+     * Lookups by search key alone then match on the leading bytes of the entry keys.
+     * @param row  values for (at least) the key columns and included columns
+     * @returns    the encoded entry key (freed by caller)
+     */
+    KeyBytes *encode_entry(const ValueDict *row) const;
+
+    /**
+     * Get a node below the root. Interior nodes come from the node cache, and are added to it while there is room.
+     * All access to interior nodes goes through here, so there is never more than one copy of a cached node.
+     * @param block_id  the node's block
+     * @param height    the node's height (1 for a leaf)
+     * @returns         the node, to be handed back to release()
+     */
+    BTreeNode *fetch(BlockID block_id, uint height) const;
+
+    /**
+     * Done with a node from fetch(). Frees it unless it is cached or is the root.
+     */
+    void release(BTreeNode *node) const;
+
+    /**
+     * Take a node out of the cache (it is leaving the tree or becoming the root); the caller now owns it.
+     */
+    void uncache(BTreeNode *node) const;
+
+    /**
+     * Free all the cached nodes (unpinning their blocks).
+     */
+    void clear_cache();
+
+    Handles *_lookup(BTreeNode *node, uint height, const KeyBytes *key) const;
+
+    /**
+     * Descend to the leaf where key is or would be.
+     * @param key  search key, or nullptr for the leftmost leaf
+     * @returns    the leaf (freed by caller)
+     */
+    BTreeLeaf *find_leaf(const KeyBytes *key) const;
+
+    /**
+     * Build the tree bottom-up from the relation's rows: sort every (key, handle) pair, pack them into a chain
+     * of leaves, then pack each level of interior nodes over the one below until there is a single root.
+     * @throws DbRelationError  if the index is unique and two rows have the same key
+     */
+    void bulk_load();
+
+    /**
+     * Add one row's entry, growing a new root if the old one splits.
+     * @param row     values for (at least) the key columns, to check a unique index that includes columns
+     * @param entry   the row's encoded entry key (see encode_entry)
+     * @param handle  the row
+     * @throws DbRelationError  if the index is unique and already has the row's key
+     */
+    void insert_entry(ValueDict *row, const KeyBytes *entry, Handle handle);
+
+    Insertion _insert(BTreeNode *node, uint height, const KeyBytes *key, Handle handle);
+
+    /**
+     * Recursive delete. Fixes up any child left underfull by merging it with or borrowing from a sibling.
+     * @returns  true if node itself is now underfull
+     */
+    bool _del(BTreeNode *node, uint height, const KeyBytes *key, Handle handle);
+
+    /**
+     * Merge or redistribute two neighboring children of parent.
+     * @param parent  interior node holding both
+     * @param k       position of left in parent (right is at k + 1)
+     * @param height  height of parent
+     */
+    void rebalance(BTreeInterior *parent, uint k, BTreeNode *left, BTreeNode *right, uint height);
 };
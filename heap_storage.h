@@ -2,6 +2,7 @@
  * @file heap_storage.h - Implementation of storage_engine with a heap file structure.
  * SlottedPage: DbBlock
  * HeapFile: DbFile
+ * FreeSpaceMap
  * HeapTable: DbRelation
  *
  * @author Kevin Lundeen
@@ -11,4 +12,5 @@
 #pragma once
 #include "SlottedPage.h"
 #include "HeapFile.h"
+#include "FreeSpaceMap.h"
 #include "HeapTable.h"
\ No newline at end of file
@@ -4,9 +4,12 @@
  * @see "Seattle University, CPSC5300, Winter 2023"
  */
 
+#include <algorithm>
+#include <sstream>
 #include "schema_tables.h"
 #include "ParseTreeToString.h"
 #include "btree.h"
+#include "HashIndex.h"
 
 void initialize_schema_tables() {
     Tables tables;
@@ -18,6 +21,9 @@ void initialize_schema_tables() {
     Indices indices;
     indices.create_if_not_exists();
     indices.close();
+    Statistics statistics;
+    statistics.create_if_not_exists();
+    statistics.close();
 }
 
 // Not terribly useful since the parser weeds most of these out
@@ -86,6 +92,8 @@ void Tables::create() {
     insert(&row);
     row["table_name"] = Value("_indices");
     insert(&row);
+    row["table_name"] = Value("_statistics");
+    insert(&row);
 }
 
 // Manually check that table_name is unique.
@@ -121,13 +129,18 @@ void Tables::get_columns(Identifier table_name, ColumnNames& column_names, Colum
     where["table_name"] = table_name;
     Handles* handles = Tables::columns_table->select(&where);
 
+    // the rows can be anywhere in _columns, so put them back in order by ordinal_position (1-based)
+    column_names.resize(handles->size());
+    column_attributes.resize(handles->size());
     ColumnAttribute column_attribute;
     for (Handle& handle: *handles) {
         ValueDict *row = Tables::columns_table->project(
-                handle);  // get the row's values: {'column_name': <name>, 'data_type': <type>}
+                handle);  // get the row's values: {'column_name': <name>, 'data_type': <type>, 'ordinal_position': <n>}
 
-        Identifier column_name = (*row)["column_name"].s;
-        column_names.push_back(column_name);
+        uint which = (uint) (*row)["ordinal_position"].n;
+        if (which < 1 || which > handles->size())
+            throw DbRelationError("bad ordinal_position for column " + (*row)["column_name"].s);
+        column_names[which - 1] = (*row)["column_name"].s;
 
         ColumnAttribute::DataType data_type;
         if ((*row)["data_type"].s == "INT")
@@ -140,7 +153,7 @@ void Tables::get_columns(Identifier table_name, ColumnNames& column_names, Colum
             throw DbRelationError("Unknown data type");
         column_attribute.set_data_type(data_type);
 
-        column_attributes.push_back(column_attribute);
+        column_attributes[which - 1] = column_attribute;
 
         delete row;
     }
@@ -177,6 +190,7 @@ ColumnNames& Columns::COLUMN_NAMES() {
         cn.push_back("table_name");
         cn.push_back("column_name");
         cn.push_back("data_type");
+        cn.push_back("ordinal_position");
     }
     return cn;
 }
@@ -186,9 +200,11 @@ ColumnAttributes& Columns::COLUMN_ATTRIBUTES() {
     static ColumnAttributes cas;
     if (cas.empty()) {
         ColumnAttribute ca(ColumnAttribute::TEXT);
-        cas.push_back(ca);
-        cas.push_back(ca);
-        cas.push_back(ca);
+        cas.push_back(ca);  // table_name
+        cas.push_back(ca);  // column_name
+        cas.push_back(ca);  // data_type
+        ca.set_data_type(ColumnAttribute::INT);
+        cas.push_back(ca);  // ordinal_position
     }
     return cas;
 }
@@ -204,29 +220,60 @@ void Columns::create() {
     row["data_type"] = Value("TEXT");  // all these are TEXT fields
     row["table_name"] = Value("_tables");
     row["column_name"] = Value("table_name");
+    row["ordinal_position"] = Value(1);
     insert(&row);
     row["table_name"] = Value("_columns");
     row["column_name"] = Value("table_name");
     insert(&row);
     row["column_name"] = Value("column_name");
+    row["ordinal_position"] = Value(2);
     insert(&row);
     row["column_name"] = Value("data_type");
+    row["ordinal_position"] = Value(3);
+    insert(&row);
+    row["column_name"] = Value("ordinal_position");
+    row["ordinal_position"] = Value(4);
+    row["data_type"] = Value("INT");
     insert(&row);
+    row["data_type"] = Value("TEXT");
     row["table_name"] = Value("_indices");
     row["column_name"] = Value("table_name");
+    row["ordinal_position"] = Value(1);
     insert(&row);
     row["column_name"] = Value("index_name");
+    row["ordinal_position"] = Value(2);
     insert(&row);
     row["column_name"] = Value("column_name");
-    insert(&row);
-    row["column_name"] = Value("index_type");
+    row["ordinal_position"] = Value(3);
     insert(&row);
     row["column_name"] = Value("seq_in_index");
+    row["ordinal_position"] = Value(4);
     row["data_type"] = Value("INT");
     insert(&row);
+    row["column_name"] = Value("index_type");
+    row["ordinal_position"] = Value(5);
+    row["data_type"] = Value("TEXT");
+    insert(&row);
     row["column_name"] = Value("is_unique");
+    row["ordinal_position"] = Value(6);
     row["data_type"] = Value("BOOLEAN");
     insert(&row);
+    row["table_name"] = Value("_statistics");
+    int ordinal_position = 0;
+    for (auto const &column: std::vector<std::pair<const char *, const char *>>{
+            {"table_name",   "TEXT"},
+            {"column_name",  "TEXT"},
+            {"row_count",    "INT"},
+            {"page_count",   "INT"},
+            {"changed_rows", "INT"},
+            {"n_distinct",   "INT"},
+            {"most_common",  "TEXT"},
+            {"histogram",    "TEXT"}}) {
+        row["column_name"] = Value(column.first);
+        row["ordinal_position"] = Value(++ordinal_position);
+        row["data_type"] = Value(column.second);
+        insert(&row);
+    }
 }
 
 // Manually check that (table_name, column_name) is unique.
@@ -309,7 +356,7 @@ Handle Indices::insert(const ValueDict *row) {
     ValueDict where;
     where["table_name"] = row->at("table_name");
     where["index_name"] = row->at("index_name");
-    if (row->at("seq_in_index").n > 1)
+    if (row->at("seq_in_index").n != 1)
         where["column_name"] = row->at("column_name");  // check for duplicate columns on the same index
     Handles *handles = select(&where);
     bool unique = handles->empty();
@@ -338,53 +385,43 @@ void Indices::del(Handle handle) {
 
 // Return a list of column names and column attributes for given table.
 void Indices::get_columns(Identifier table_name, Identifier index_name, ColumnNames &column_names, bool &is_hash,
-                          bool &is_unique) {
+                          bool &is_unique, ColumnNames *include_columns) {
     // SELECT * FROM _indices WHERE table_name = <table_name> AND index_name = <index_name>
     ValueDict where;
     where["table_name"] = table_name;
     where["index_name"] = index_name;
     Handles *handles = select(&where);
 
-    Identifier colnames[DbIndex::MAX_COMPOSITE];
-    uint size = 0;
+    Identifier colnames[DbIndex::MAX_COMPOSITE], include_colnames[DbIndex::MAX_COMPOSITE];
+    uint size = 0, include_size = 0;
     for (auto const &handle: *handles) {
         ValueDict *row = project(handle);
 
         Identifier column_name = (*row)["column_name"].s;
-        uint which = (uint) (*row)["seq_in_index"].n;
-        colnames[which - 1] = column_name;  // seq_in_index is 1-based
-        if (which > size)
-            size = which;
+        int seq_in_index = (*row)["seq_in_index"].n;
+        if (seq_in_index < 0) {
+            uint which = (uint) -seq_in_index;
+            include_colnames[which - 1] = column_name;  // included columns are numbered -1, -2, ...
+            if (which > include_size)
+                include_size = which;
+        } else {
+            uint which = (uint) seq_in_index;
+            colnames[which - 1] = column_name;  // seq_in_index is 1-based
+            if (which > size)
+                size = which;
+        }
         is_unique = (*row)["is_unique"].n != 0;
         is_hash = (*row)["index_type"].s == "HASH";
         delete row;
     }
     for (uint i = 0; i < size; i++)
         column_names.push_back(colnames[i]);
+    if (include_columns != nullptr)
+        for (uint i = 0; i < include_size; i++)
+            include_columns->push_back(include_colnames[i]);
     delete handles;
 }
 
-// FIXME - use this for now until we have BTreeIndex and HashIndex
-class DummyIndex : public DbIndex {
-public:
-    DummyIndex(DbRelation &rel, Identifier idx, ColumnNames key, bool unq) : DbIndex(rel, idx, key, unq) {}
-
-    void create() {}
-
-    void drop() {}
-
-    void open() {}
-
-    void close() {}
-
-    Handles *lookup(ValueDict *key_values) const { return nullptr; }
-
-    void insert(Handle handle) {}
-
-    void del(Handle handle) {}
-};
-
-
 // Return a table for given table_name.
 DbIndex &Indices::get_index(Identifier table_name, Identifier index_name) {
     // if they are asking about an index we've once constructed, then just return that one
@@ -392,16 +429,16 @@ DbIndex &Indices::get_index(Identifier table_name, Identifier index_name) {
     if (Indices::index_cache.find(cache_key) != Indices::index_cache.end())
         return *Indices::index_cache[cache_key];
 
-    // otherwise assume it is a DummyIndex (for now)
-    ColumnNames column_names;
+    // otherwise construct it from its rows in _indices
+    ColumnNames column_names, include_columns;
     bool is_hash, is_unique;
-    get_columns(table_name, index_name, column_names, is_hash, is_unique);
+    get_columns(table_name, index_name, column_names, is_hash, is_unique, &include_columns);
     DbRelation &table = Tables::get_table(table_name);
     DbIndex *index;
     if (is_hash) {
-        index = new DummyIndex(table, index_name, column_names, is_unique);  // FIXME - change to HashIndex
+        index = new HashIndex(table, index_name, column_names, is_unique);
     } else {
-        index = new BTreeIndex(table, index_name, column_names, is_unique);
+        index = new BTreeIndex(table, index_name, column_names, is_unique, include_columns);
     }
     Indices::index_cache[cache_key] = index;
     return *index;
@@ -421,3 +458,335 @@ IndexNames Indices::get_index_names(Identifier table_name) {
     delete handles;
     return ret;
 }
+
+
+/*
+ * *******************************
+ * Statistics class implementation
+ * *******************************
+ */
+const Identifier Statistics::TABLE_NAME = "_statistics";
+
+// get the column name for _statistics column
+ColumnNames &Statistics::COLUMN_NAMES() {
+    static ColumnNames cn;
+    if (cn.empty()) {
+        cn.push_back("table_name");
+        cn.push_back("column_name");  // empty for the row about the whole table
+        cn.push_back("row_count");
+        cn.push_back("page_count");
+        cn.push_back("changed_rows");
+        cn.push_back("n_distinct");
+        cn.push_back("most_common");
+        cn.push_back("histogram");
+    }
+    return cn;
+}
+
+// get the column attribute for _statistics column
+ColumnAttributes &Statistics::COLUMN_ATTRIBUTES() {
+    static ColumnAttributes cas;
+    if (cas.empty()) {
+        ColumnAttribute ca(ColumnAttribute::TEXT);
+        cas.push_back(ca);  // table_name
+        cas.push_back(ca);  // column_name
+        ca.set_data_type(ColumnAttribute::INT);
+        cas.push_back(ca);  // row_count
+        cas.push_back(ca);  // page_count
+        cas.push_back(ca);  // changed_rows
+        cas.push_back(ca);  // n_distinct
+        ca.set_data_type(ColumnAttribute::TEXT);
+        cas.push_back(ca);  // most_common
+        cas.push_back(ca);  // histogram
+    }
+    return cas;
+}
+
+// ctor - we have a fixed table structure
+Statistics::Statistics() : HeapTable(TABLE_NAME, COLUMN_NAMES(), COLUMN_ATTRIBUTES()) {}
+
+// counts are kept in INT columns
+static Value count_value(u_long count) {
+    return Value((int32_t) std::min(count, (u_long) INT32_MAX));
+}
+
+// write a value for the most_common and histogram columns
+static void write_value(std::ostream &out, const Value &value) {
+    if (value.data_type != ColumnAttribute::TEXT) {
+        out << value;
+        return;
+    }
+    out << '"';
+    for (char c: value.s) {
+        if (c == '"')
+            out << '"';
+        out << c;
+    }
+    out << '"';
+}
+
+// read back a value written by write_value
+static Value read_value(std::istream &in) {
+    std::string token;
+    if (in.peek() == '"') {
+        in.get();
+        for (int c = in.get(); c != EOF; c = in.get()) {
+            if (c == '"' && in.peek() != '"')
+                return Value(token);
+            if (c == '"')
+                in.get();
+            token += (char) c;
+        }
+        throw DbRelationError("unterminated value in " + Statistics::TABLE_NAME);
+    }
+    while (in.peek() != EOF && in.peek() != ',' && in.peek() != '=')
+        token += (char) in.get();
+    if (token == "true" || token == "false") {
+        Value value(token == "true" ? 1 : 0);
+        value.data_type = ColumnAttribute::BOOLEAN;
+        return value;
+    }
+    try {
+        return Value(std::stoi(token));
+    } catch (std::exception &e) {
+        throw DbRelationError("bad value '" + token + "' in " + Statistics::TABLE_NAME);
+    }
+}
+
+// Value::operator== does not tell BOOLEANs apart
+static bool same_value(const Value &a, const Value &b) {
+    return a.data_type == b.data_type && !(a < b) && !(b < a);
+}
+
+double ColumnStatistics::equal_fraction(const Value &value) const {
+    if (this->row_count == 0)
+        return 0.0;
+    double common_rows = 0.0;
+    for (auto const &common: this->most_common) {
+        if (same_value(common.first, value))
+            return std::min(1.0, (double) common.second / this->row_count);
+        common_rows += common.second;
+    }
+    if (this->n_distinct <= this->most_common.size())
+        return 0.0;
+    double other_rows = std::max(0.0, this->row_count - common_rows);
+    return other_rows / (this->n_distinct - this->most_common.size()) / this->row_count;
+}
+
+double ColumnStatistics::range_fraction(const ValueRange &range) const {
+    if (this->row_count == 0)
+        return 0.0;
+    double common_rows = 0.0, in_range = 0.0;
+    for (auto const &common: this->most_common) {
+        common_rows += common.second;
+        if (range.contains(common.first))
+            in_range += common.second;
+    }
+    double fraction = in_range / this->row_count;
+    double others = std::max(0.0, 1.0 - common_rows / this->row_count);
+    if (this->histogram.size() == 1)
+        fraction += range.contains(this->histogram[0]) ? others : 0.0;
+    if (this->histogram.size() < 2)
+        return std::min(1.0, fraction);
+    const Value &first = this->histogram.front();
+    if ((range.has_min && range.min.data_type != first.data_type) ||
+        (range.has_max && range.max.data_type != first.data_type))
+        return std::min(1.0, fraction);
+    double spanned = (range.has_max ? this->histogram_below(range.max) : 1.0) -
+                     (range.has_min ? this->histogram_below(range.min) : 0.0);
+    return std::min(1.0, fraction + others * std::max(0.0, spanned));
+}
+
+double ColumnStatistics::histogram_below(const Value &value) const {
+    const std::vector<Value> &bounds = this->histogram;
+    if (!(bounds.front() < value))
+        return 0.0;
+    if (!(value < bounds.back()))
+        return 1.0;
+    uint i = (uint) (std::upper_bound(bounds.begin(), bounds.end(), value) - bounds.begin()) - 1;
+    double within = 0.5;  // no way to tell how far into the bucket a TEXT value is
+    if (value.data_type == ColumnAttribute::INT)
+        within = ((double) value.n - bounds[i].n) / ((double) bounds[i + 1].n - bounds[i].n);
+    return (i + within) / (bounds.size() - 1);
+}
+
+/**
+ * Work out a column's statistics from a sample of its values.
+ * The number of distinct values is the Haas-Stokes estimate PostgreSQL uses, n*d / (n - f1 + f1*n/N), for d
+ * distinct values in a sample of n of the N rows, f1 of which were seen only once. The most common values are
+ * those seen more often than the average value (all of them if there are few enough); the histogram splits
+ * the rest into buckets of equal numbers of sampled rows.
+ * @param sample     the column's value in each sampled row
+ * @param row_count  rows in the table
+ * @returns          the statistics
+ */
+static ColumnStatistics summarize(const std::vector<Value> &sample, u_long row_count) {
+    ColumnStatistics statistics;
+    statistics.row_count = row_count;
+    if (sample.empty())
+        return statistics;
+    std::map<Value, u_long> counts;
+    for (auto const &value: sample)
+        counts[value]++;
+    double n = sample.size(), d = counts.size(), f1 = 0;
+    for (auto const &count: counts)
+        if (count.second == 1)
+            f1++;
+    double estimate = n * d / (n - f1 + f1 * n / std::max(n, (double) row_count));
+    estimate = std::min(estimate, std::max(d, (double) row_count));
+    statistics.n_distinct = (u_long) (std::max(estimate, d) + 0.5);
+
+    std::vector<std::pair<Value, u_long>> by_count(counts.begin(), counts.end());
+    std::stable_sort(by_count.begin(), by_count.end(),
+                     [](const std::pair<Value, u_long> &a, const std::pair<Value, u_long> &b) {
+                         return a.second > b.second;
+                     });
+    bool all_fit = counts.size() <= Statistics::MOST_COMMON;
+    for (auto const &count: by_count) {
+        if (statistics.most_common.size() == Statistics::MOST_COMMON)
+            break;
+        if (!all_fit && (count.second < 2 || count.second <= n / d))
+            break;
+        statistics.most_common.push_back({count.first, (u_long) (count.second * row_count / n + 0.5)});
+        counts.erase(count.first);
+    }
+
+    if (counts.size() < 2)
+        return statistics;
+    u_long rest = 0;
+    for (auto const &count: counts)
+        rest += count.second;
+    uint buckets = std::min((uint) counts.size() - 1, Statistics::HISTOGRAM_BUCKETS);
+    u_long seen = 0;
+    uint bound = 0;  // next bound to find: the value at position bound * (rest - 1) / buckets
+    for (auto const &count: counts) {
+        seen += count.second;
+        while (bound <= buckets && bound * (rest - 1) / buckets < seen) {
+            if (statistics.histogram.empty() || statistics.histogram.back() < count.first)
+                statistics.histogram.push_back(count.first);
+            bound++;
+        }
+    }
+    return statistics;
+}
+
+// Sample the table, then replace its rows here.
+void Statistics::analyze(Identifier table_name, DbRelation &table, u_long &sampled) {
+    u_long row_count;
+    uint page_count;
+    ValueDicts *rows = table.sample(SAMPLE_SIZE, row_count, page_count);
+    sampled = rows->size();
+    std::vector<std::pair<Identifier, ColumnStatistics>> columns;
+    for (auto const &column_name: table.get_column_names()) {
+        std::vector<Value> sample;
+        sample.reserve(rows->size());
+        for (auto const row: *rows)
+            sample.push_back(row->at(column_name));
+        columns.push_back({column_name, summarize(sample, row_count)});
+    }
+    for (auto row: *rows)
+        delete row;
+    delete rows;
+
+    forget(table_name);
+    ValueDict row;
+    row["table_name"] = Value(table_name);
+    row["column_name"] = Value("");
+    row["row_count"] = count_value(row_count);
+    row["page_count"] = count_value(page_count);
+    row["changed_rows"] = Value(0);
+    row["n_distinct"] = Value(0);
+    row["most_common"] = Value("");
+    row["histogram"] = Value("");
+    insert(&row);
+    row["page_count"] = Value(0);
+    for (auto const &column: columns) {
+        const ColumnStatistics &statistics = column.second;
+        std::ostringstream most_common, histogram;
+        for (auto const &value: statistics.most_common) {
+            if (&value != &statistics.most_common.front())
+                most_common << ",";
+            write_value(most_common, value.first);
+            most_common << "=" << value.second;
+        }
+        for (auto const &value: statistics.histogram) {
+            if (&value != &statistics.histogram.front())
+                histogram << ",";
+            write_value(histogram, value);
+        }
+        row["column_name"] = Value(column.first);
+        row["n_distinct"] = count_value(statistics.n_distinct);
+        row["most_common"] = Value(most_common.str());
+        row["histogram"] = Value(histogram.str());
+        insert(&row);
+    }
+}
+
+bool Statistics::get_table(Identifier table_name, u_long &row_count, uint &page_count, u_long &changed_rows) {
+    ValueDict where = {{"table_name", Value(table_name)}, {"column_name", Value("")}};
+    Handles *handles = select(&where);
+    bool found = !handles->empty();
+    if (found) {
+        ValueDict *row = project(handles->front());
+        row_count = (u_long) (*row)["row_count"].n;
+        page_count = (uint) (*row)["page_count"].n;
+        changed_rows = (u_long) (*row)["changed_rows"].n;
+        delete row;
+    }
+    delete handles;
+    return found;
+}
+
+bool Statistics::get_column(Identifier table_name, Identifier column_name, ColumnStatistics &statistics) {
+    ValueDict where = {{"table_name", Value(table_name)}, {"column_name", Value(column_name)}};
+    Handles *handles = select(&where);
+    bool found = !handles->empty();
+    ValueDict *row = found ? project(handles->front()) : nullptr;
+    delete handles;
+    if (!found)
+        return false;
+    statistics = ColumnStatistics();
+    statistics.row_count = (u_long) (*row)["row_count"].n;
+    statistics.n_distinct = (u_long) (*row)["n_distinct"].n;
+    std::istringstream most_common((*row)["most_common"].s), histogram((*row)["histogram"].s);
+    delete row;
+    while (most_common.peek() != EOF) {
+        Value value = read_value(most_common);
+        u_long count;
+        if (most_common.get() != '=' || !(most_common >> count))
+            throw DbRelationError("bad most_common in " + TABLE_NAME + " for " + table_name + "." + column_name);
+        statistics.most_common.push_back({value, count});
+        if (most_common.peek() == ',')
+            most_common.get();
+    }
+    while (histogram.peek() != EOF) {
+        statistics.histogram.push_back(read_value(histogram));
+        if (histogram.peek() == ',')
+            histogram.get();
+    }
+    return true;
+}
+
+// One update of the table's row per call, so callers count a whole statement's rows at once.
+void Statistics::count_changes(Identifier table_name, long rows_added, u_long rows_changed) {
+    ValueDict where = {{"table_name", Value(table_name)}, {"column_name", Value("")}};
+    Handles *handles = select(&where);
+    if (!handles->empty()) {
+        ValueDict *row = project(handles->front());
+        long row_count = std::max((*row)["row_count"].n + rows_added, 0L);
+        u_long changed_rows = (u_long) (*row)["changed_rows"].n + rows_changed;
+        delete row;
+        ValueDict new_values = {{"row_count", count_value((u_long) row_count)},
+                                {"changed_rows", count_value(changed_rows)}};
+        update(handles->front(), &new_values);
+    }
+    delete handles;
+}
+
+void Statistics::forget(Identifier table_name) {
+    ValueDict where = {{"table_name", Value(table_name)}};
+    Handles *handles = select(&where);
+    for (auto const &handle: *handles)
+        del(handle);
+    delete handles;
+}
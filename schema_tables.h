@@ -2,6 +2,8 @@
  * @file schema_tables.h - schema table classes:
  * 		Columns
  * 		Tables
+ * 		Indices
+ * 		Statistics
  * @author Kevin Lundeen
  * @see "Seattle University, CPSC5300, Winter 2023"
  */
@@ -126,9 +128,11 @@ public:
      * @param is_hash         returned by reference: set to False if the
      *                        requested index is a btree index
      * @param is_unique       search key for this index is a key for the relation
+     * @param include_columns  if not nullptr, returned by reference: list of the columns the index's entries
+     *                         hold besides the search key (their rows in _indices have seq_in_index -1, -2, ...)
      */
     virtual void get_columns(Identifier table_name, Identifier index_name, ColumnNames& column_names, bool& is_hash,
-                             bool& is_unique);
+                             bool& is_unique, ColumnNames* include_columns = nullptr);
 
     /**
      * Get the instantiated DbIndex for the given index.
@@ -157,4 +161,108 @@ protected:
 
 private:
     static std::map<std::pair<Identifier, Identifier>, DbIndex*> index_cache;
-};
\ No newline at end of file
+};
+
+
+/**
+ * @class ColumnStatistics - what ANALYZE found out about the values of one column, from a sample of its rows
+ */
+class ColumnStatistics {
+public:
+    ColumnStatistics() : row_count(0), n_distinct(0), most_common(), histogram() {}
+
+    u_long row_count;   // rows in the table when it was analyzed
+    u_long n_distinct;  // estimated number of distinct values
+    std::vector<std::pair<Value, u_long>> most_common;  // most common values, with the estimated rows of each
+    std::vector<Value> histogram;  // in order, bounds of buckets holding equal shares of the other values
+
+    /**
+     * Estimate the share of the rows that have a given value.
+     * @param value  the value
+     * @returns      from 0 to 1
+     */
+    double equal_fraction(const Value &value) const;
+
+    /**
+     * Estimate the share of the rows that have a value in a given range: the most common values in it, and
+     * the part of the histogram it spans (in proportion within a bucket of INTs, half a bucket otherwise).
+     * @param range  the range
+     * @returns      from 0 to 1
+     */
+    double range_fraction(const ValueRange &range) const;
+
+protected:
+    double histogram_below(const Value &value) const;  // share of the histogram's values less than value
+};
+
+
+/**
+ * @class Statistics - The singleton table that stores what ANALYZE found out about each table.
+ * Each analyzed table has a row with an empty column_name, holding its row and block counts and the rows
+ * inserted, deleted and updated since, and a row for each of its columns, holding a ColumnStatistics. The
+ * row_count of the table's row is kept up to date by count_changes; the other counts are as of ANALYZE.
+ * The most common values and the histogram bounds are kept as text: a comma-separated list of values (TEXT in
+ * double quotes), each followed by "=" and its row count in the case of the most common values.
+ */
+class Statistics : public HeapTable {
+public:
+    /**
+     * Name of the statistics table ("_statistics")
+     */
+    static const Identifier TABLE_NAME;
+
+    static const uint SAMPLE_SIZE = 30000U;  // rows (and blocks) ANALYZE reads at most
+    static const uint MOST_COMMON = 10U;  // most common values kept for a column
+    static const uint HISTOGRAM_BUCKETS = 20U;  // histogram buckets for the rest of a column's values
+
+    // ctor/dtor
+    Statistics();
+
+    virtual ~Statistics() {}
+
+    /**
+     * ANALYZE a table: sample its rows and replace its rows here with what they show.
+     * @param table_name  name of the table
+     * @param table       the table
+     * @param sampled     returned by reference: number of rows sampled
+     */
+    virtual void analyze(Identifier table_name, DbRelation& table, u_long& sampled);
+
+    /**
+     * Get the size of an analyzed table.
+     * @param table_name    table to look up
+     * @param row_count     returned by reference: estimated rows in the table now
+     * @param page_count    returned by reference: blocks in the table when it was analyzed
+     * @param changed_rows  returned by reference: rows inserted, deleted or updated since it was analyzed
+     * @returns             false if the table has not been analyzed
+     */
+    virtual bool get_table(Identifier table_name, u_long& row_count, uint& page_count, u_long& changed_rows);
+
+    /**
+     * Get the statistics of a column of an analyzed table.
+     * @param table_name   table to look up
+     * @param column_name  column to look up
+     * @param statistics   returned by reference: the column's statistics
+     * @returns            false if the table has not been analyzed
+     */
+    virtual bool get_column(Identifier table_name, Identifier column_name, ColumnStatistics& statistics);
+
+    /**
+     * Count rows changed in a table since it was analyzed. Nothing to do if it has not been.
+     * @param table_name    the table
+     * @param rows_added    rows inserted (or, if negative, deleted)
+     * @param rows_changed  rows inserted, deleted or updated
+     */
+    virtual void count_changes(Identifier table_name, long rows_added, u_long rows_changed);
+
+    /**
+     * Remove the statistics of a table (it is being dropped).
+     * @param table_name  the table
+     */
+    virtual void forget(Identifier table_name);
+
+protected:
+    static ColumnNames& COLUMN_NAMES();
+
+    static ColumnAttributes& COLUMN_ATTRIBUTES();
+};
@@ -6,10 +6,14 @@
 
 #include <cstdlib>
 #include <iostream>
+#include <regex>
+#include <sstream>
+#include <stdexcept>
 #include <string>
 #include "db_cxx.h"
 #include "ParseTreeToString.h"
 #include "SQLExec.h"
+#include "BufferPool.h"
 #include "tests.h"
 
 using namespace std;
@@ -17,7 +21,7 @@ using namespace hsql;
 
 DbEnv* _DB_ENV; // Global DB environment
 const u_int32_t ENV_FLAGS = DB_CREATE | DB_INIT_MPOOL;
-const std::string TEST = "test", QUIT = "quit";
+const std::string TEST = "test", STATS = "stats", QUIT = "quit";
 
 /**
  * Establishes a database environment
@@ -42,17 +46,74 @@ void handleSQL(string);
  */
 void handleStatements(SQLParserResult*);
 
+/**
+ * Processes a CREATE INDEX statement ending with an INCLUDE (columns) clause, which the parser does not know
+ * @param sql A SQL query that the parser rejected
+ * @return false if sql is not such a statement
+ */
+bool handleCreateIndexInclude(string);
+
+/**
+ * Processes a CREATE TABLE statement ending with a WITH (PAGE_SIZE = n) clause, which the parser does not know
+ * @param sql A SQL query that the parser rejected
+ * @return false if sql is not such a statement
+ */
+bool handleCreateTableWith(string);
+
+/**
+ * Processes a COPY table FROM 'file' statement, which the parser knows as IMPORT FROM CSV FILE 'file' INTO table
+ * @param sql A SQL query that the parser rejected
+ * @return false if sql is not such a statement
+ */
+bool handleCopy(string);
+
+/**
+ * Processes a VACUUM table statement, which the parser does not know
+ * @param sql A SQL query that the parser rejected
+ * @return false if sql is not such a statement
+ */
+bool handleVacuum(string);
+
+/**
+ * Processes an ANALYZE table statement, which the parser does not know
+ * @param sql A SQL query that the parser rejected
+ * @return false if sql is not such a statement
+ */
+bool handleAnalyze(string);
+
+/**
+ * Processes an EXPLAIN statement, which the parser does not know
+ * @param sql A SQL query that the parser rejected
+ * @return false if sql is not such a statement
+ */
+bool handleExplain(string);
+
 /**
  * Main entry point of the sql5300 program
  * @args dbenvpath  the path to the BerkeleyDB database environment
+ * @args frames     (optional) number of block frames in the buffer pool
  */
 int main(int argc, char** argv) {
-    if (argc != 2) {
-        cerr << "USAGE: " << argv[0] << " [db_environment]\n";
+    if (argc != 2 && argc != 3) {
+        cerr << "USAGE: " << argv[0] << " [db_environment] [buffer_frames]\n";
         return EXIT_FAILURE;
     }
+    if (argc == 3) {
+        try {
+            string frames = argv[2];
+            size_t end;
+            unsigned long capacity = stoul(frames, &end);
+            if (end != frames.size() || frames[0] == '-' || capacity > UINT32_MAX)
+                throw invalid_argument(frames);
+            BufferPool::instance().set_capacity((uint) capacity);
+        } catch (exception& e) {  // not a number, or not a number of frames the pool can have
+            cerr << "USAGE: " << argv[0] << " [db_environment] [buffer_frames]\n";
+            return EXIT_FAILURE;
+        }
+    }
     initDbEnv(argv[1]);
     runSQLShell();
+    BufferPool::instance().checkpoint();  // write back whatever is still dirty
     return EXIT_SUCCESS;
 }
 
@@ -88,7 +149,14 @@ void handleSQL(std::string sql) {
         cout << "test_heap_storage: " << (test_heap_storage() ? "Passed" : "Failed") << endl;
         cout << "test_sql_exec: " << (test_sql_exec() ? "Passed" : "Failed") << endl;
         cout << "test_btree: " << (test_btree() ? "Passed" : "Failed") << endl;
-    } else
+        cout << "test_hash_index: " << (test_hash_index() ? "Passed" : "Failed") << endl;
+        cout << "test_buffer_pool: " << (test_buffer_pool() ? "Passed" : "Failed") << endl;
+        cout << "test_row_codec: " << (test_row_codec() ? "Passed" : "Failed") << endl;
+    } else if (sql == STATS)
+        cout << "buffer pool (" << BufferPool::instance().get_capacity() << " frames): "
+             << BufferPool::instance().get_stats() << endl;
+    else if (!handleCreateIndexInclude(sql) && !handleCreateTableWith(sql) && !handleCopy(sql) && !handleVacuum(sql) &&
+             !handleAnalyze(sql) && !handleExplain(sql))
         cerr << "invalid SQL: " << sql << endl << parsedSQL->errorMsg() << endl;
     delete parsedSQL;
 }
@@ -106,4 +174,131 @@ void handleStatements(hsql::SQLParserResult* parsedSQL) {
             cerr << "Error: " << e.what() << endl;
         }
     }
-}
\ No newline at end of file
+}
+
+bool handleCreateIndexInclude(std::string sql) {
+    static const regex INCLUDE_CLAUSE("\\s*(CREATE\\s+INDEX\\s.*\\))\\s*INCLUDE\\s*\\(([^()]*)\\)\\s*;?\\s*",
+                                      regex::icase);
+    smatch match;
+    if (!regex_match(sql, match, INCLUDE_CLAUSE))
+        return false;
+    SQLParserResult* const parsedSQL = SQLParser::parseSQLString(match[1].str());
+    if (!parsedSQL->isValid() || parsedSQL->size() != 1) {
+        delete parsedSQL;
+        return false;
+    }
+    ColumnNames include_columns;
+    stringstream columns(match[2].str());
+    string column, included;
+    while (getline(columns, column, ',')) {
+        size_t start = column.find_first_not_of(" \t"), end = column.find_last_not_of(" \t");
+        include_columns.push_back(start == string::npos ? "" : column.substr(start, end - start + 1));
+        included += (included.empty() ? "" : ", ") + include_columns.back();
+    }
+    const SQLStatement* statement = parsedSQL->getStatement(0);
+    try {
+        cout << ParseTreeToString::statement(statement) << " INCLUDE (" << included << ")" << endl;
+        QueryResult* result = SQLExec::execute(statement, include_columns);
+        cout << *result << endl;
+        delete result;
+    } catch (SQLExecError& e) {
+        cerr << "Error: " << e.what() << endl;
+    }
+    delete parsedSQL;
+    return true;
+}
+
+bool handleCreateTableWith(std::string sql) {
+    static const regex WITH_CLAUSE("\\s*(CREATE\\s+TABLE\\s.*\\))\\s*WITH\\s*\\(\\s*PAGE_SIZE\\s*=\\s*(\\d+)\\s*\\)\\s*;?\\s*",
+                                   regex::icase);
+    smatch match;
+    if (!regex_match(sql, match, WITH_CLAUSE))
+        return false;
+    SQLParserResult* const parsedSQL = SQLParser::parseSQLString(match[1].str());
+    if (!parsedSQL->isValid() || parsedSQL->size() != 1) {
+        delete parsedSQL;
+        return false;
+    }
+    const SQLStatement* statement = parsedSQL->getStatement(0);
+    try {
+        uint page_size = (uint) stoul(match[2].str());
+        cout << ParseTreeToString::statement(statement) << " WITH (PAGE_SIZE = " << page_size << ")" << endl;
+        QueryResult* result = SQLExec::execute(statement, page_size);
+        cout << *result << endl;
+        delete result;
+    } catch (SQLExecError& e) {
+        cerr << "Error: " << e.what() << endl;
+    } catch (out_of_range& e) {
+        cerr << "Error: page size " << match[2].str() << " is out of range" << endl;
+    }
+    delete parsedSQL;
+    return true;
+}
+
+bool handleCopy(std::string sql) {
+    static const regex COPY("\\s*COPY\\s+(\\w+)\\s+FROM\\s+'([^']*)'\\s*;?\\s*", regex::icase);
+    smatch match;
+    if (!regex_match(sql, match, COPY))
+        return false;
+    SQLParserResult* const parsedSQL =
+            SQLParser::parseSQLString("IMPORT FROM CSV FILE '" + match[2].str() + "' INTO " + match[1].str());
+    bool valid = parsedSQL->isValid();
+    if (valid)
+        handleStatements(parsedSQL);
+    delete parsedSQL;
+    return valid;
+}
+
+bool handleVacuum(std::string sql) {
+    static const regex VACUUM("\\s*VACUUM\\s+(\\w+)\\s*;?\\s*", regex::icase);
+    smatch match;
+    if (!regex_match(sql, match, VACUUM))
+        return false;
+    try {
+        cout << "VACUUM " << match[1].str() << endl;
+        QueryResult* result = SQLExec::vacuum(match[1].str());
+        cout << *result << endl;
+        delete result;
+    } catch (SQLExecError& e) {
+        cerr << "Error: " << e.what() << endl;
+    }
+    return true;
+}
+
+bool handleAnalyze(std::string sql) {
+    static const regex ANALYZE("\\s*ANALYZE\\s+(\\w+)\\s*;?\\s*", regex::icase);
+    smatch match;
+    if (!regex_match(sql, match, ANALYZE))
+        return false;
+    try {
+        cout << "ANALYZE " << match[1].str() << endl;
+        QueryResult* result = SQLExec::analyze(match[1].str());
+        cout << *result << endl;
+        delete result;
+    } catch (SQLExecError& e) {
+        cerr << "Error: " << e.what() << endl;
+    }
+    return true;
+}
+
+bool handleExplain(std::string sql) {
+    static const regex EXPLAIN("\\s*EXPLAIN\\s+(.*)", regex::icase);
+    smatch match;
+    if (!regex_match(sql, match, EXPLAIN))
+        return false;
+    SQLParserResult* const parsedSQL = SQLParser::parseSQLString(match[1].str());
+    bool valid = parsedSQL->isValid() && parsedSQL->size() == 1;
+    if (valid) {
+        const SQLStatement* statement = parsedSQL->getStatement(0);
+        try {
+            cout << "EXPLAIN " << ParseTreeToString::statement(statement) << endl;
+            QueryResult* result = SQLExec::explain(statement);
+            cout << *result << endl;
+            delete result;
+        } catch (SQLExecError& e) {
+            cerr << "Error: " << e.what() << endl;
+        }
+    }
+    delete parsedSQL;
+    return valid;
+}
@@ -5,6 +5,7 @@
  */
 
 #include <algorithm>
+#include <random>
 #include "storage_engine.h"
 
 bool Value::operator==(const Value& other) const {
@@ -49,6 +50,42 @@ std::ostream &operator<<(std::ostream &out, const Value &value) {
     return out;
 }
 
+void ValueRange::restrict_min(const Value& value, bool inclusive) {
+    if (!this->has_min || this->min < value || (!(value < this->min) && !inclusive)) {
+        this->min = value;
+        this->min_inclusive = inclusive;
+    }
+    this->has_min = true;
+}
+
+void ValueRange::restrict_max(const Value& value, bool inclusive) {
+    if (!this->has_max || value < this->max || (!(this->max < value) && !inclusive)) {
+        this->max = value;
+        this->max_inclusive = inclusive;
+    }
+    this->has_max = true;
+}
+
+bool ValueRange::contains(const Value& value) const {
+    if (this->has_min && (value.data_type != this->min.data_type || value < this->min ||
+                          (!this->min_inclusive && !(this->min < value))))
+        return false;
+    if (this->has_max && (value.data_type != this->max.data_type || this->max < value ||
+                          (!this->max_inclusive && !(value < this->max))))
+        return false;
+    return true;
+}
+
+std::ostream &operator<<(std::ostream &out, const ValueRange &range) {
+    if (range.has_min)
+        out << (range.min_inclusive ? ">= " : "> ") << range.min;
+    if (range.has_min && range.has_max)
+        out << " and ";
+    if (range.has_max)
+        out << (range.max_inclusive ? "<= " : "< ") << range.max;
+    return out;
+}
+
 // Get only selected column attributes
 ColumnAttributes* DbRelation::get_column_attributes(const ColumnNames& select_column_names) const {
     ColumnAttributes* ret = new ColumnAttributes();
@@ -64,6 +101,69 @@ ColumnAttributes* DbRelation::get_column_attributes(const ColumnNames& select_co
     return ret;
 }
 
+// Only the default block size, unless a subclass says otherwise.
+void DbRelation::create(uint block_size) {
+    if (block_size != DbBlock::BLOCK_SZ)
+        throw DbRelationError("table " + this->table_name + " cannot have " + std::to_string(block_size) +
+                              "-byte blocks");
+    this->create();
+}
+
+// One insert per row; subclasses override this to fill blocks in bulk.
+Handles* DbRelation::insert_batch(const ValueDicts* rows) {
+    Handles* handles = new Handles();
+    try {
+        for (auto const row: *rows)
+            handles->push_back(this->insert(row));
+    } catch (...) {
+        delete handles;
+        throw;
+    }
+    return handles;
+}
+
+// Reservoir sampling over a scan of every row (the same seed each time, so the same rows give the same sample).
+ValueDicts* DbRelation::sample(uint max_rows, u_long& row_count, uint& page_count) {
+    std::mt19937 random(5300);
+    Handles handles;
+    Handle handle;
+    row_count = 0;
+    HandleCursor* cursor = this->scan();
+    while (cursor->next(handle)) {
+        row_count++;
+        if (handles.size() < max_rows) {
+            handles.push_back(handle);
+        } else {
+            u_long i = std::uniform_int_distribution<u_long>(0, row_count - 1)(random);
+            if (i < max_rows)
+                handles[i] = handle;
+        }
+    }
+    delete cursor;
+    page_count = 0;
+    return this->project(&handles);
+}
+
+// Nothing is ever picked to move unless a subclass overrides vacuum_rows too.
+Handles* DbRelation::vacuum_move(const Handles* handles) {
+    throw DbRelationError("table " + this->table_name + " cannot be vacuumed");
+}
+
+// Materializes the selection; subclasses override this to really stream.
+HandleCursor* DbRelation::scan(const ValueDict* where) {
+    return new HandlesCursor(where == nullptr ? this->select() : this->select(where));
+}
+
+// Materializes the source and the selection; subclasses override this to really stream.
+HandleCursor* DbRelation::scan(HandleCursor* source, const ValueDict* where) {
+    Handles handles;
+    Handle handle;
+    while (source->next(handle))
+        handles.push_back(handle);
+    delete source;
+    return new HandlesCursor(this->select(&handles, where));
+}
+
 // Just pulls out the column names from a ValueDict and passes that to the usual form of project().
 ValueDict* DbRelation::project(Handle handle, const ValueDict* where) {
     ColumnNames t;
@@ -93,8 +193,11 @@ ValueDicts* DbRelation::project(Handles* handles, const ValueDict* where) {
     ColumnNames t;
     for (auto const& column: *where)
         t.push_back(column.first);
-    ValueDicts* ret = new ValueDicts();
-    for (auto const& handle: *handles)
-        ret->push_back(project(handle, &t));
-    return ret;
-}
\ No newline at end of file
+    return project(handles, &t);
+}
+
+// One insert per record; subclasses override this to insert in bulk.
+void DbIndex::insert_batch(const Handles* records) {
+    for (auto const& record: *records)
+        this->insert(record);
+}
@@ -43,14 +43,20 @@ using DbBlockNoRoomError = std::length_error;
  * 	get_block()
  * 	get_data()
  * 	get_block_id()
+ * 	get_block_size()
  */
 class DbBlock {
 public:
     /**
-     * our blocks are 4kB
+     * our blocks are 4kB unless their file was created with another size
      */
     static const uint BLOCK_SZ = 4096;
 
+    /**
+     * largest block a file can have (so an offset within a block fits in 16 bits)
+     */
+    static const uint MAX_BLOCK_SZ = 65536;
+
     /**
      * ctor/dtor (subclasses should handle the big-5)
      */
@@ -129,13 +135,52 @@ public:
      */
     virtual BlockID get_block_id() { return block_id; }
 
+    /**
+     * Get the size of this block (that of all the blocks in its DbFile).
+     * @returns  number of bytes
+     */
+    uint get_block_size() const { return block.get_size(); }
+
 protected:
     Dbt block;
     BlockID block_id;
 };
 
 // convenience type alias
-using BlockIDs = std::vector<BlockID>;  // FIXME: will need to turn this into an iterator at some point
+using BlockIDs = std::vector<BlockID>;  // prefer a BlockIDRange (no list to build) where there is one
+
+/**
+ * @class BlockIDRange - consecutive block ids first..last, for range-based for loops without a BlockIDs list
+ */
+class BlockIDRange {
+public:
+    class iterator {
+    public:
+        iterator(BlockID block_id) : block_id(block_id) {}
+
+        BlockID operator*() const { return block_id; }
+
+        iterator& operator++() {
+            block_id++;
+            return *this;
+        }
+
+        bool operator!=(const iterator& other) const { return block_id != other.block_id; }
+
+    protected:
+        BlockID block_id;
+    };
+
+    BlockIDRange(BlockID first, BlockID last) : first(first), last(last) {}
+
+    iterator begin() const { return iterator(first); }
+
+    iterator end() const { return iterator(last + 1); }
+
+protected:
+    BlockID first;
+    BlockID last;
+};
 
 /**
  * @class DbFile - abstract base class which represents a disk-based collection of DbBlocks
@@ -259,11 +304,94 @@ using Identifier = std::string;
 using ColumnNames = std::vector<Identifier>;
 using ColumnAttributes = std::vector<ColumnAttribute>;
 using Handle = std::pair<BlockID, RecordID>;
-using Handles = std::vector<Handle>;  // FIXME: will need to turn this into an iterator at some point
+using Handles = std::vector<Handle>;  // prefer a HandleCursor (no list to build) where there is one
 using ValueDict = std::map<Identifier, Value>;
 using ValueDicts = std::vector<ValueDict*>;
 
 
+/**
+ * @class ValueRange - the values between two bounds, either of which may be missing (a range predicate)
+ */
+class ValueRange {
+public:
+    ValueRange() : has_min(false), min(), min_inclusive(true), has_max(false), max(), max_inclusive(true) {}
+
+    bool has_min;
+    Value min;
+    bool min_inclusive;
+    bool has_max;
+    Value max;
+    bool max_inclusive;
+
+    /**
+     * Add a lower bound (column > value, or column >= value), keeping whichever bound is tighter.
+     */
+    void restrict_min(const Value& value, bool inclusive);
+
+    /**
+     * Add an upper bound (column < value, or column <= value), keeping whichever bound is tighter.
+     */
+    void restrict_max(const Value& value, bool inclusive);
+
+    /**
+     * Whether a value is in the range. A value of another data type than a bound never is (as with Value::operator==).
+     */
+    bool contains(const Value& value) const;
+
+    friend std::ostream& operator<<(std::ostream& out, const ValueRange& range);  // e.g. "> 3 and <= 9"
+};
+
+using ValueRanges = std::map<Identifier, ValueRange>;
+
+
+/**
+ * @class HandleCursor - forward-only stream of the handles of qualifying rows
+ *
+ * Produces handles one at a time as they are found so the caller can start on the first row right away
+ * and nobody holds the whole list.
+ */
+class HandleCursor {
+public:
+    virtual ~HandleCursor() {}
+
+    /**
+     * Get the next handle.
+     * @param handle  returned by reference: the next qualifying row
+     * @returns       false if there are no more rows (handle is then unchanged)
+     */
+    virtual bool next(Handle& handle) = 0;
+};
+
+
+/**
+ * @class HandlesCursor - HandleCursor over an already built list of handles
+ */
+class HandlesCursor : public HandleCursor {
+public:
+    /**
+     * @param handles  list to go through (freed by this cursor)
+     */
+    HandlesCursor(Handles* handles) : handles(handles), i(0) {}
+
+    virtual ~HandlesCursor() { delete handles; }
+
+    HandlesCursor(const HandlesCursor& other) = delete;
+
+    HandlesCursor& operator=(const HandlesCursor& other) = delete;
+
+    virtual bool next(Handle& handle) {
+        if (i >= handles->size())
+            return false;
+        handle = (*handles)[i++];
+        return true;
+    }
+
+protected:
+    Handles* handles;
+    size_t i;
+};
+
+
 /**
  * @class DbRelationError - generic exception class for DbRelation
  */
@@ -285,12 +413,16 @@ public:
  * 	close()
  * 	
  *	insert(row)
+ *	insert_batch(rows)
  *	update(handle, new_values)
+ *	vacuum_rows(max_rows), vacuum_move(handles), vacuum_truncate()
  *	del(handle)
  *	select()
  *	select(where)
+ *	scan(where)
  *	project(handle)
  *	project(handle, column_names)
+ *	sample(max_rows, row_count, page_count)
  */
 class DbRelation {
 public:
@@ -306,6 +438,14 @@ public:
      */
     virtual void create() = 0;
 
+    /**
+     * Execute: CREATE TABLE <table_name> ( <columns> ) WITH (PAGE_SIZE = <block_size>)
+     * Assumes the metadata and validation are already done.
+     * @param block_size  bytes per block of the relation's file
+     * @throws            DbRelationError if the relation cannot have blocks of that size
+     */
+    virtual void create(uint block_size);
+
     /**
      * Execute: CREATE TABLE IF NOT EXISTS <table_name> ( <columns> )
      * Assumes the metadata and validate are already done.
@@ -336,6 +476,14 @@ public:
      */
     virtual Handle insert(const ValueDict* row) = 0;
 
+    /**
+     * Insert many rows at once (bulk load). This default inserts them one at a time; subclasses that can fill
+     * their blocks more cheaply should override it.
+     * @param rows  dictionaries keyed by column names
+     * @returns     handles to the new rows, in the same order as rows (freed by caller)
+     */
+    virtual Handles* insert_batch(const ValueDicts* rows);
+
     /**
      * Conceptually, execute: UPDATE INTO <table_name> SET <new_values> WHERE <handle>
      * where handle is sufficient to identify one specific record (e.g., returned
@@ -375,6 +523,22 @@ public:
      */
     virtual Handles* select(Handles* current_selection, const ValueDict* where) = 0;
 
+    /**
+     * Streaming version of select(where). This default just wraps the list from select; subclasses
+     * that can find rows one at a time should override it.
+     * @param where  where-clause predicates (nullptr for every row)
+     * @returns      cursor over the handles of qualifying rows (freed by caller)
+     */
+    virtual HandleCursor* scan(const ValueDict* where = nullptr);
+
+    /**
+     * Streaming version of select(current_selection, where).
+     * @param source  cursor over the rows to restrict the selection to (freed by the returned cursor)
+     * @param where   where-clause predicates
+     * @returns       cursor over the handles of qualifying rows (freed by caller)
+     */
+    virtual HandleCursor* scan(HandleCursor* source, const ValueDict* where);
+
 
     /**
      * Return a sequence of all values for handle (SELECT *).
@@ -408,6 +572,45 @@ public:
 
     virtual ValueDicts* project(Handles* handles, const ValueDict* column_names);
 
+    /**
+     * Pick rows at random for ANALYZE, each row as likely as any other. This default reads every row; subclasses
+     * override it to read only some of their blocks.
+     * @param max_rows    most rows to pick
+     * @param row_count   returned by reference: estimate of how many rows the relation has
+     * @param page_count  returned by reference: blocks the relation takes (0 if it does not know)
+     * @returns           the picked rows, in no particular order (freed by caller)
+     */
+    virtual ValueDicts* sample(uint max_rows, u_long& row_count, uint& page_count);
+
+    /**
+     * VACUUM, one chunk at a time. Pick rows at the end of the relation that can move into room nearer its start.
+     * The caller takes the rows' index entries out, calls vacuum_move, puts the entries back under the new
+     * handles, and calls vacuum_truncate to give back the blocks that are now empty; then picks the next chunk.
+     * This default finds nothing to move.
+     * @param max_rows  most rows to pick
+     * @returns         handles of the rows to move, empty once there is nothing left to move (freed by caller)
+     */
+    virtual Handles* vacuum_rows(uint max_rows) { return new Handles(); }
+
+    /**
+     * Move the rows picked by vacuum_rows.
+     * @param handles  rows to move
+     * @returns        their new handles, in the same order (freed by caller)
+     */
+    virtual Handles* vacuum_move(const Handles* handles);
+
+    /**
+     * Give back the empty blocks at the end of the relation.
+     * @returns  number of blocks given back
+     */
+    virtual uint vacuum_truncate() { return 0; }
+
+    /**
+     * Size of the blocks the relation is kept in (indices on it use the same size).
+     * @returns  number of bytes
+     */
+    virtual uint get_block_size() { return DbBlock::BLOCK_SZ; }
+
     /**
      * Accessor for column_names.
      * @returns column_names   list of column names for this relation, in order
@@ -499,6 +702,40 @@ public:
         throw DbRelationError("range index query not supported");
     }
 
+    /**
+     * Streaming lookup of a range of search keys, in key order.
+     * @param min_key        dictionary of min search key, or nullptr for no lower bound
+     * @param min_inclusive  true if rows with key min_key are in the range
+     * @param max_key        dictionary of max search key, or nullptr for no upper bound
+     * @param max_inclusive  true if rows with key max_key are in the range
+     * @returns              cursor over DbFile handles for records in range (freed by caller, while the
+     *                       index is open)
+     */
+    virtual HandleCursor* range_scan(const ValueDict* min_key, bool min_inclusive, const ValueDict* max_key,
+                                     bool max_inclusive) const {
+        throw DbRelationError("range index query not supported");
+    }
+
+    /**
+     * Whether the index's entries hold the values of the given columns (see lookup_covered).
+     * @param column_names  columns wanted
+     * @returns             true if each one is a key column or one of the index's included columns
+     */
+    virtual bool covers(const ColumnNames& column_names) const {
+        return false;
+    }
+
+    /**
+     * Lookup a specific search key and read the values of some columns from the index entries themselves,
+     * without touching the relation (an index-only lookup).
+     * @param key_values    dictionary of values for the search key
+     * @param column_names  columns to get, all of them covered by the index
+     * @returns             values of column_names for each record with key_values (freed by caller)
+     */
+    virtual ValueDicts* lookup_covered(ValueDict* key_values, const ColumnNames& column_names) const {
+        throw DbRelationError("index-only lookup not supported");
+    }
+
     /**
      * Insert the index entry for the given record.
      * @param record  handle (into relation) to the record to insert
@@ -506,6 +743,13 @@ public:
      */
     virtual void insert(Handle record) = 0;
 
+    /**
+     * Insert the index entries for many records at once. This default inserts them one at a time.
+     * @param records  handles (into relation) to the records to insert
+     *                 (all of them must be in the relation at time of insertion)
+     */
+    virtual void insert_batch(const Handles* records);
+
     /**
      * Delete the index entry for the given record.
      * @param record  handle (into relation) to the record to remove
@@ -513,6 +757,30 @@ public:
      */
     virtual void del(Handle record) = 0;
 
+    /**
+     * Accessor for key_columns.
+     * @returns  the columns of the search key, in order
+     */
+    virtual const ColumnNames& get_key_columns() const {
+        return key_columns;
+    }
+
+    /**
+     * Accessor for name.
+     * @returns  index name (unique by table)
+     */
+    virtual Identifier get_name() const {
+        return name;
+    }
+
+    /**
+     * Accessor for unique.
+     * @returns  true if the search key is a key for the relation
+     */
+    virtual bool is_unique() const {
+        return unique;
+    }
+
 protected:
     DbRelation &relation;
     Identifier name;
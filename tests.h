@@ -5,14 +5,23 @@
  */
 
 #pragma once
+#include <algorithm>
 #include <iostream>
+#include <chrono>
+#include <cstdio>
 #include <cstring>
+#include <fstream>
+#include <set>
 #include "db_cxx.h"
 #include "SlottedPage.h"
+#include "HeapFile.h"
 #include "HeapTable.h"
+#include "BufferPool.h"
+#include "RowCodec.h"
 #include "SQLExec.h"
 #include "ParseTreeToString.h"
 #include "btree.h"
+#include "HashIndex.h"
 
 
 /**
@@ -77,7 +86,7 @@ bool test_slotted_page() {
     if (expected != actual)
         return assertion_failure("get 2 back " + actual);
 
-    // test put with expansion (and slide and ids)
+    // test put with expansion (and compact and ids)
     char rec1_rev[] = "something much bigger";
     rec1_dbt = Dbt(rec1_rev, sizeof(rec1_rev));
     slot.put(1, rec1_dbt);
@@ -95,7 +104,7 @@ bool test_slotted_page() {
     if (expected != actual)
         return assertion_failure("get 1 back after expanding put of 1 " + actual);
 
-    // test put with contraction (and slide and ids)
+    // test put with contraction (and ids)
     rec1_dbt = Dbt(rec1, sizeof(rec1));
     slot.put(1, rec1_dbt);
     // check both rec2 and rec1 after contracting put
@@ -138,6 +147,46 @@ bool test_slotted_page() {
         return assertion_failure("wrong type thrown when add too big");
     }
 
+    // deletes leave dead bytes until an add needs them
+    char lazy_space[DbBlock::BLOCK_SZ];
+    Dbt lazy_dbt(lazy_space, sizeof(lazy_space));
+    SlottedPage lazy(lazy_dbt, 2, true);
+    char filler[100];
+    RecordID n_lazy = 0;
+    try {
+        for (;; n_lazy++) {
+            std::memset(filler, 'a' + n_lazy % 26, sizeof(filler));
+            Dbt filler_dbt(filler, sizeof(filler));
+            lazy.add(&filler_dbt);
+        }
+    } catch (DbBlockNoRoomError &exc) {
+        // full
+    }
+    u_int16_t full_unused = lazy.unused_bytes();
+    for (RecordID record_id = 1; record_id < n_lazy; record_id += 2)
+        lazy.del(record_id);
+    if (lazy.dead != (n_lazy / 2) * sizeof(filler) || lazy.unused_bytes() != full_unused + lazy.dead)
+        return assertion_failure("dead bytes after deletes", lazy.dead, lazy.unused_bytes());
+    char big[300];
+    std::memset(big, '#', sizeof(big));
+    Dbt big_dbt(big, sizeof(big));
+    RecordID big_id = lazy.add(&big_dbt);
+    if (lazy.dead != 0)
+        return assertion_failure("add did not compact", lazy.dead);
+    if (big_id % 2 != 1 || big_id >= n_lazy || lazy.num_records != n_lazy)
+        return assertion_failure("add did not reuse a deleted record id", big_id, lazy.num_records);
+    lazy.put(2, big_dbt);  // enlarge into the reclaimed space
+    for (RecordID record_id: lazy.records()) {
+        u_int16_t size;
+        const char *bytes = lazy.get_record(record_id, size);
+        char expected_byte = record_id == big_id || record_id == 2 ? '#' : (char) ('a' + (record_id - 1) % 26);
+        if (record_id % 2 == 1 && record_id != big_id && record_id != n_lazy)
+            return assertion_failure("deleted record still there", record_id);
+        if (size != (expected_byte == '#' ? sizeof(big) : sizeof(filler)) ||
+            bytes[0] != expected_byte || bytes[size - 1] != expected_byte)
+            return assertion_failure("record moved by compaction", record_id);
+    }
+
     // more volume
     std::string gettysburg = "Four score and seven years ago our fathers brought forth on this continent, a new nation, conceived in Liberty, and dedicated to the proposition that all men are created equal.";
     int32_t n = -1;
@@ -227,6 +276,225 @@ bool test_compare(DbRelation& table, Handle handle, int a, std::string b) {
     return true;
 }
 
+/**
+ * Test helper. Fills a block with rows, then updates them: in place while they fit, then growing one until it has
+ * to move to another block, growing it again where it moved, and shrinking it back home. The handle must find the
+ * row all along, and scans must see it just once, under that handle.
+ * @return  true if the tests all succeeded
+ */
+bool test_heap_update() {
+    ColumnNames column_names = {"a", "b"};
+    ColumnAttributes column_attributes = {ColumnAttribute(ColumnAttribute::INT), ColumnAttribute(ColumnAttribute::TEXT)};
+    HeapTable table("_test_update_cpp", column_names, column_attributes);
+    table.create();
+    Handles handles;
+    ValueDict row = {{"a", Value(0)}, {"b", Value(std::string(100, 'b'))}};
+    while (handles.empty() || handles.back().first == 1) {
+        row["a"] = Value((int) handles.size());
+        handles.push_back(table.insert(&row));
+    }
+    Handle target = handles[5];
+    auto b_of = [&table](Handle handle) {
+        ValueDict* result = table.project(handle);
+        std::string b = (*result)["b"].s;
+        delete result;
+        return b;
+    };
+    auto count_rows = [&table](const ValueDict* where) {
+        Handles* found = table.select(where);
+        u_long n = found->size();
+        delete found;
+        return n;
+    };
+
+    // same size and smaller stay put
+    ValueDict new_values = {{"b", Value(std::string(100, 'c'))}};
+    table.update(target, &new_values);
+    new_values["b"] = Value(std::string(10, 'd'));
+    table.update(target, &new_values);
+    if (b_of(target) != std::string(10, 'd') || b_of(handles[4]) != std::string(100, 'b'))
+        return assertion_failure("update in place");
+
+    // too big for its block: moves, but keeps its handle
+    for (uint size: {2000U, 3000U}) {
+        new_values["b"] = Value(std::string(size, 'e'));
+        table.update(target, &new_values);
+        if (b_of(target) != std::string(size, 'e'))
+            return assertion_failure("update of a row that moves", size);
+    }
+    ValueDict where = {{"b", Value(std::string(3000, 'e'))}};
+    Handles* found = table.select(&where);
+    bool found_once = found->size() == 1 && (*found)[0] == target;
+    delete found;
+    if (!found_once || count_rows(nullptr) != handles.size())
+        return assertion_failure("scan should see a moved row once, under its handle");
+    where = {{"a", Value(5)}};
+    if (count_rows(&where) != 1)
+        return assertion_failure("select of a moved row by another column");
+
+    // deletes make room at home, so it goes back there
+    table.del(handles[6]);
+    table.del(handles[7]);
+    new_values["b"] = Value(std::string(150, 'f'));
+    table.update(target, &new_values);
+    if (b_of(target) != std::string(150, 'f') || count_rows(nullptr) != handles.size() - 2)
+        return assertion_failure("update that moves a row back home");
+
+    // a deleted moved row is gone from both blocks
+    new_values["b"] = Value(std::string(3000, 'g'));
+    table.update(target, &new_values);
+    table.del(target);
+    if (count_rows(nullptr) != handles.size() - 3 || BufferPool::instance().get_pinned_count() != 0)
+        return assertion_failure("delete of a moved row");
+    try {
+        table.update(target, &new_values);
+        return assertion_failure("update of a deleted row should throw");
+    } catch (DbRelationError& e) {}
+    table.drop();
+    std::cout << "update ok" << std::endl;
+    return true;
+}
+
+/**
+ * Test helper. Fills six blocks, moves one row out of its block with an update, deletes most rows of the blocks in
+ * between, then vacuums the way VACUUM does: the tail rows must move forward under new handles, the moved row must
+ * keep its handle, and the emptied blocks at the end must be given back.
+ * @return  true if the tests all succeeded
+ */
+bool test_heap_vacuum() {
+    ColumnNames column_names = {"a", "b"};
+    ColumnAttributes column_attributes = {ColumnAttribute(ColumnAttribute::INT), ColumnAttribute(ColumnAttribute::TEXT)};
+    HeapTable table("_test_vacuum_cpp", column_names, column_attributes);
+    table.create();
+    Handles handles;
+    ValueDict row = {{"a", Value(0)}, {"b", Value(std::string(100, 'b'))}};
+    while (handles.empty() || handles.back().first < 6) {
+        row["a"] = Value((int) handles.size());
+        handles.push_back(table.insert(&row));
+    }
+    ValueDict new_values = {{"b", Value(std::string(3000, 'm'))}};
+    table.update(handles[5], &new_values);  // moves to the last block (or a new one)
+
+    std::map<int, Handle> live;  // a -> handle
+    for (uint i = 0; i < handles.size(); i++) {
+        BlockID block_id = handles[i].first;
+        if (block_id > 1 && block_id < 6 && i % 10 != 0)
+            table.del(handles[i]);
+        else
+            live[(int) i] = handles[i];
+    }
+
+    uint released = 0;
+    u_long moved_n = 0;
+    while (true) {
+        Handles* picked = table.vacuum_rows(7);
+        if (picked->empty()) {
+            delete picked;
+            break;
+        }
+        Handles* moved = table.vacuum_move(picked);
+        for (uint i = 0; i < picked->size(); i++) {
+            if ((*moved)[i] == (*picked)[i])
+                continue;
+            moved_n++;
+            for (auto& entry: live)
+                if (entry.second == (*picked)[i])
+                    entry.second = (*moved)[i];
+        }
+        delete picked;
+        delete moved;
+        released += table.vacuum_truncate();
+    }
+    released += table.vacuum_truncate();
+    if (moved_n == 0 || released == 0)
+        return assertion_failure("vacuum should move rows and release blocks", released);
+    if (live[5] != handles[5])
+        return assertion_failure("a moved row keeps its handle through vacuum");
+
+    // the file stays short once closed and opened again
+    table.close();
+    HeapFile file("_test_vacuum_cpp");
+    file.open();
+    BlockID last_block = file.get_last_block_id();
+    file.close();
+    if (last_block == 0 || last_block >= 6)
+        return assertion_failure("last block after reopening the vacuumed file", last_block);
+    table.open();
+    for (auto const& entry: live) {
+        if (entry.second.first >= 6)
+            return assertion_failure("row left in the tail", entry.first);
+        ValueDict* result = table.project(entry.second);
+        bool ok = (*result)["a"].n == entry.first &&
+                  (*result)["b"].s == std::string(entry.first == 5 ? 3000 : 100, entry.first == 5 ? 'm' : 'b');
+        delete result;
+        if (!ok)
+            return assertion_failure("row after vacuum", entry.first);
+    }
+    Handles* all = table.select();
+    bool all_ok = all->size() == live.size();
+    delete all;
+    if (!all_ok || BufferPool::instance().get_pinned_count() != 0)
+        return assertion_failure("scan after vacuum");
+
+    // inserts carry on into the shortened file
+    row["a"] = Value(-1);
+    Handle handle = table.insert(&row);
+    ValueDict* result = table.project(handle);
+    bool insert_ok = (*result)["a"].n == -1 && handle.first < 6;
+    delete result;
+    if (!insert_ok)
+        return assertion_failure("insert after vacuum");
+    table.drop();
+    std::cout << "vacuum ok (moved " << moved_n << " rows, released " << released << " blocks)" << std::endl;
+    return true;
+}
+
+/**
+ * Test helper. Two HeapTables on one file, as when a schema table is opened by SQLExec and again by
+ * Tables::get_table: each must see the rows the other adds and deletes, also once both are closed and reopened.
+ * @return  true if the tests all succeeded
+ */
+bool test_heap_two_tables() {
+    ColumnNames column_names = {"a", "b"};
+    ColumnAttributes column_attributes = {ColumnAttribute(ColumnAttribute::INT), ColumnAttribute(ColumnAttribute::TEXT)};
+    HeapTable* first = new HeapTable("_test_two_tables", column_names, column_attributes);
+    first->create();
+    HeapTable* second = new HeapTable("_test_two_tables", column_names, column_attributes);
+    second->open();  // while the file's only block is still empty
+
+    ValueDict row = {{"a", Value(1)}, {"b", Value("x")}};
+    first->insert(&row);
+    Handles* handles = second->select();
+    u_long found = handles->size();
+    delete handles;
+    if (found != 1)
+        return assertion_failure("row added through one table not seen through the other", found);
+
+    row["a"] = Value(2);
+    Handle handle = second->insert(&row);
+    first->del(handle);
+    handles = second->select();
+    found = handles->size();
+    delete handles;
+    if (found != 1)
+        return assertion_failure("rows after an insert and a delete through different tables", found);
+
+    first->close();
+    second->close();
+    delete first;
+    delete second;
+    HeapTable reopened("_test_two_tables", column_names, column_attributes);
+    reopened.open();
+    handles = reopened.select();
+    found = handles->size();
+    delete handles;
+    if (found != 1)
+        return assertion_failure("rows after reopening a file two tables had open", found);
+    reopened.drop();
+    std::cout << "two tables on one file ok" << std::endl;
+    return true;
+}
+
 /**
  * Testing function for heap storage engine.
  * @return true if the tests all succeeded
@@ -283,7 +551,65 @@ bool test_heap_storage() {
             return false;
     }
     std::cout << "many inserts/select/projects ok" << std::endl;
+
+    // batch projection reads each block once and keeps the handles' order
+    std::set<BlockID> block_ids;
+    for (auto const &handle: *handles)
+        block_ids.insert(handle.first);
+    Handles reversed(handles->rbegin(), handles->rend());
+    ColumnNames just_a = {"a"};
+    BufferPoolStats before = BufferPool::instance().get_stats();
+    ValueDicts* rows = table.project(&reversed, &just_a);
+    BufferPoolStats after = BufferPool::instance().get_stats();
+    if (after.hits + after.misses - before.hits - before.misses != block_ids.size())
+        return assertion_failure("batch projection did not read each block once",
+                                 after.hits + after.misses - before.hits - before.misses, block_ids.size());
+    if (rows->size() != reversed.size())
+        return assertion_failure("batch projection returned wrong number of rows", rows->size());
+    i = 999;
+    for (auto row: *rows) {
+        if (row->size() != 1 || (*row)["a"] != Value(i--))
+            return assertion_failure("batch projection out of order", i + 1);
+        delete row;
+    }
+    delete rows;
+    std::cout << "batch project ok" << std::endl;
+    delete handles;
+
+    ValueDict where;
+    where["a"] = Value(500);
+    where["c"] = Value(true);
+    where["c"].data_type = ColumnAttribute::BOOLEAN;
+    handles = table.select(&where);
+    if (handles->size() != 1 || !test_compare(table, (*handles)[0], 500, b))
+        return assertion_failure("select where a = 500 and c = true");
+    delete handles;
+    where["b"] = Value("no such string");
+    handles = table.select(&where);
+    if (handles->size() != 0)
+        return assertion_failure("select where on a text column that does not match");
     delete handles;
+    std::cout << "select where ok" << std::endl;
+
+    // a scan holds one block at a time and finds the same rows as select
+    HandleCursor* cursor = table.scan();
+    Handle handle;
+    uint n_scanned = 0;
+    while (cursor->next(handle)) {
+        if (BufferPool::instance().get_pinned_count() != 1)
+            return assertion_failure("scan should pin just one block", BufferPool::instance().get_pinned_count());
+        if (!test_compare(table, handle, n_scanned++ - 1, b))
+            return assertion_failure("scan returned wrong row", n_scanned);
+    }
+    delete cursor;
+    if (n_scanned != 1001 || BufferPool::instance().get_pinned_count() != 0)
+        return assertion_failure("scan returned wrong number of rows", n_scanned);
+    where.erase("b");
+    cursor = table.scan(new HandlesCursor(table.select()), &where);
+    if (!cursor->next(handle) || !test_compare(table, handle, 500, b) || cursor->next(handle))
+        return assertion_failure("scan of a cursor where a = 500 and c = true");
+    delete cursor;
+    std::cout << "scan ok" << std::endl;
 
     table.del(last_handle);
     handles = table.select();
@@ -295,9 +621,80 @@ bool test_heap_storage() {
             return false;
     }
     std::cout << "del ok" << std::endl;
-    table.drop();
     delete handles;
-    return true;
+
+    // inserts go into the room deletes leave
+    handles = table.select();
+    BlockID last_block = handles->back().first;
+    u_long n_deleted = 0;
+    for (u_long j = 0; j < handles->size(); j++)
+        if (j % 3 != 0) {
+            table.del((*handles)[j]);
+            n_deleted++;
+        }
+    delete handles;
+    for (u_long j = 0; j < n_deleted / 2; j++) {
+        test_set_row(row, (int) j, b);
+        Handle handle = table.insert(&row);
+        if (handle.first > last_block)
+            return assertion_failure("insert should reuse the room of deleted rows", handle.first, last_block);
+    }
+
+    // a scan does not read blocks with no rows left, and the map is still there after closing the table
+    handles = table.select();
+    for (auto const &handle: *handles)
+        if (handle.first != last_block)
+            table.del(handle);
+    delete handles;
+    table.close();
+    HeapTable reopened("_test_data_cpp", column_names, column_attributes);
+    reopened.open();
+    BufferPoolStats before_scan = BufferPool::instance().get_stats();
+    handles = reopened.select();
+    BufferPoolStats after_scan = BufferPool::instance().get_stats();
+    if (after_scan.hits + after_scan.misses - before_scan.hits - before_scan.misses != 1)
+        return assertion_failure("scan should only read the block with rows left",
+                                 after_scan.hits + after_scan.misses - before_scan.hits - before_scan.misses);
+    delete handles;
+    test_set_row(row, -1, b);
+    if (reopened.insert(&row).first != 1)
+        return assertion_failure("insert after reopening should go into the first block");
+    std::cout << "free space reuse ok" << std::endl;
+
+    // a batch fills blocks one after another, and a bad row in it leaves the table as it was
+    ValueDicts batch;
+    for (int j = 0; j < 500; j++) {
+        batch.push_back(new ValueDict());
+        test_set_row(*batch.back(), j, b);
+    }
+    handles = reopened.select();
+    u_long n_before_batch = handles->size();
+    delete handles;
+    Handles* batch_handles = reopened.insert_batch(&batch);
+    bool batch_ok = batch_handles->size() == batch.size();
+    for (u_long j = 0; batch_ok && j < batch_handles->size(); j++)
+        batch_ok = test_compare(reopened, (*batch_handles)[j], (int) j, b) &&
+                   (j == 0 || (*batch_handles)[j - 1].first <= (*batch_handles)[j].first);
+    delete batch_handles;
+    ValueDict short_row = {{"a", Value(0)}};
+    batch.push_back(&short_row);
+    try {
+        delete reopened.insert_batch(&batch);
+        batch_ok = false;
+    } catch (DbRelationError& e) {}
+    batch.pop_back();
+    for (auto row: batch)
+        delete row;
+    if (!batch_ok || BufferPool::instance().get_pinned_count() != 0)
+        return assertion_failure("insert_batch");
+    handles = reopened.select();
+    u_long n_after_batch = handles->size();
+    delete handles;
+    if (n_after_batch != n_before_batch + 500)
+        return assertion_failure("a rejected batch should add no rows", n_after_batch, n_before_batch);
+    std::cout << "insert batch ok" << std::endl;
+    reopened.drop();
+    return test_heap_update() && test_heap_vacuum() && test_heap_two_tables();
 }
 
 
@@ -345,7 +742,7 @@ bool test_show_columns_from_schema_tables() {
         return false;
     std::cout << *result << std::endl;
     rows = result->get_rows();
-    if (rows->size() != 3)
+    if (rows->size() != 4)
         return false;
     delete result;
 
@@ -499,6 +896,518 @@ bool test_delete() {
     return true;
 }
 
+/**
+ * Testing UPDATE: changing a column no index holds leaves the indices alone, changing an indexed one redoes the
+ * entries of just that index, and rows made too big for their block can still be found by their old handles
+ * @return true if the tests all succeeded
+ */
+bool test_update() {
+    std::cout << "\n=====================\n";
+    for (std::string sql: {"create table duck (id int, name text, pond int)",
+                           "create index duck_id on duck using btree (id)",
+                           "create index duck_pond on duck using multi_btree (pond)"}) {
+        QueryResult* result = parse(sql);
+        if (!result)
+            return false;
+        delete result;
+    }
+    for (int i = 0; i < 100; i++) {
+        QueryResult* result = parse("insert into duck values (" + std::to_string(i) + ", \"duck\", " +
+                                    std::to_string(i % 4) + ")");
+        if (!result)
+            return false;
+        delete result;
+    }
+    std::string long_name(2000, 'q');
+    std::vector<std::pair<std::string, std::string>> expected = {
+            {"update duck set name = \"" + long_name + "\" where pond = 3", "successfully updated 25 rows"},
+            {"update duck set pond = 5 where id = 7", "successfully updated 1 rows and 1 indices"},
+            {"update duck set name = \"mallard\", pond = 6 where pond = 5", "successfully updated 1 rows and 1 indices"}};
+    for (auto const& statement: expected) {
+        QueryResult* result = parse(statement.first);
+        if (!result)
+            return false;
+        std::cout << *result << std::endl;
+        bool ok = result->get_message() == statement.second;
+        delete result;
+        if (!ok)
+            return assertion_failure("update message: " + statement.second);
+    }
+    QueryResult* result = parse("select id, name from duck where pond = 6");
+    if (!result)
+        return false;
+    ValueDicts* rows = result->get_rows();
+    bool ok = rows->size() == 1 && rows->front()->at("id").n == 7 && rows->front()->at("name").s == "mallard";
+    delete result;
+    result = parse("select id from duck where pond = 3");
+    if (!result)
+        return false;
+    ok = ok && result->get_rows()->size() == 24;
+    delete result;
+    result = parse("select name from duck where id = 11");
+    if (!result)
+        return false;
+    ok = ok && result->get_rows()->size() == 1 && result->get_rows()->front()->at("name").s == long_name;
+    delete result;
+    if (!ok)
+        return assertion_failure("select after update");
+    try {
+        result = parse("update duck set id = \"abc\" where id = 1");
+        delete result;
+        return assertion_failure("update with a value of the wrong type should throw");
+    } catch (SQLExecError& e) {}
+    result = parse("select name from duck where id = 1");
+    ok = result != nullptr && result->get_rows()->size() == 1;
+    delete result;
+    if (!ok)
+        return assertion_failure("row after a rejected update");
+
+    // an update that would duplicate a unique key changes nothing, in the table or its indices
+    try {
+        result = parse("update duck set id = 200 where pond = 1");  // the first row goes, then the second clashes
+        delete result;
+        return assertion_failure("update to a duplicate key should throw");
+    } catch (SQLExecError& e) {
+        std::cout << "expected error: " << e.what() << std::endl;
+    }
+    for (int id: {1, 5, 9, 200}) {
+        result = parse("select id, pond from duck where id = " + std::to_string(id));
+        ok = result != nullptr && result->get_rows()->size() == (id == 200 ? 0U : 1U) &&
+             (id == 200 || result->get_rows()->front()->at("pond").n == 1);
+        delete result;
+        if (!ok)
+            return assertion_failure("row after a rejected update to a duplicate key", id);
+    }
+    result = parse("select id from duck where pond = 1");
+    ok = result != nullptr && result->get_rows()->size() == 25;
+    delete result;
+    if (!ok)
+        return assertion_failure("pond index after a rejected update to a duplicate key");
+    result = parse("drop table duck");
+    delete result;
+    std::cout << "update ok\n";
+    return true;
+}
+
+/**
+ * Testing IMPORT FROM CSV FILE (what COPY table FROM 'file' runs as): rows land in the table and its index, quoted
+ * fields keep their commas and quotes, and a line with the wrong number of fields is an error
+ * @return true if the tests all succeeded
+ */
+bool test_copy() {
+    std::cout << "\n=====================\n";
+    const std::string csv_name = "_test_copy.csv";
+    std::ofstream csv(csv_name);
+    const int n_rows = 12345;  // more than one batch
+    for (int i = 0; i < n_rows; i++)
+        csv << i << "," << (i == 7 ? "\"seven, \"\"7\"\"\"" : "chick" + std::to_string(i)) << "," << i % 10 << "\n";
+    csv.close();
+    QueryResult* result = parse("create table chick (id int, name text, coop int)");
+    if (!result)
+        return false;
+    delete result;
+    result = parse("create index chick_coop on chick using multi_btree (coop)");
+    if (!result)
+        return false;
+    delete result;
+    result = parse("import from csv file '" + csv_name + "' into chick");
+    if (!result)
+        return false;
+    std::cout << *result << std::endl;
+    bool ok = result->get_message() ==
+              "successfully copied " + std::to_string(n_rows) + " rows into chick and into 1 indices";
+    delete result;
+    if (!ok)
+        return assertion_failure("copy message");
+    result = parse("select id, name from chick where coop = 7");
+    if (!result)
+        return false;
+    ValueDicts* rows = result->get_rows();
+    ok = rows->size() == (n_rows + 2) / 10 && rows->front()->at("name").s == "seven, \"7\"";
+    delete result;
+    if (!ok)
+        return assertion_failure("select after copy");
+
+    csv.open(csv_name);
+    csv << "1,one,1\n2,two\n";
+    csv.close();
+    try {
+        result = parse("import from csv file '" + csv_name + "' into chick");
+        delete result;
+        ok = false;
+    } catch (SQLExecError& e) {
+        std::cout << "expected error: " << e.what() << std::endl;
+    }
+    std::remove(csv_name.c_str());
+    if (!ok)
+        return assertion_failure("copy of a line with too few fields");
+    result = parse("drop table chick");
+    delete result;
+    std::cout << "copy ok\n";
+    return true;
+}
+
+/**
+ * Testing the optimizer's use of a btree index for where clauses
+ * @return true if the tests all succeeded
+ */
+bool test_index_select() {
+    std::cout << "\n=====================\n";
+    QueryResult* result = parse("create table hen (name text, id int, age int)");
+    if (!result)
+        return false;
+    delete result;
+    for (int i = 0; i < 200; i++) {
+        result = parse("insert into hen values (\"hen" + std::to_string(i) + "\", " + std::to_string(i) + ", " +
+                       std::to_string(i % 5) + ")");
+        if (!result)
+            return false;
+        delete result;
+    }
+    result = parse("create index hen_id on hen using btree (id)");
+    if (!result)
+        return false;
+    delete result;
+
+    DbRelation& hen = SQLExec::tables->get_table("hen");
+    ValueDict* where = new ValueDict();
+    (*where)["id"] = Value(123);
+    EvalPlan* plan = new EvalProjectAll(new EvalSelect(where, new EvalTableScan(hen)));
+    EvalPlan* optimized = plan->optimize(nullptr);
+    if (dynamic_cast<EvalProjectAll*>(optimized) == nullptr)
+        return assertion_failure("optimized plan should still end with a projection");
+    delete optimized;
+    delete plan;
+
+    where = new ValueDict();
+    (*where)["id"] = Value(123);
+    EvalPlan* select = new EvalSelect(where, new EvalTableScan(hen));
+    optimized = select->optimize(SQLExec::indices);
+    if (dynamic_cast<EvalIndexLookup*>(optimized) == nullptr)
+        return assertion_failure("where id = 123 should be an index lookup");
+    delete optimized;
+    (*where)["age"] = Value(3);
+    optimized = select->optimize(SQLExec::indices);
+    if (dynamic_cast<EvalSelect*>(optimized) == nullptr)
+        return assertion_failure("where id = 123 and age = 3 should be a select over an index lookup");
+    delete optimized;
+    (*where)["age"] = Value(4);
+    where->erase("id");
+    optimized = select->optimize(SQLExec::indices);
+    if (dynamic_cast<EvalTableScan*>(optimized) == nullptr)
+        return assertion_failure("where age = 4 should be a table scan");
+    delete optimized;
+    delete select;
+
+    result = parse("select name from hen where id = 123 and age = 3");
+    if (!result || result->get_rows()->size() != 1 || (*result->get_rows())[0]->at("name") != Value("hen123"))
+        return assertion_failure("indexed select found the wrong rows");
+    delete result;
+    result = parse("select name from hen where id = 123 and age = 2");
+    if (!result || result->get_rows()->size() != 0)
+        return assertion_failure("indexed select should check the other predicates");
+    delete result;
+
+    // with an index on id that includes name, name is read from the index entries instead of from hen
+    hsql::SQLParserResult* parsed = hsql::SQLParser::parseSQLString("create index hen_id_name on hen using btree (id)");
+    result = SQLExec::execute(parsed->getStatement(0), ColumnNames(1, "name"));
+    delete parsed;
+    delete result;
+    where = new ValueDict();
+    (*where)["id"] = Value(123);
+    plan = new EvalProject(ColumnNames(1, "name"), new EvalSelect(where, new EvalTableScan(hen)));
+    optimized = plan->optimize(SQLExec::indices);
+    if (dynamic_cast<EvalIndexOnlyLookup*>(optimized) == nullptr)
+        return assertion_failure("select name where id = 123 should be an index-only lookup");
+    ValueDicts* rows = optimized->evaluate();
+    bool found = rows->size() == 1 && rows->front()->at("name") == Value("hen123");
+    for (auto row: *rows)
+        delete row;
+    delete rows;
+    delete optimized;
+    delete plan;
+    if (!found)
+        return assertion_failure("index-only lookup found the wrong rows");
+    where = new ValueDict();
+    (*where)["id"] = Value(123);
+    plan = new EvalProject(ColumnNames{"name", "age"}, new EvalSelect(where, new EvalTableScan(hen)));
+    optimized = plan->optimize(SQLExec::indices);
+    if (dynamic_cast<EvalProject*>(optimized) == nullptr)
+        return assertion_failure("select name, age where id = 123 needs to read hen");
+    delete optimized;
+    delete plan;
+
+    // a value of another type than its column's equals no row's, whichever index is used
+    result = parse("create index hen_age on hen using hash (age)");
+    delete result;
+    for (std::string sql: {std::string("select name from hen where id = \"abc\""),
+                           std::string("select * from hen where id = \"abc\""),
+                           std::string("select * from hen where age = \"abc\"")}) {
+        result = parse(sql);
+        bool none = result != nullptr && result->get_rows()->empty();
+        delete result;
+        if (!none)
+            return assertion_failure("no rows should match: " + sql);
+    }
+
+    result = parse("drop table hen");
+    if (!result)
+        return false;
+    delete result;
+    std::cout << "index select ok\n";
+    return true;
+}
+
+/**
+ * Testing VACUUM: after deleting most rows, the rest move to the front of the table and both of its indices still
+ * find every one of them under their new handles
+ * @return true if the tests all succeeded
+ */
+bool test_vacuum() {
+    std::cout << "\n=====================\n";
+    for (std::string sql: {"create table goose (id int, name text, flock int)",
+                           "create index goose_id on goose using btree (id)",
+                           "create index goose_flock on goose using multi_btree (flock)"}) {
+        QueryResult* result = parse(sql);
+        if (!result)
+            return false;
+        delete result;
+    }
+    std::string name(200, 'g');
+    for (int i = 0; i < 300; i++) {
+        QueryResult* result = parse("insert into goose values (" + std::to_string(i) + ", \"" + name + "\", " +
+                                    std::to_string(i % 3) + ")");
+        if (!result)
+            return false;
+        delete result;
+    }
+    for (std::string sql: {"delete from goose where flock = 1", "delete from goose where flock = 2"}) {
+        QueryResult* result = parse(sql);
+        if (!result)
+            return false;
+        delete result;
+    }
+    QueryResult* result;
+    try {
+        result = SQLExec::vacuum("goose");
+    } catch (SQLExecError& e) {
+        return assertion_failure(std::string("vacuum: ") + e.what());
+    }
+    std::cout << *result << std::endl;
+    bool ok = result->get_message().find("released 0 blocks") == std::string::npos &&
+              result->get_message().find("moved 0 rows") == std::string::npos;
+    delete result;
+    if (!ok)
+        return assertion_failure("vacuum should move rows and release blocks");
+    for (int i = 0; i < 300 && ok; i += 3) {
+        result = parse("select id, name from goose where id = " + std::to_string(i));
+        if (!result)
+            return false;
+        ok = result->get_rows()->size() == 1 && result->get_rows()->front()->at("name").s == name;
+        delete result;
+    }
+    if (!ok)
+        return assertion_failure("index lookup after vacuum");
+    result = parse("select id from goose where flock = 0");
+    if (!result)
+        return false;
+    ok = result->get_rows()->size() == 100;
+    delete result;
+    if (!ok)
+        return assertion_failure("non-unique index lookup after vacuum");
+    try {
+        result = SQLExec::vacuum("no_such_table");
+        delete result;
+        return assertion_failure("vacuum of a missing table should throw");
+    } catch (SQLExecError& e) {}
+    result = parse("drop table goose");
+    delete result;
+    std::cout << "vacuum ok\n";
+    return true;
+}
+
+/**
+ * Testing ANALYZE: sizes and column statistics land in _statistics, inserts and deletes keep the row count
+ * current, and sampling just some of the blocks still estimates the row count
+ * @return true if the tests all succeeded
+ */
+bool test_analyze() {
+    std::cout << "\n=====================\n";
+    const std::string csv_name = "_test_analyze.csv";
+    std::ofstream csv(csv_name);
+    const int n_rows = 5000;
+    for (int i = 0; i < n_rows; i++)
+        csv << i << "," << (i % 10 < 6 ? "grey" : i % 10 < 9 ? "white" : "blue") << "," << i % 50 << "\n";
+    csv.close();
+    for (std::string sql: {std::string("create table heron (id int, colour text, wing int)"),
+                           "import from csv file '" + csv_name + "' into heron"}) {
+        QueryResult* result = parse(sql);
+        if (!result)
+            return false;
+        delete result;
+    }
+    std::remove(csv_name.c_str());
+    QueryResult* result;
+    try {
+        result = SQLExec::analyze("heron");
+    } catch (SQLExecError& e) {
+        return assertion_failure(std::string("analyze: ") + e.what());
+    }
+    std::cout << *result << std::endl;
+    delete result;
+
+    u_long row_count, changed_rows;
+    uint page_count;
+    if (!SQLExec::statistics->get_table("heron", row_count, page_count, changed_rows) || row_count != n_rows ||
+        page_count == 0 || changed_rows != 0)
+        return assertion_failure("table statistics", row_count);
+    ColumnStatistics colour, id, wing;
+    if (!SQLExec::statistics->get_column("heron", "colour", colour) ||
+        !SQLExec::statistics->get_column("heron", "id", id) ||
+        !SQLExec::statistics->get_column("heron", "wing", wing))
+        return assertion_failure("column statistics");
+    if (colour.n_distinct != 3 || colour.most_common.size() != 3 || colour.most_common[0].first != Value("grey") ||
+        colour.most_common[0].second != 3000 || !colour.histogram.empty())
+        return assertion_failure("few distinct values should all be most common", colour.n_distinct);
+    if (id.n_distinct != n_rows || !id.most_common.empty() ||
+        id.histogram.size() != Statistics::HISTOGRAM_BUCKETS + 1 || id.histogram.front().n != 0 ||
+        id.histogram.back().n != n_rows - 1)
+        return assertion_failure("unique column", id.n_distinct);
+    if (wing.n_distinct != 50 || !wing.most_common.empty() || wing.histogram.size() != Statistics::HISTOGRAM_BUCKETS + 1)
+        return assertion_failure("evenly spread column", wing.n_distinct);
+
+    // the catalog can be queried like any other table
+    result = parse("select column_name, n_distinct, most_common from _statistics where table_name = \"heron\"");
+    if (!result)
+        return false;
+    std::cout << *result << std::endl;
+    bool ok = result->get_rows()->size() == 4;
+    delete result;
+    if (!ok)
+        return assertion_failure("select from _statistics");
+
+    // counted since ANALYZE
+    for (std::string sql: {"insert into heron values (5000, \"pink\", 1)", "delete from heron where colour = \"blue\"",
+                           "update heron set wing = 0 where id = 1"}) {
+        result = parse(sql);
+        if (!result)
+            return false;
+        delete result;
+    }
+    SQLExec::statistics->get_table("heron", row_count, page_count, changed_rows);
+    if (row_count != n_rows + 1 - n_rows / 10 || changed_rows != 1 + n_rows / 10 + 1)
+        return assertion_failure("row count after changes", row_count);
+
+    // reading 5 of the blocks, the same ones each time
+    u_long estimate, again_estimate;
+    ValueDicts* sample = SQLExec::tables->get_table("heron").sample(5, estimate, page_count);
+    ValueDicts* again = SQLExec::tables->get_table("heron").sample(5, again_estimate, page_count);
+    ok = sample->size() == 5 && estimate > row_count * 3 / 4 && estimate < row_count * 5 / 4;
+    bool same = again->size() == sample->size() && again_estimate == estimate;
+    for (uint i = 0; same && i < sample->size(); i++)
+        same = *(*sample)[i] == *(*again)[i];
+    for (auto row: *sample)
+        delete row;
+    delete sample;
+    for (auto row: *again)
+        delete row;
+    delete again;
+    if (!ok)
+        return assertion_failure("row count from a sample of the blocks", estimate);
+    if (!same)
+        return assertion_failure("an unchanged table should give the same sample");
+
+    result = parse("drop table heron");
+    delete result;
+    if (SQLExec::statistics->get_table("heron", row_count, page_count, changed_rows))
+        return assertion_failure("statistics of a dropped table");
+    std::cout << "analyze ok\n";
+    return true;
+}
+
+/**
+ * Testing the cost-based optimizer on an analyzed table: a lookup in an index only when it finds few enough rows
+ * to beat reading every block, range lookups in B-trees, the most selective range checked first, and
+ * estimates that match what the queries find
+ * @return true if the tests all succeeded
+ */
+bool test_optimizer() {
+    std::cout << "\n=====================\n";
+    const std::string csv_name = "_test_optimizer.csv";
+    std::ofstream csv(csv_name);
+    const int n_rows = 3000;
+    std::string filler(200, 'f');  // so that the table takes about 150 blocks
+    for (int i = 0; i < n_rows; i++)
+        csv << i << "," << (i % 40 == 0 ? "snowy" : "barn") << "," << i % 300 << "," << i % 7 << "," << filler << "\n";
+    csv.close();
+    for (std::string sql: {std::string("create table owl (id int, kind text, size int, age int, notes text)"),
+                           std::string("create index owl_id on owl using btree (id)"),
+                           std::string("create index owl_kind on owl using hash (kind)"),
+                           std::string("create index owl_size on owl using multi_btree (size)"),
+                           "import from csv file '" + csv_name + "' into owl"}) {
+        QueryResult* result = parse(sql);
+        if (!result)
+            return false;
+        delete result;
+    }
+    std::remove(csv_name.c_str());
+    QueryResult* result = SQLExec::analyze("owl");
+    delete result;
+
+    // the plan of the selection in each query, the rows it finds, and the operator that reads the table
+    struct Case {
+        std::string where;
+        int rows;
+        std::string access;
+    };
+    std::vector<Case> cases = {
+            {"id = 5",                                  1,    "IndexLookup owl.owl_id"},
+            {"kind = \"snowy\"",                        75,   "IndexLookup owl.owl_kind"},
+            {"kind = \"barn\"",                         2925, "TableScan owl"},
+            {"size >= 10 and size < 13",                30,   "IndexRange owl.owl_size"},
+            {"size >= 100",                             2000, "TableScan owl"},
+            {"kind = \"snowy\" and size < 20",          5,    "IndexLookup owl.owl_kind"},
+            {"size >= 100 and age <= 0 and kind = \"barn\"", 275, "TableScan owl"}};
+    for (auto const& c: cases) {
+        std::string sql = "select id, size from owl where " + c.where;
+        hsql::SQLParserResult* parsed = hsql::SQLParser::parseSQLString(sql);
+        result = SQLExec::explain(parsed->getStatement(0));
+        std::string plan = result->get_message();
+        delete result;
+        result = SQLExec::execute(parsed->getStatement(0));
+        delete parsed;
+        int found = (int) result->get_rows()->size();
+        delete result;
+        std::cout << sql << "\n" << plan << "\nfound " << found << " rows" << std::endl;
+        if (found != c.rows)
+            return assertion_failure("rows found where " + c.where, found);
+        if (plan.find(c.access) == std::string::npos)
+            return assertion_failure("plan where " + c.where + " should use " + c.access);
+    }
+
+    // estimates, and the order the range predicates are checked in
+    ValueDict* where = new ValueDict({{"kind", Value("barn")}});
+    ValueRanges* ranges = new ValueRanges();
+    (*ranges)["size"].restrict_min(Value(100), true);
+    (*ranges)["age"].restrict_max(Value(0), true);
+    DbRelation& owl = SQLExec::tables->get_table("owl");
+    EvalPlan* plan = new EvalSelect(where, new EvalTableScan(owl), ranges);
+    EvalPlan* optimized = plan->optimize(SQLExec::indices, SQLExec::statistics);
+    std::string description = optimized->explain();
+    double estimate = optimized->get_estimated_rows();
+    delete optimized;
+    delete plan;
+    if (description.find("Select age <= 0 and size >= 100") == std::string::npos)
+        return assertion_failure("the more selective range should be checked first: " + description);
+    if (estimate < 275 * 0.8 || estimate > 275 * 1.2)
+        return assertion_failure("estimated rows", estimate);
+
+    result = parse("drop table owl");
+    delete result;
+    std::cout << "optimizer ok\n";
+    return true;
+}
+
 /**
  * Testing functionality of SQLExec
  * @return true if all tests succeed
@@ -542,7 +1451,25 @@ bool test_sql_exec() {
         && test_select(1)
         && test_delete()
         && test_select(0)
-        && test_drop_table();
+        && test_drop_table()
+
+        // test index selection in the optimizer
+        && test_index_select()
+
+        // test bulk load from a CSV file
+        && test_copy()
+
+        // test update
+        && test_update()
+
+        // test vacuum
+        && test_vacuum()
+
+        // test analyze
+        && test_analyze()
+
+        // test the cost-based optimizer
+        && test_optimizer();
 }
 
 
@@ -552,6 +1479,314 @@ bool test_sql_exec() {
  * ****************************
  */
 
+/**
+ * Test helper. Builds a tall tree (long text keys, so only a few fit in a node) and checks that once its
+ * interior nodes are cached a lookup reads just its leaf, and that the cached nodes keep up with splits and merges.
+ * @return  true if the tests all succeeded
+ */
+bool test_btree_node_cache() {
+    ColumnNames column_names = {"k", "n"};
+    ColumnAttributes column_attributes = {ColumnAttribute(ColumnAttribute::TEXT), ColumnAttribute(ColumnAttribute::INT)};
+    HeapTable table("__test_btree_cache", column_names, column_attributes);
+    table.create();
+    const int n_rows = 2000;
+    std::string pad(1000, '.');
+    Handles handles;
+    for (int i = 0; i < n_rows; i += 2) {
+        ValueDict row = {{"k", Value(std::to_string(10000 + i) + pad)}, {"n", Value(i)}};
+        handles.push_back(table.insert(&row));
+    }
+    BTreeIndex::set_node_cache_size(1000);
+    BTreeIndex index(table, "__test_btree_cache_k", ColumnNames(1, "k"), true);
+    index.create();
+
+    // warm the cache, then a lookup should pin only its leaf
+    ValueDict lookup;
+    for (int i = 0; i < n_rows; i += 2) {
+        lookup["k"] = Value(std::to_string(10000 + i) + pad);
+        delete index.lookup(&lookup);
+    }
+    BufferPoolStats before = BufferPool::instance().get_stats();
+    lookup["k"] = Value(std::to_string(10000 + 1234) + pad);
+    Handles *found = index.lookup(&lookup);
+    BufferPoolStats after = BufferPool::instance().get_stats();
+    if (found->size() != 1)
+        return assertion_failure("cached lookup did not find its row");
+    delete found;
+    u_long pins = after.hits + after.misses - before.hits - before.misses;
+    if (pins != 1)
+        return assertion_failure("cached lookup should read only its leaf", pins);
+
+    // splits and merges go through the cached nodes
+    for (int i = 1; i < n_rows; i += 2) {
+        ValueDict row = {{"k", Value(std::to_string(10000 + i) + pad)}, {"n", Value(i)}};
+        index.insert(table.insert(&row));
+    }
+    for (auto const &handle: handles)
+        index.del(handle);
+    for (int i = 0; i < n_rows; i++) {
+        lookup["k"] = Value(std::to_string(10000 + i) + pad);
+        found = index.lookup(&lookup);
+        bool ok = found->size() == (u_long) (i % 2);
+        if (ok && i % 2) {
+            ValueDict *row = table.project(found->back());
+            ok = row->at("n") == Value(i);
+            delete row;
+        }
+        delete found;
+        if (!ok)
+            return assertion_failure("lookup after inserts and deletes", i);
+    }
+    found = index.range(nullptr, nullptr);
+    u_long count = found->size();
+    delete found;
+    if (count != n_rows / 2)
+        return assertion_failure("range after inserts and deletes", count);
+
+    // more indices share the same part of the buffer pool rather than each pinning more of it
+    BTreeIndex::set_node_cache_size(BTreeIndex::DEFAULT_NODE_CACHE_SIZE);
+    std::vector<BTreeIndex*> others;
+    for (int j = 0; j < 3; j++) {
+        others.push_back(new BTreeIndex(table, "__test_btree_cache_k" + std::to_string(j), ColumnNames(1, "k"), true));
+        others.back()->create();
+        for (int i = 1; i < n_rows; i += 2) {
+            lookup["k"] = Value(std::to_string(10000 + i) + pad);
+            delete others.back()->lookup(&lookup);
+        }
+    }
+    uint pinned = BufferPool::instance().get_pinned_count();
+    for (auto other: others) {
+        other->drop();
+        delete other;
+    }
+    uint held = 2 * (1 + (uint) others.size());  // each open index holds its stat block and its root
+    if (pinned > BufferPool::instance().get_capacity() / BTreeIndex::NODE_CACHE_SHARE + held)
+        return assertion_failure("cached nodes of all the indices pinned more than their share of the pool", pinned);
+
+    index.close();
+    if (BufferPool::instance().get_pinned_count() != 0)
+        return assertion_failure("cached nodes still pinned after close", BufferPool::instance().get_pinned_count());
+    index.drop();
+    table.drop();
+    std::cout << "btree node cache ok" << std::endl;
+    return true;
+}
+
+/**
+ * Test helper. Builds a non-unique index where one key has enough rows to need overflow pages, then checks that
+ * lookups find every row for a key, in block order, as rows come and go.
+ * @return  true if the tests all succeeded
+ */
+bool test_btree_non_unique() {
+    ColumnNames column_names = {"a", "b"};
+    ColumnAttributes column_attributes = {ColumnAttribute(ColumnAttribute::INT), ColumnAttribute(ColumnAttribute::INT)};
+    HeapTable table("__test_btree_multi", column_names, column_attributes);
+    table.create();
+    const int n_rows = 3000, n_keys = 10, frequent = -1;  // every third row has the frequent key
+    std::vector<Handles> expected(n_keys + 1);
+    for (int i = 0; i < n_rows; i++) {
+        int b = i % 3 == 0 ? frequent : i % n_keys;
+        ValueDict row = {{"a", Value(i)}, {"b", Value(b)}};
+        expected[b + 1].push_back(table.insert(&row));
+    }
+    BTreeIndex index(table, "__test_btree_multi_b", ColumnNames(1, "b"), false);
+    index.create();
+
+    // more rows after the bulk load, then drop some from the middle of the frequent key's overflow pages
+    for (int i = n_rows; i < n_rows + 1500; i++) {
+        int b = i % 2 == 0 ? frequent : i % n_keys;
+        ValueDict row = {{"a", Value(i)}, {"b", Value(b)}};
+        Handle handle = table.insert(&row);
+        index.insert(handle);
+        expected[b + 1].push_back(handle);
+    }
+    for (int b = frequent; b < n_keys; b++) {
+        Handles &handles = expected[b + 1];
+        u_long n_deleting = b == frequent ? handles.size() * 3 / 4 : handles.size() / 10;
+        u_long at = handles.size() / 8;
+        for (u_long i = 0; i < n_deleting; i++) {
+            index.del(handles[at]);
+            table.del(handles[at]);
+            handles.erase(handles.begin() + at);
+        }
+    }
+
+    ValueDict lookup;
+    u_long total = 0;
+    for (int b = frequent; b < n_keys; b++) {
+        lookup["b"] = Value(b);
+        Handles *found = index.lookup(&lookup);
+        Handles &handles = expected[b + 1];
+        std::sort(handles.begin(), handles.end());
+        bool ok = *found == handles;
+        delete found;
+        if (!ok)
+            return assertion_failure("non-unique lookup should find every row in block order", b + 1);
+        total += handles.size();
+    }
+    Handles *found = index.range(nullptr, nullptr);
+    u_long count = found->size();
+    delete found;
+    if (count != total)
+        return assertion_failure("non-unique range", count, total);
+
+    index.drop();
+    table.drop();
+    std::cout << "non-unique btree ok" << std::endl;
+    return true;
+}
+
+/**
+ * Test helper. Builds a unique index on id and a non-unique one on grp, both including other columns, and checks
+ * that lookups by key alone still work and that index-only lookups read the right values out of the entries.
+ * @return  true if the tests all succeeded
+ */
+bool test_btree_include() {
+    ColumnNames column_names = {"id", "grp", "name"};
+    ColumnAttributes column_attributes = {ColumnAttribute(ColumnAttribute::INT), ColumnAttribute(ColumnAttribute::INT),
+                                          ColumnAttribute(ColumnAttribute::TEXT)};
+    HeapTable table("__test_btree_include", column_names, column_attributes);
+    table.create();
+    const int n_rows = 3000, n_groups = 10;
+    Handles handles;
+    for (int i = 0; i < n_rows / 2; i++) {
+        ValueDict row = {{"id", Value(i)}, {"grp", Value(i % n_groups)}, {"name", Value("name" + std::to_string(i))}};
+        handles.push_back(table.insert(&row));
+    }
+    BTreeIndex id_index(table, "__test_btree_include_id", ColumnNames(1, "id"), true, ColumnNames(1, "name"));
+    id_index.create();
+    BTreeIndex grp_index(table, "__test_btree_include_grp", ColumnNames(1, "grp"), false, ColumnNames(1, "id"));
+    grp_index.create();
+    for (int i = n_rows / 2; i < n_rows; i++) {
+        ValueDict row = {{"id", Value(i)}, {"grp", Value(i % n_groups)}, {"name", Value("name" + std::to_string(i))}};
+        handles.push_back(table.insert(&row));
+        id_index.insert(handles.back());
+        grp_index.insert(handles.back());
+    }
+    if (!id_index.covers(ColumnNames{"name", "id"}) || id_index.covers(ColumnNames{"name", "grp"}))
+        return assertion_failure("covers should be the key columns and included columns");
+
+    // same key, other included value
+    ValueDict duplicate = {{"id", Value(7)}, {"grp", Value(0)}, {"name", Value("other")}};
+    Handle duplicate_handle = table.insert(&duplicate);
+    try {
+        id_index.insert(duplicate_handle);
+        return assertion_failure("unique index with included columns took a duplicate key");
+    } catch (DbRelationError &e) {}
+    table.del(duplicate_handle);
+
+    for (int i = 0; i < n_rows; i += 2) {
+        id_index.del(handles[i]);
+        grp_index.del(handles[i]);
+        table.del(handles[i]);
+    }
+    ValueDict lookup;
+    for (int i = 0; i < n_rows; i++) {
+        lookup = {{"id", Value(i)}};
+        Handles *found = id_index.lookup(&lookup);
+        ValueDicts *rows = id_index.lookup_covered(&lookup, ColumnNames(1, "name"));
+        bool ok = i % 2 == 0 ? found->empty() && rows->empty()
+                             : found->size() == 1 && found->front() == handles[i] && rows->size() == 1 &&
+                               rows->front()->at("name") == Value("name" + std::to_string(i));
+        delete found;
+        for (auto row: *rows)
+            delete row;
+        delete rows;
+        if (!ok)
+            return assertion_failure("lookup in index with included columns", i);
+    }
+    for (int g = 0; g < n_groups; g++) {
+        Handles expected;
+        std::vector<int> expected_ids;
+        for (int i = g; i < n_rows; i += n_groups)
+            if (i % 2 != 0) {
+                expected.push_back(handles[i]);
+                expected_ids.push_back(i);
+            }
+        lookup = {{"grp", Value(g)}};
+        Handles *found = grp_index.lookup(&lookup);
+        bool ok = *found == expected;
+        delete found;
+        ValueDicts *rows = grp_index.lookup_covered(&lookup, ColumnNames{"grp", "id"});
+        std::vector<int> ids;
+        for (auto row: *rows) {
+            ok = ok && row->at("grp") == Value(g);
+            ids.push_back(row->at("id").n);
+            delete row;
+        }
+        delete rows;
+        if (!ok || ids != expected_ids)
+            return assertion_failure("non-unique lookup in index with included columns", g);
+    }
+    ValueDict min_key = {{"id", Value(100)}}, max_key = {{"id", Value(200)}};
+    Handles *found = id_index.range(&min_key, &max_key);
+    u_long count = found->size();
+    delete found;
+    if (count != 50)
+        return assertion_failure("range in index with included columns", count);
+
+    id_index.drop();
+    grp_index.drop();
+    table.drop();
+    std::cout << "btree include ok" << std::endl;
+    return true;
+}
+
+/**
+ * Test helper. Creates a table with 32kB blocks, checks that it keeps that size when reopened, that it takes rows
+ * too big for 4kB blocks, and that a B-tree index on it gets the same size of blocks (so fewer of them).
+ * @return  true if the tests all succeeded
+ */
+bool test_big_pages() {
+    ColumnNames column_names = {"id", "text"};
+    ColumnAttributes column_attributes = {ColumnAttribute(ColumnAttribute::INT), ColumnAttribute(ColumnAttribute::TEXT)};
+    const uint page_size = 32768;
+    HeapTable bad_table("__test_pages_bad", column_names, column_attributes);
+    for (uint bad_size: {1000U, 6000U, 2 * DbBlock::MAX_BLOCK_SZ}) {
+        try {
+            bad_table.create(bad_size);
+            return assertion_failure("blocks must be a power of 2 from 4kB to 64kB", bad_size);
+        } catch (DbRelationError &e) {}
+    }
+
+    HeapTable table("__test_pages", column_names, column_attributes);
+    table.create(page_size);
+    const int n_rows = 2000;
+    Handles handles;
+    for (int i = 0; i < n_rows; i++) {
+        ValueDict row = {{"id", Value(i)}, {"text", Value(std::string(i % 100 == 0 ? 10000 : 10, 'x'))}};
+        handles.push_back(table.insert(&row));
+    }
+    table.close();
+    HeapTable reopened("__test_pages", column_names, column_attributes);
+    if (reopened.get_block_size() != page_size)
+        return assertion_failure("table should keep its block size", reopened.get_block_size(), page_size);
+    ValueDict *big = reopened.project(handles[n_rows / 2]);
+    bool big_ok = (*big)["text"].s.size() == 10000;
+    delete big;
+    if (!big_ok)
+        return assertion_failure("row bigger than 4kB should come back whole");
+
+    BTreeIndex index(reopened, "id", ColumnNames(1, "id"), true);
+    index.create();
+    ValueDict lookup = {{"id", Value(n_rows - 1)}};
+    Handles *found = index.lookup(&lookup);
+    bool found_ok = found->size() == 1 && (*found)[0] == handles.back();
+    delete found;
+    if (!found_ok)
+        return assertion_failure("lookup in an index with big blocks");
+    HeapFile index_file("__test_pages-id");
+    index_file.open();
+    bool index_ok = index_file.get_block_size() == page_size && index_file.get_last_block_id() <= 4;
+    index_file.close();
+    if (!index_ok)
+        return assertion_failure("index should have the table's block size");
+    index.drop();
+    reopened.drop();
+    std::cout << "big pages ok" << std::endl;
+    return true;
+}
+
 bool test_btree() {
     std::cout << std::endl;
     ColumnNames column_names;
@@ -622,73 +1857,620 @@ bool test_btree() {
             delete result;
         }
 
-    // delete and range temporarily not implemented
-
     // test delete
-    // ValueDict row;
-    // row["a"] = 44;
-    // row["b"] = 44;
-    // auto thandle = table.insert(&row);
-    // index.insert(thandle);
-    // lookup["a"] = 44;
-    // handles = index.lookup(&lookup);
-    // thandle = handles->back();
-    // delete handles;
-    // result = table.project(thandle);
-    // if (*result != row) {
-    //     std::cout << "44 lookup failed" << std::endl;
-    //     return false;
-    // }
-    // delete result;
-    // index.del(thandle);
-    // table.del(thandle);
-    // handles = index.lookup(&lookup);
-    // if (handles->size() != 0) {
-    //     std::cout << "delete failed" << std::endl;
-    //     return false;
-    // }
-    // delete handles;
-
-    // // test range
-    // ValueDict minkey, maxkey;
-    // minkey["a"] = 100;
-    // maxkey["a"] = 310;
-    // handles = index.range(&minkey, &maxkey);
-    // ValueDicts *results = table.project(handles);
-    // for (int i = 0; i < 210; i++) {
-    //     if (results->at(i)->at("a") != Value(100 + i)) {
-    //         ValueDict *wrong = results->at(i);
-    //         std::cout << "range failed: " << i << ", a: " << wrong->at("a").n << ", b: " << wrong->at("b").n
-    //                   << std::endl;
-    //         return false;
-    //     }
-    // }
-    // delete handles;
-    // for (auto vd: *results)
-    //     delete vd;
-    // delete results;
-
-    // // test range from beginning and to end
-    // handles = index.range(nullptr, nullptr);
-    // u_long count_i = handles->size();
-    // delete handles;
-    // handles = table.select();
-    // u_long count_t = handles->size();
-    // if (count_i != count_t) {
-    //     std::cout << "full range failed: " << count_i << std::endl;
-    //     return false;
-    // }
-    // for (u_long i = 0; i < count_t; i++)
-    //     index.del((*handles)[i]);
-    // delete handles;
-    // handles = index.range(nullptr, nullptr);
-    // count_i = handles->size();
-    // delete handles;
-    // if (count_i != 0) {
-    //     std::cout << "delete everything failed: " << count_i << std::endl;
-    //     return false;
-    // }
+    ValueDict row;
+    row["a"] = 44;
+    row["b"] = 44;
+    auto thandle = table.insert(&row);
+    index.insert(thandle);
+    lookup["a"] = 44;
+    handles = index.lookup(&lookup);
+    thandle = handles->back();
+    delete handles;
+    result = table.project(thandle);
+    if (*result != row) {
+        std::cout << "44 lookup failed" << std::endl;
+        return false;
+    }
+    delete result;
+    index.del(thandle);
+    table.del(thandle);
+    handles = index.lookup(&lookup);
+    if (handles->size() != 0) {
+        std::cout << "delete failed" << std::endl;
+        return false;
+    }
+    delete handles;
+
+    // test range
+    ValueDict minkey, maxkey;
+    minkey["a"] = 100;
+    maxkey["a"] = 310;
+    handles = index.range(&minkey, &maxkey);
+    ValueDicts *results = table.project(handles);
+    for (int i = 0; i < 210; i++) {
+        if (results->at(i)->at("a") != Value(100 + i)) {
+            ValueDict *wrong = results->at(i);
+            std::cout << "range failed: " << i << ", a: " << wrong->at("a").n << ", b: " << wrong->at("b").n
+                      << std::endl;
+            return false;
+        }
+    }
+    delete handles;
+    for (auto vd: *results)
+        delete vd;
+    delete results;
+
+    // test range from beginning and to end
+    handles = index.range(nullptr, nullptr);
+    u_long count_i = handles->size();
+    delete handles;
+    handles = table.select();
+    u_long count_t = handles->size();
+    if (count_i != count_t) {
+        std::cout << "full range failed: " << count_i << std::endl;
+        return false;
+    }
+    delete handles;
+
+    // test exclusive and open-ended bounds with the cursor
+    minkey["a"] = 49000;
+    HandleCursor *cursor = index.range_scan(&minkey, false, nullptr, false);
+    Handle handle;
+    int expected = 49001;
+    while (cursor->next(handle)) {
+        result = table.project(handle);
+        if (result->at("a") != Value(expected++)) {
+            std::cout << "open-ended range failed: " << expected - 1 << std::endl;
+            return false;
+        }
+        delete result;
+    }
+    delete cursor;
+    if (expected != 100 * 500 + 100) {
+        std::cout << "open-ended range stopped early: " << expected << std::endl;
+        return false;
+    }
+    maxkey["a"] = 50;
+    cursor = index.range_scan(nullptr, true, &maxkey, false);
+    if (!cursor->next(handle) || cursor->next(handle)) {
+        std::cout << "range below 50 should have just 12" << std::endl;
+        return false;
+    }
+    delete cursor;
+    minkey["a"] = 12;
+    maxkey["a"] = 88;
+    handles = index.range(&minkey, &maxkey);
+    count_i = handles->size();
+    delete handles;
+    cursor = index.range_scan(&minkey, false, &maxkey, false);
+    bool empty = !cursor->next(handle);
+    delete cursor;
+    if (count_i != 2 || !empty) {
+        std::cout << "inclusive/exclusive range failed" << std::endl;
+        return false;
+    }
+    std::cout << "btree range ok" << std::endl;
+
+    // test deleting half (leaves and interior nodes merge or borrow) and then everything
+    handles = table.select();
+    for (u_long i = 0; i < count_t; i += 2)
+        index.del((*handles)[i]);
+    Handles *remaining = index.range(nullptr, nullptr);
+    if (remaining->size() != count_t / 2) {
+        std::cout << "delete half failed: " << remaining->size() << std::endl;
+        return false;
+    }
+    results = table.project(remaining);
+    for (u_long i = 1; i < results->size(); i++)
+        if (!(results->at(i - 1)->at("a") < results->at(i)->at("a"))) {
+            std::cout << "range out of order after delete half: " << i << std::endl;
+            return false;
+        }
+    for (auto vd: *results)
+        delete vd;
+    delete results;
+    delete remaining;
+    for (u_long i = 1; i < count_t; i += 2)
+        index.del((*handles)[i]);
+    delete handles;
+    handles = index.range(nullptr, nullptr);
+    count_i = handles->size();
+    delete handles;
+    if (count_i != 0) {
+        std::cout << "delete everything failed: " << count_i << std::endl;
+        return false;
+    }
     index.drop();
+
+    // bulk load with an external sort (many small runs) and partly filled nodes
+    BTreeIndex::set_sort_run_size(1000);
+    BTreeIndex::set_fill_factor(0.7);
+    column_names.clear();
+    column_names.push_back("b");
+    BTreeIndex bindex(table, "barindex", column_names, true);
+    bindex.create();
+    BTreeIndex::set_sort_run_size(BTreeIndex::DEFAULT_SORT_RUN_SIZE);
+    BTreeIndex::set_fill_factor(0.9);
+    handles = bindex.range(nullptr, nullptr);
+    results = table.project(handles);
+    bool sorted = results->size() == count_t;
+    for (u_long i = 1; sorted && i < results->size(); i++)
+        sorted = results->at(i - 1)->at("b") < results->at(i)->at("b");
+    for (auto vd: *results)
+        delete vd;
+    delete results;
+    delete handles;
+    if (!sorted) {
+        std::cout << "bulk load range failed" << std::endl;
+        return false;
+    }
+    lookup.clear();
+    lookup["b"] = -4321;
+    handles = bindex.lookup(&lookup);
+    result = handles->empty() ? nullptr : table.project(handles->back());
+    delete handles;
+    if (result == nullptr || result->at("a") != Value(4421)) {
+        std::cout << "bulk load lookup failed" << std::endl;
+        return false;
+    }
+    delete result;
+    row["a"] = 7;
+    row["b"] = 50000;
+    bindex.insert(table.insert(&row));
+    lookup["b"] = 50000;
+    handles = bindex.lookup(&lookup);
+    count_i = handles->size();
+    delete handles;
+    if (count_i != 1) {
+        std::cout << "insert after bulk load failed" << std::endl;
+        return false;
+    }
+    std::cout << "bulk load ok" << std::endl;
+    bindex.drop();
     table.drop();
+    return test_btree_node_cache() && test_btree_non_unique() && test_btree_include() && test_big_pages();
+}
+
+
+/*
+ * ****************************
+ * Hash index tests
+ * ****************************
+ */
+
+/**
+ * Builds hash indices big enough to split their buckets many times (one of them with keys frequent enough to
+ * need overflow pages), checks lookups as rows come and go, and times lookups and inserts against a B-tree.
+ * @return  true if the tests all succeeded
+ */
+bool test_hash_index() {
+    std::cout << std::endl;
+    ColumnNames column_names = {"id", "grp"};
+    ColumnAttributes column_attributes = {ColumnAttribute(ColumnAttribute::INT), ColumnAttribute(ColumnAttribute::INT)};
+    HeapTable table("__test_hash", column_names, column_attributes);
+    table.create();
+    const int n_rows = 20000, n_groups = 25;
+    Handles handles;
+    for (int i = 0; i < n_rows / 2; i++) {
+        ValueDict row = {{"id", Value(i)}, {"grp", Value(i % n_groups)}};
+        handles.push_back(table.insert(&row));
+    }
+    HashIndex id_index(table, "__test_hash_id", ColumnNames(1, "id"), true);
+    id_index.create();
+    HashIndex grp_index(table, "__test_hash_grp", ColumnNames(1, "grp"), false);
+    grp_index.create();
+    for (int i = n_rows / 2; i < n_rows; i++) {
+        ValueDict row = {{"id", Value(i)}, {"grp", Value(i % n_groups)}};
+        handles.push_back(table.insert(&row));
+        id_index.insert(handles.back());
+        grp_index.insert(handles.back());
+    }
+    if (id_index.get_bucket_count() <= HashIndex::INITIAL_BUCKETS)
+        return assertion_failure("hash index should have split its buckets", id_index.get_bucket_count());
+
+    ValueDict lookup;
+    for (int i = 0; i < n_rows; i++) {
+        lookup["id"] = Value(i);
+        Handles *found = id_index.lookup(&lookup);
+        bool ok = found->size() == 1 && found->front() == handles[i];
+        delete found;
+        if (!ok)
+            return assertion_failure("hash lookup", i);
+    }
+    lookup["id"] = Value(n_rows);
+    Handles *found = id_index.lookup(&lookup);
+    u_long count = found->size();
+    delete found;
+    if (count != 0)
+        return assertion_failure("hash lookup of a missing key", count);
+    ValueDict duplicate = {{"id", Value(7)}, {"grp", Value(-1)}};
+    Handle duplicate_handle = table.insert(&duplicate);
+    try {
+        id_index.insert(duplicate_handle);
+        return assertion_failure("unique hash index took a duplicate key");
+    } catch (DbRelationError &e) {}
+    table.del(duplicate_handle);
+
+    // delete every third row, then each group should have just the rest, in block order
+    for (int i = 0; i < n_rows; i += 3) {
+        id_index.del(handles[i]);
+        grp_index.del(handles[i]);
+        table.del(handles[i]);
+    }
+    for (int g = 0; g < n_groups; g++) {
+        Handles expected;
+        for (int i = g; i < n_rows; i += n_groups)
+            if (i % 3 != 0)
+                expected.push_back(handles[i]);
+        lookup = {{"grp", Value(g)}};
+        found = grp_index.lookup(&lookup);
+        bool ok = *found == expected;
+        delete found;
+        if (!ok)
+            return assertion_failure("non-unique hash lookup after deletes", g);
+    }
+    for (int i = 0; i < 30; i++) {
+        lookup = {{"id", Value(i)}};
+        found = id_index.lookup(&lookup);
+        count = found->size();
+        delete found;
+        if (count != (u_long) (i % 3 != 0))
+            return assertion_failure("hash lookup after deletes", i);
+    }
+    std::cout << "hash index ok" << std::endl;
+
+    // against a B-tree on the same column
+    BTreeIndex btree_index(table, "__test_hash_btree", ColumnNames(1, "id"), true);
+    btree_index.create();
+    HashIndex hash_index(table, "__test_hash_hash", ColumnNames(1, "id"), true);
+    hash_index.create();
+    DbIndex *indices[] = {&btree_index, &hash_index};
+    for (int i = 0; i < n_rows; i += 3) {
+        ValueDict row = {{"id", Value(i)}, {"grp", Value(i % n_groups)}};
+        handles[i] = table.insert(&row);
+    }
+    long lookup_us[2], insert_us[2];
+    for (int which = 0; which < 2; which++) {
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 1; i < n_rows; i += 3) {
+            lookup = {{"id", Value(i)}};
+            delete indices[which]->lookup(&lookup);
+        }
+        auto middle = std::chrono::steady_clock::now();
+        for (int i = 0; i < n_rows; i += 3)
+            indices[which]->insert(handles[i]);
+        auto end = std::chrono::steady_clock::now();
+        for (int i = 0; i < n_rows; i += 3)
+            indices[which]->del(handles[i]);
+        lookup_us[which] = std::chrono::duration_cast<std::chrono::microseconds>(middle - start).count();
+        insert_us[which] = std::chrono::duration_cast<std::chrono::microseconds>(end - middle).count();
+    }
+    std::cout << n_rows / 3 << " lookups: btree " << lookup_us[0] << "us, hash " << lookup_us[1] << "us; "
+              << n_rows / 3 << " inserts: btree " << insert_us[0] << "us, hash " << insert_us[1] << "us" << std::endl;
+
+    btree_index.drop();
+    hash_index.drop();
+    id_index.drop();
+    grp_index.drop();
+    table.drop();
+    return true;
+}
+
+
+/*
+ * ****************************
+ * Buffer pool tests
+ * ****************************
+ */
+
+/**
+ * Test helper. Checks that a block holds the single record written by test_buffer_pool.
+ * @param file      file holding the block
+ * @param block_id  block to check
+ * @return          true if the block's record is block_id
+ */
+bool test_buffer_pool_block(HeapFile& file, BlockID block_id) {
+    SlottedPage* page = file.get(block_id);
+    Dbt* record = page->get(1);
+    bool ok = record != nullptr && *(BlockID*) record->get_data() == block_id;
+    delete record;
+    delete page;
+    return ok;
+}
+
+/**
+ * Testing function for the buffer pool.
+ * @return true if the tests all succeeded
+ */
+bool test_buffer_pool() {
+    std::cout << std::endl;
+    BufferPool& pool = BufferPool::instance();
+    uint capacity = pool.get_capacity();
+    if (pool.get_pinned_count() != 0)
+        return assertion_failure("pinned frames left behind by earlier tests", pool.get_pinned_count());
+    const uint frames = 8;
+    pool.set_capacity(frames);
+
+    HeapFile file("_test_buffer_pool");
+    file.create();
+    const BlockID n_blocks = 3 * frames;
+    for (BlockID block_id = 1; block_id <= n_blocks; block_id++) {
+        SlottedPage* page = block_id == 1 ? file.get(1) : file.get_new();
+        Dbt record(&block_id, sizeof(block_id));
+        page->add(&record);
+        file.put(page);
+        delete page;
+    }
+    if (pool.get_pinned_count() != 0)
+        return assertion_failure("pages not unpinned on delete", pool.get_pinned_count());
+
+    // the last block written is still resident
+    BufferPoolStats before = pool.get_stats();
+    if (!test_buffer_pool_block(file, n_blocks))
+        return assertion_failure("resident block has wrong contents");
+    if (pool.get_stats().hits != before.hits + 1)
+        return assertion_failure("re-reading a resident block was not a hit");
+    std::cout << "buffer pool hit ok" << std::endl;
+
+    // the early blocks were evicted (and written back) and have to be read again
+    before = pool.get_stats();
+    for (BlockID block_id = 1; block_id <= n_blocks; block_id++)
+        if (!test_buffer_pool_block(file, block_id))
+            return assertion_failure("evicted block has wrong contents", block_id);
+    if (pool.get_stats().misses <= before.misses || pool.get_stats().evictions <= before.evictions)
+        return assertion_failure("expected misses and evictions re-reading every block");
+    std::cout << "buffer pool eviction/write-back ok: " << pool.get_stats() << std::endl;
+
+    // every frame pinned
+    std::vector<SlottedPage*> pinned;
+    for (BlockID block_id = 1; block_id <= frames; block_id++)
+        pinned.push_back(file.get(block_id));
+    bool threw = false;
+    try {
+        delete file.get(frames + 1);
+    } catch (DbRelationError& e) {
+        threw = true;
+    }
+    for (auto page: pinned)
+        delete page;
+    if (!threw)
+        return assertion_failure("failed to throw when every frame is pinned");
+    std::cout << "buffer pool exhaustion ok" << std::endl;
+
+    // a pinned block cannot be thrown away under its holder
+    SlottedPage* held = file.get(n_blocks);
+    threw = false;
+    try {
+        file.truncate(n_blocks - 1);
+    } catch (DbRelationError& e) {
+        threw = true;
+    }
+    bool still_held = file.get_last_block_id() == n_blocks && pool.get_pinned_count() == 1;
+    delete held;
+    if (!threw || !still_held || pool.get_pinned_count() != 0)
+        return assertion_failure("discarding a pinned block should throw and leave it pinned");
+
+    // a block pinned through two handles on the file is still written back after one of them closes
+    HeapFile other("_test_buffer_pool");
+    other.open();
+    held = other.get(1);
+    delete file.get(1);  // the frame was last pinned through file
+    file.close();
+    other.put(held);
+    delete held;
+    bool written = true;
+    try {
+        pool.checkpoint();
+    } catch (DbRelationError& e) {
+        written = false;
+    }
+    other.close();
+    file.open();
+    if (!written)
+        return assertion_failure("block changed through the handle left open was not written back");
+
+    file.drop();
+    pool.set_capacity(capacity);
+    return true;
+}
+
+/**
+ * Test helper. HeapTable::marshal as it was before RowCodec, kept to time RowCodec against: the column types are
+ * looked up by name for every row, and every row is built in a block-sized buffer and copied out.
+ * @return  the marshaled row (freed by caller, along with its bytes)
+ */
+Dbt* test_old_marshal(const ColumnNames& column_names, const ColumnAttributes& column_attributes, const ValueDict* row) {
+    char* bytes = new char[DbBlock::BLOCK_SZ];
+    uint offset = 0;
+    uint col_num = 0;
+    for (auto const& column_name: column_names) {
+        ColumnAttribute ca = column_attributes[col_num++];
+        ValueDict::const_iterator column = row->find(column_name);
+        Value value = column->second;
+        if (ca.get_data_type() == ColumnAttribute::DataType::INT) {
+            *(int32_t*) (bytes + offset) = value.n;
+            offset += sizeof(int32_t);
+        } else if (ca.get_data_type() == ColumnAttribute::DataType::TEXT) {
+            u_long size = value.s.length();
+            *(u_int16_t*) (bytes + offset) = (u_int16_t) size;
+            offset += sizeof(u_int16_t);
+            std::memcpy(bytes + offset, value.s.c_str(), size);
+            offset += size;
+        } else {
+            *(uint8_t*) (bytes + offset) = (uint8_t) value.n;
+            offset += sizeof(uint8_t);
+        }
+    }
+    char* right_size_bytes = new char[offset];
+    std::memcpy(right_size_bytes, bytes, offset);
+    delete[] bytes;
+    return new Dbt(right_size_bytes, offset);
+}
+
+/**
+ * Test helper. HeapTable::unmarshal as it was before RowCodec (see test_old_marshal).
+ * @return  the row's values (freed by caller)
+ */
+ValueDict* test_old_unmarshal(const ColumnNames& column_names, const ColumnAttributes& column_attributes, Dbt* data) {
+    ValueDict* row = new ValueDict();
+    Value value;
+    char* bytes = (char*) data->get_data();
+    uint offset = 0;
+    uint col_num = 0;
+    for (auto const& column_name: column_names) {
+        ColumnAttribute ca = column_attributes[col_num++];
+        value.data_type = ca.get_data_type();
+        if (ca.get_data_type() == ColumnAttribute::DataType::INT) {
+            value.n = *(int32_t*) (bytes + offset);
+            offset += sizeof(int32_t);
+        } else if (ca.get_data_type() == ColumnAttribute::DataType::TEXT) {
+            u_int16_t size = *(u_int16_t*) (bytes + offset);
+            offset += sizeof(u_int16_t);
+            char buffer[DbBlock::BLOCK_SZ];
+            std::memcpy(buffer, bytes + offset, size);
+            buffer[size] = '\0';
+            value.s = std::string(buffer);
+            offset += size;
+        } else {
+            value.n = *(uint8_t*) (bytes + offset);
+            offset += sizeof(uint8_t);
+        }
+        (*row)[column_name] = value;
+    }
+    return row;
+}
+
+/**
+ * Round-trip rows through a RowCodec, check in-place predicates, and time pulling one column
+ * out of a row against decoding the whole row into a ValueDict (what unmarshal used to do).
+ * @return true if the tests all succeeded
+ */
+bool test_row_codec() {
+    std::cout << std::endl;
+    DataTypes data_types = {ColumnAttribute::DataType::INT, ColumnAttribute::DataType::TEXT,
+                            ColumnAttribute::DataType::BOOLEAN, ColumnAttribute::DataType::TEXT,
+                            ColumnAttribute::DataType::INT};
+    ColumnNames column_names = {"a", "b", "c", "d", "e"};
+    RowCodec codec(data_types);
+    Value yes(1);
+    yes.data_type = ColumnAttribute::DataType::BOOLEAN;
+    std::vector<Value> row = {Value(-12), Value("hello"), yes, Value(""), Value(99)};
+    char bytes[DbBlock::BLOCK_SZ];
+    uint size = codec.size(row);
+    if (codec.encode(row, bytes) != size || size != 4 + 7 + 1 + 2 + 4)
+        return assertion_failure("wrong encoded size", size);
+
+    std::vector<Value> all;
+    codec.decode(bytes, all);
+    if (all != row)
+        return assertion_failure("full decode does not round-trip");
+    for (uint i = 0; i < row.size(); i++)
+        if (codec.decode(bytes, i) != row[i])
+            return assertion_failure("single column decode wrong", i);
+    std::vector<Value> some;
+    codec.decode(bytes, {4, 1}, some);
+    if (some.size() != 2 || some[0] != row[4] || some[1] != row[1])
+        return assertion_failure("partial decode wrong");
+    std::cout << "row codec round trip ok" << std::endl;
+
+    Value hello("hello"), goodbye("goodbye"), ninety_nine(99);
+    if (!codec.matches(bytes, {ColumnPredicate(1, &hello), ColumnPredicate(2, &yes), ColumnPredicate(4, &ninety_nine)}))
+        return assertion_failure("predicates should match");
+    if (codec.matches(bytes, {ColumnPredicate(1, &goodbye)}) || codec.matches(bytes, {ColumnPredicate(0, &ninety_nine)}))
+        return assertion_failure("predicates should not match");
+    std::cout << "row codec matches ok" << std::endl;
+
+    // index keys must sort bytewise in the same order as their values
+    KeyCodec key_codec({ColumnAttribute::DataType::INT, ColumnAttribute::DataType::TEXT});
+    std::vector<std::vector<Value>> keys = {
+            {Value(-2147483647 - 1), Value("z")}, {Value(-300), Value("")}, {Value(-1), Value("b")},
+            {Value(0), Value("")}, {Value(0), Value("a")}, {Value(0), Value(std::string("a\0", 2))},
+            {Value(0), Value("ab")}, {Value(0), Value("b")}, {Value(256), Value("a")}, {Value(2147483647), Value("")}};
+    KeyBytes previous;
+    for (uint i = 0; i < keys.size(); i++) {
+        KeyBytes key = key_codec.encode(keys[i]);
+        if (i > 0 && !(previous < key && KeyCodec::compare(previous.data(), (uint) previous.size(), key.data(),
+                                                            (uint) key.size()) < 0))
+            return assertion_failure("key codec order wrong", i);
+        std::vector<Value> decoded;
+        key_codec.decode(key.data(), decoded);
+        if (decoded != keys[i])
+            return assertion_failure("key codec does not round-trip", i);
+        previous = key;
+    }
+    std::cout << "key codec order ok" << std::endl;
+
+    // a row to and from its bytes, the way HeapTable::marshal/unmarshal used to and the way RowCodec does
+    const uint n = 200000;
+    ColumnAttributes column_attributes;
+    for (auto data_type: data_types)
+        column_attributes.push_back(ColumnAttribute(data_type));
+    ValueDict row_dict;
+    for (uint j = 0; j < column_names.size(); j++)
+        row_dict[column_names[j]] = row[j];
+    long old_checksum = 0, new_checksum = 0;
+    auto old_start = std::chrono::steady_clock::now();
+    for (uint i = 0; i < n; i++) {
+        Dbt* data = test_old_marshal(column_names, column_attributes, &row_dict);
+        ValueDict* dict = test_old_unmarshal(column_names, column_attributes, data);
+        old_checksum += (*dict)["e"].n;
+        delete dict;
+        delete[] (char*) data->get_data();
+        delete data;
+    }
+    // RowCodec as HeapTable uses it: the values in column order, and no ValueDict unless a row is projected
+    auto new_start = std::chrono::steady_clock::now();
+    std::vector<const Value*> values(column_names.size());
+    std::vector<Value> decoded;
+    char encoded[DbBlock::BLOCK_SZ];
+    for (uint i = 0; i < n; i++) {
+        for (uint j = 0; j < column_names.size(); j++)
+            values[j] = &row_dict.at(column_names[j]);
+        codec.encode(values, encoded);
+        codec.decode(encoded, decoded);
+        new_checksum += decoded[4].n;
+    }
+    auto new_end = std::chrono::steady_clock::now();
+    long dict_checksum = 0;
+    for (uint i = 0; i < n; i++) {
+        for (uint j = 0; j < column_names.size(); j++)
+            values[j] = &row_dict.at(column_names[j]);
+        codec.encode(values, encoded);
+        codec.decode(encoded, decoded);
+        ValueDict dict;
+        for (uint j = 0; j < column_names.size(); j++)
+            dict[column_names[j]] = decoded[j];
+        dict_checksum += dict["e"].n;
+    }
+    auto dict_end = std::chrono::steady_clock::now();
+    if (old_checksum != (long) n * 99 || new_checksum != old_checksum || dict_checksum != old_checksum)
+        return assertion_failure("wrong checksum marshaling rows");
+    auto old_us = std::chrono::duration_cast<std::chrono::microseconds>(new_start - old_start).count();
+    auto new_us = std::chrono::duration_cast<std::chrono::microseconds>(new_end - new_start).count();
+    auto dict_us = std::chrono::duration_cast<std::chrono::microseconds>(dict_end - new_end).count();
+    std::cout << "encode and decode " << n << " rows: old marshal/unmarshal " << old_us << "us, RowCodec "
+              << new_us << "us (" << dict_us << "us with the row decoded into a ValueDict)" << std::endl;
+
+    long checksum = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (uint i = 0; i < n; i++) {
+        std::vector<Value> values;
+        codec.decode(bytes, values);
+        ValueDict dict;
+        for (uint j = 0; j < column_names.size(); j++)
+            dict[column_names[j]] = values[j];
+        checksum += dict["e"].n;
+    }
+    auto middle = std::chrono::steady_clock::now();
+    for (uint i = 0; i < n; i++)
+        checksum += codec.decode(bytes, 4).n;
+    auto end = std::chrono::steady_clock::now();
+    if (checksum != 2L * n * 99)
+        return assertion_failure("wrong checksum");
+    auto full_us = std::chrono::duration_cast<std::chrono::microseconds>(middle - start).count();
+    auto one_us = std::chrono::duration_cast<std::chrono::microseconds>(end - middle).count();
+    std::cout << "decode " << n << " rows: whole row to ValueDict " << full_us << "us, one column "
+              << one_us << "us" << std::endl;
     return true;
 }